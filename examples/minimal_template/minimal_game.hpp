@@ -74,15 +74,14 @@ public:
 
   void update(
       vector<message>& out_messages,
+      vector<std::string>& broadcasts,
       const vector<message>& in_messages,
       long delta_time
     )
   {
     for(const message& msg : in_messages) {
-      for(player_id pid : m_player_list) {
-        json temp = { { "pid", msg.first }, { "message", msg.second } };
-        out_messages.emplace_back(pid, temp.dump());
-      }
+      json temp = { { "pid", msg.first }, { "message", msg.second } };
+      broadcasts.push_back(temp.dump());
     }
   }
 
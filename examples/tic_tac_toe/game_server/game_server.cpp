@@ -7,7 +7,8 @@
 
 #include <simple_web_game_server/game_server.hpp>
 #include <json_traits/nlohmann_traits.hpp>
-#include <websocketpp_configs/asio_tls_no_logs.hpp>
+#include <codec_traits/nlohmann_codecs.hpp>
+#include <websocketpp_configs/asio_tls_deflate_no_logs.hpp>
 
 #include "../tic_tac_toe_game.hpp"
 
@@ -15,7 +16,14 @@ using namespace std::chrono_literals;
 using ttt_server = simple_web_game_server::game_server<
     tic_tac_toe_game,
     jwt::default_clock, nlohmann_traits,
-    asio_tls_no_logs
+    // full game states compress well, so offer permessage-deflate
+    asio_tls_deflate_no_logs,
+    simple_web_game_server::default_close_reasons,
+    // browsers that request no subprotocol are sent JSON
+    simple_web_game_server::codec_list<
+        nlohmann_json_codec,
+        nlohmann_msgpack_codec
+      >
   >;
 
 using claim = jwt::basic_claim<nlohmann_traits>;
@@ -96,6 +104,9 @@ int main() {
 
   gs.set_tls_init_handler(tls_init);
 
+  // players reconnect with the same game token, so skip repeat verifications
+  gs.set_token_cache_size(4096);
+
   // any of the processes below can be managed by multiple threads for higher
   // performance on multi-threaded machines
 
@@ -3,6 +3,8 @@
 
 #include <spdlog/spdlog.h>
 
+#include <simple_web_game_server/rating_index.hpp>
+
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
@@ -173,7 +175,8 @@ class tic_tac_toe_game {
 public:
   using player_traits = tic_tac_toe_player_traits;
   using player_id = player_traits::id::player_id;
-  using message = std::pair<player_id, std::string>;
+  // messages are decoded and encoded by the game_server's codecs
+  using message = std::pair<player_id, json>;
 
   tic_tac_toe_game(const json& msg) : m_valid(true), m_started(false),
     m_game_over(false), m_turn(0), m_state(0), m_times({ 100000, 100000 }),
@@ -201,7 +204,7 @@ public:
     m_data_map[id].is_connected = true;
 
     if(m_started) {
-      out_messages.emplace_back(id, get_full_state(id).dump());
+      out_messages.emplace_back(id, get_full_state(id));
     }
   }
 
@@ -211,6 +214,7 @@ public:
 
   void update(
       vector<message>& out_messages,
+      vector<json>& broadcasts,
       const vector<message>& in_messages,
       long delta_time
     )
@@ -227,32 +231,19 @@ public:
       }
 
       m_elapsed_time += delta_time;
+      // time and game state are the same for every player, so they are
+      // broadcast to the whole session
       if(m_elapsed_time >= 1000) {
-        for(player_id player : m_player_list) {
-          if(m_data_map[player].is_connected) {
-            out_messages.emplace_back(player, get_time_state().dump());
-          }
-        }
+        broadcasts.push_back(get_time_state());
         m_elapsed_time = 0;
       }
 
       if(is_done()) {
-        for(player_id player : m_player_list) {
-          if(m_data_map[player].is_connected) {
-            out_messages.emplace_back(player, get_game_state(player).dump());
-          }
-        }
+        broadcasts.push_back(get_game_state());
       }
 
       for(const message& msg : in_messages) {
-        json msg_json = json::parse(msg.second, nullptr, false);
-        if(msg_json.is_discarded()) {
-          spdlog::debug(
-              "player {} sent invalid json: {}", msg.first, msg.second
-            );
-        } else {
-          player_update(out_messages, msg.first, msg_json);
-        }
+        player_update(broadcasts, msg.first, msg.second);
       }
     } else {
       if(m_valid && (m_player_list.size() > 1)) {
@@ -270,7 +261,7 @@ public:
 
         for(player_id player : m_player_list) {
           if(m_data_map[player].is_connected) {
-            out_messages.emplace_back(player, get_full_state(player).dump());
+            out_messages.emplace_back(player, get_full_state(player));
           }
         }
       }
@@ -304,16 +295,27 @@ public:
     return m_valid;
   }
 
+  // only the newest clock update matters, so a client that falls behind
+  // is sent the latest one rather than every stale copy
+  std::size_t get_broadcast_conflation_key(const json& msg) const {
+    if(msg.size() == 1 && msg.contains("times")) {
+      return TIME_STATE_KEY;
+    }
+    return 0;
+  }
+
 private:
+  static constexpr std::size_t TIME_STATE_KEY = 1;
+
   void player_update(
-      vector<message>& msg_list,
+      vector<json>& broadcasts,
       player_id id,
       const json& data
     )
   {
     try {
-      unsigned int i = data["move"][0].get<unsigned int>();
-      unsigned int j = data["move"][1].get<unsigned int>();
+      unsigned int i = data.at("move")[0].get<unsigned int>();
+      unsigned int j = data.at("move")[1].get<unsigned int>();
 
       if(m_started && !is_done()) {
         if(id == m_player_list[m_turn])
@@ -321,12 +323,8 @@ private:
           int value = BOARD_VALUES[m_turn];
           if(m_board.add_move(i, j, value)) {
             m_turn = (m_turn + 1) % 2;
-            m_move_list.push_back(data["move"]);
-            for(player_id player : m_player_list) {
-              if(m_data_map[player].is_connected) {
-                msg_list.emplace_back(player, get_game_state(player).dump());
-              }
-            }
+            m_move_list.push_back(data.at("move"));
+            broadcasts.push_back(get_game_state());
           } else {
             spdlog::debug(
                 "player {} sent invalid move: {}", id, data.dump()
@@ -343,7 +341,7 @@ private:
     }
   }
 
-  json get_game_state(player_id id) const {
+  json get_game_state() const {
     json game_json;
     game_json["board"] = m_board.get_board();
     game_json["times"] = m_times;
@@ -355,7 +353,7 @@ private:
   }
 
   json get_full_state(player_id id) const {
-    json game_json = get_game_state(id);
+    json game_json = get_game_state();
     game_json["player"] = (id == m_player_list.front()) ? 0 : 1;
 
     return game_json;
@@ -422,52 +420,38 @@ public:
   };
 
   using session_data_map = typename player_traits::id::session_id_map<session_data>;
+  using rating_index = simple_web_game_server::rating_index<
+      session_id, int, player_traits::id::hash
+    >;
 
   bool can_match(const session_data_map& session_map) {
     return session_map.size() > 1;
   }
 
+  int get_rating(const session_data& data) const {
+    return data.rating;
+  }
+
   void match(
       vector<game>& game_list,
       vector<message>& messages,
       const session_data_map& session_map,
+      rating_index& index,
       long delta_time
     )
   {
     m_elapsed_time += delta_time;
     if(m_elapsed_time > 5000) {
       m_elapsed_time = 0;
-      unordered_set<session_id> matched;
-      for(auto it1 = session_map.begin(); it1 != session_map.end(); ++it1) {
-        if(matched.count(it1->first) > 0) {
-          continue;
-        }
-        int min_score = 100000;
-        session_id partner;
-        auto temp = it1;
-        for(auto it2 = ++temp; it2 != session_map.end(); ++it2) {
-          if(matched.count(it2->first) > 0) {
-            continue;
-          }
-          int score = std::abs(it1->second.rating - it2->second.rating);
-          if(score < min_score) {
-            partner = it2->first;
-            min_score = score;
-          }
-        }
-
-        if(min_score <= 250) {
+      index.match_pairs(250, [&](session_id a, session_id b) {
           game_list.emplace_back(
             game{
-              { it1->first, partner },
-              it1->first,
+              { a, b },
+              a,
               json{ { "matched", true } }
             }
           );
-          matched.insert(it1->first);
-          matched.insert(partner);
-        }
-      }
+        });
     }
   }
 
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_ACTION_QUEUE_HPP
+#define JWT_GAME_SERVER_ACTION_QUEUE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace simple_web_game_server {
+  /// A multi-producer multi-consumer queue split into independent shards.
+  /**
+   * Each shard has its own lock, queue, and condition variable, so producers
+   * and consumers working on different shards never contend. Values pushed
+   * with the same key always land in the same shard, and each shard is a
+   * FIFO queue, so the relative order of values with the same key is kept
+   * so long as each shard is consumed by a single worker.
+   *
+   * Workers call add_worker() once and then take values with pop_worker().
+   * With T workers and S > T shards, worker i drains shards i, i + T,
+   * i + 2T, and so on, so every shard is drained however few workers run;
+   * with at least S workers, worker i < S is bound to shard i and waits
+   * only on that shard's condition variable, while any further workers
+   * stay idle until the queue stops. A shard is held by the worker that
+   * last popped from it until that worker's next call to pop_worker(), so
+   * no two workers ever handle values of the same shard at once, even
+   * while shards move to a newly added worker.
+   *
+   * Each shard stores its values in a circular buffer that keeps its
+   * capacity, so once a shard has grown to its peak size pushes and pops
+   * never allocate. The value type must be default constructible.
+   */
+  template<typename value>
+  class action_queue {
+  private:
+    // a FIFO queue in a circular buffer whose capacity is a power of two
+    class ring_buffer {
+    public:
+      ring_buffer() : m_head(0), m_size(0) {}
+
+      bool empty() const {
+        return m_size == 0;
+      }
+
+      std::size_t size() const {
+        return m_size;
+      }
+
+      void push_back(value&& v) {
+        if(m_size == m_values.size()) {
+          grow();
+        }
+        m_values[(m_head + m_size) & (m_values.size() - 1)] = std::move(v);
+        ++m_size;
+      }
+
+      value& front() {
+        return m_values[m_head];
+      }
+
+      // resets the popped slot so it does not hold on to any resources
+      void pop_front() {
+        m_values[m_head] = value{};
+        m_head = (m_head + 1) & (m_values.size() - 1);
+        --m_size;
+      }
+
+      value& operator[](std::size_t i) {
+        return m_values[(m_head + i) & (m_values.size() - 1)];
+      }
+
+      void clear() {
+        while(!empty()) {
+          pop_front();
+        }
+        m_head = 0;
+      }
+
+    private:
+      void grow() {
+        std::vector<value> values(std::max<std::size_t>(16, 2 * m_size));
+        for(std::size_t i = 0; i < m_size; ++i) {
+          values[i] = std::move((*this)[i]);
+        }
+        m_values.swap(values);
+        m_head = 0;
+      }
+
+      std::vector<value> m_values;
+      std::size_t m_head;
+      std::size_t m_size;
+    };
+
+    struct shard {
+      shard() : wake(false), is_held(false) {}
+
+      ring_buffer values;
+      std::mutex lock;
+      std::condition_variable cond;
+      // set to wake the worker waiting on this shard when a value arrives
+      // on another of the shards it drains
+      bool wake;
+      // set while a worker handles a value popped from this shard
+      bool is_held;
+    };
+
+  public:
+    /// Constructs a stopped queue with the given number of shards.
+    explicit action_queue(std::size_t shard_count = 1) : m_is_running(false),
+      m_worker_count(0)
+    {
+      resize(shard_count);
+    }
+
+    /// Sets the number of shards; may only be called while stopped.
+    /**
+     * Any values remaining in the queue are discarded.
+     */
+    void resize(std::size_t shard_count) {
+      if(shard_count == 0) {
+        shard_count = 1;
+      }
+      m_shards.reset(new shard[shard_count]);
+      m_cursors.reset(new std::size_t[shard_count]());
+      m_held.reset(new std::size_t[shard_count]());
+      m_shard_count = shard_count;
+      m_worker_count = 0;
+    }
+
+    /// Returns the number of shards.
+    std::size_t shard_count() const {
+      return m_shard_count;
+    }
+
+    /// Returns the shard assigned to values pushed with the given key.
+    std::size_t get_shard(const void* key) const {
+      // mix the pointer bits since allocations share their low order bits
+      std::uint64_t x = reinterpret_cast<std::uintptr_t>(key);
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33;
+      return static_cast<std::size_t>(x % m_shard_count);
+    }
+
+    /// Registers a new worker and returns its index for pop_worker().
+    /**
+     * The shards are spread over the workers registered since the queue was
+     * last started, so running exactly shard_count() workers gives each
+     * shard a dedicated worker, and workers beyond shard_count() are idle.
+     * Adding a worker while fewer than shard_count() run moves some shards
+     * to the new worker, which waits for the old one to finish with any
+     * value it holds from them.
+     */
+    std::size_t add_worker() {
+      const std::size_t worker = m_worker_count++;
+      if(worker >= m_shard_count) {
+        return worker;
+      }
+
+      // wake the waiting workers so each picks up its new set of shards
+      for(std::size_t i = 0; i < m_shard_count; ++i) {
+        {
+          std::lock_guard<std::mutex> guard(m_shards[i].lock);
+          m_shards[i].wake = true;
+        }
+        m_shards[i].cond.notify_all();
+      }
+      return worker;
+    }
+
+    /// Allows values to be pushed and popped.
+    /**
+     * Forgets the workers of any previous run, which must all have returned
+     * from pop_worker() after the queue was stopped.
+     */
+    void start() {
+      for(std::size_t i = 0; i < m_shard_count; ++i) {
+        std::lock_guard<std::mutex> guard(m_shards[i].lock);
+        m_shards[i].values.clear();
+        m_shards[i].wake = false;
+        m_shards[i].is_held = false;
+        m_cursors[i] = 0;
+        m_held[i] = 0;
+      }
+      m_worker_count = 0;
+      m_is_running = true;
+    }
+
+    /// Wakes all waiting workers and rejects further pushes.
+    /**
+     * Values left in the queue may be collected afterwards with drain().
+     */
+    void stop() {
+      for(std::size_t i = 0; i < m_shard_count; ++i) {
+        {
+          std::lock_guard<std::mutex> guard(m_shards[i].lock);
+          m_is_running = false;
+        }
+        m_shards[i].cond.notify_all();
+      }
+      {
+        std::lock_guard<std::mutex> guard(m_idle_lock);
+      }
+      m_idle_cond.notify_all();
+    }
+
+    /// Pushes a value onto the given shard and wakes one of its workers.
+    /**
+     * Returns false, without pushing, if the queue is stopped.
+     */
+    bool push(std::size_t i, value&& v) {
+      shard& s = m_shards[i];
+      {
+        std::lock_guard<std::mutex> guard(s.lock);
+        if(!m_is_running) {
+          return false;
+        }
+        s.values.push_back(std::move(v));
+      }
+      notify(i, false);
+      return true;
+    }
+
+    /// Pushes a value onto the given shard if it holds fewer than limit values.
+    /**
+     * Returns false, leaving v untouched, if the queue is stopped or the
+     * shard is full.
+     */
+    bool try_push(std::size_t i, value&& v, std::size_t limit) {
+      shard& s = m_shards[i];
+      {
+        std::lock_guard<std::mutex> guard(s.lock);
+        if(!m_is_running || s.values.size() >= limit) {
+          return false;
+        }
+        s.values.push_back(std::move(v));
+      }
+      notify(i, false);
+      return true;
+    }
+
+    /// Pushes all values in v onto the given shard and wakes its workers.
+    /**
+     * The shard lock is taken once for the whole batch and v is left empty.
+     * Returns false, without pushing, if the queue is stopped.
+     */
+    bool push_bulk(std::size_t i, std::vector<value>& v) {
+      if(v.empty()) {
+        return m_is_running;
+      }
+
+      shard& s = m_shards[i];
+      {
+        std::lock_guard<std::mutex> guard(s.lock);
+        if(!m_is_running) {
+          return false;
+        }
+        for(value& x : v) {
+          s.values.push_back(std::move(x));
+        }
+      }
+      v.clear();
+      notify(i, true);
+      return true;
+    }
+
+    /// Waits for a value on the given shard.
+    /**
+     * Returns false if the queue was stopped before a value was available.
+     */
+    bool pop(std::size_t i, value& v) {
+      shard& s = m_shards[i];
+      std::unique_lock<std::mutex> lock(s.lock);
+      while(s.values.empty()) {
+        if(!m_is_running) {
+          return false;
+        }
+        s.cond.wait(lock);
+      }
+
+      v = std::move(s.values.front());
+      s.values.pop_front();
+      return true;
+    }
+
+    /// Waits for a value on any of the shards drained by the given worker.
+    /**
+     * The worker index is one returned by add_worker(). The worker's shards
+     * are visited in turn so that none of them is starved. Calling this
+     * releases the shard of the value the worker popped last, so a worker
+     * must be done with a value before it asks for the next. Returns false
+     * if the queue was stopped before a value was available, and always
+     * waits for the queue to stop if the worker is idle.
+     */
+    bool pop_worker(std::size_t worker, value& v) {
+      if(worker >= m_shard_count) {
+        std::unique_lock<std::mutex> lock(m_idle_lock);
+        while(m_is_running) {
+          m_idle_cond.wait(lock);
+        }
+        return false;
+      }
+
+      release(worker);
+      while(true) {
+        // the worker drains the shards congruent to it modulo the number of
+        // active workers
+        const std::size_t worker_count = std::min<std::size_t>(
+            m_worker_count, m_shard_count
+          );
+        const std::size_t owned = (m_shard_count - worker - 1) / worker_count
+          + 1;
+        std::size_t& cursor = m_cursors[worker];
+        for(std::size_t j = 0; j < owned; ++j) {
+          cursor = (cursor + 1) % owned;
+          const std::size_t i = worker + cursor * worker_count;
+          shard& s = m_shards[i];
+          std::lock_guard<std::mutex> guard(s.lock);
+          if(!s.values.empty() && !s.is_held) {
+            v = std::move(s.values.front());
+            s.values.pop_front();
+            s.is_held = true;
+            m_held[worker] = i + 1;
+            return true;
+          }
+        }
+
+        shard& home = m_shards[worker];
+        std::unique_lock<std::mutex> lock(home.lock);
+        if(!m_is_running) {
+          return false;
+        }
+        while((home.values.empty() || home.is_held) && !home.wake
+            && m_is_running)
+        {
+          home.cond.wait(lock);
+        }
+        home.wake = false;
+      }
+    }
+
+    /// Removes all remaining values, passing each to the function f.
+    void drain(const std::function<void(value&)>& f) {
+      for(std::size_t i = 0; i < m_shard_count; ++i) {
+        std::lock_guard<std::mutex> guard(m_shards[i].lock);
+        ring_buffer& values = m_shards[i].values;
+        for(std::size_t j = 0; j < values.size(); ++j) {
+          f(values[j]);
+        }
+        values.clear();
+      }
+    }
+
+    /// Returns the total number of values currently queued.
+    std::size_t size() {
+      std::size_t total = 0;
+      for(std::size_t i = 0; i < m_shard_count; ++i) {
+        std::lock_guard<std::mutex> guard(m_shards[i].lock);
+        total += m_shards[i].values.size();
+      }
+      return total;
+    }
+
+  private:
+    // releases the shard the worker last popped from, waking its current
+    // worker if values arrived on it in the meantime
+    void release(std::size_t worker) {
+      if(m_held[worker] == 0) {
+        return;
+      }
+      const std::size_t i = m_held[worker] - 1;
+      m_held[worker] = 0;
+
+      bool is_waiting;
+      {
+        std::lock_guard<std::mutex> guard(m_shards[i].lock);
+        m_shards[i].is_held = false;
+        is_waiting = !m_shards[i].values.empty();
+      }
+      if(is_waiting) {
+        notify(i, false);
+      }
+    }
+
+    // wakes a worker draining shard i; a worker draining several shards
+    // waits on the first of them, its home shard
+    void notify(std::size_t i, bool all) {
+      const std::size_t worker_count = m_worker_count;
+      if(worker_count > 0 && worker_count < m_shard_count
+          && i >= worker_count)
+      {
+        shard& home = m_shards[i % worker_count];
+        {
+          std::lock_guard<std::mutex> guard(home.lock);
+          home.wake = true;
+        }
+        home.cond.notify_one();
+      } else if(all) {
+        m_shards[i].cond.notify_all();
+      } else {
+        m_shards[i].cond.notify_one();
+      }
+    }
+
+    std::unique_ptr<shard[]> m_shards;
+    // the shard each worker draining several shards visits next
+    std::unique_ptr<std::size_t[]> m_cursors;
+    // one more than the shard each worker holds, or zero
+    std::unique_ptr<std::size_t[]> m_held;
+    // idle workers wait here for the queue to stop
+    std::mutex m_idle_lock;
+    std::condition_variable m_idle_cond;
+    std::size_t m_shard_count;
+    std::atomic<bool> m_is_running;
+    std::atomic<std::size_t> m_worker_count;
+  };
+}
+
+#endif // JWT_GAME_SERVER_ACTION_QUEUE_HPP
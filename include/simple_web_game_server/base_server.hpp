@@ -23,6 +23,11 @@
 #ifndef JWT_GAME_SERVER_BASE_SERVER_HPP
 #define JWT_GAME_SERVER_BASE_SERVER_HPP
 
+#include "action_queue.hpp"
+#include "token_cache.hpp"
+#include "metrics.hpp"
+#include "message_tracer.hpp"
+
 #include <websocketpp/server.hpp>
 #include <websocketpp/common/asio_ssl.hpp>
 #include <websocketpp/common/asio.hpp>
@@ -32,17 +37,22 @@
 #include <spdlog/spdlog.h>
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <set>
 #include <string>
 #include <map>
 
+#include <algorithm>
 #include <utility>
+#include <tuple>
+#include <memory>
+#include <type_traits>
 
 #include <functional>
 
 #include <atomic>
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
 
 /**
@@ -53,12 +63,14 @@ namespace simple_web_game_server {
   /// The type for a connection handle in a websocketpp server.
   using websocketpp::connection_hdl;
 
+  /// The WebSocket opcodes, opcode::text and opcode::binary, of a message.
+  namespace opcode = websocketpp::frame::opcode;
+
   // datatype implementations
   using std::vector;
   using std::pair;
   using std::set;
   using std::map;
-  using std::queue;
 
   // functional types
   using std::function;
@@ -69,8 +81,10 @@ namespace simple_web_game_server {
   // threading type implementations
   using std::atomic;
   using std::mutex;
+  using std::shared_mutex;
   using std::lock_guard;
   using std::unique_lock;
+  using std::shared_lock;
   using std::condition_variable;
 
   /// A struct defining default close message strings.
@@ -87,8 +101,54 @@ namespace simple_web_game_server {
     static inline std::string session_complete() {
       return "SESSION_COMPLETE";
     };
+    static inline std::string server_busy() {
+      return "SERVER_BUSY";
+    };
+    static inline std::string slow_consumer() {
+      return "SLOW_CONSUMER";
+    };
+    static inline std::string pending_overflow() {
+      return "PENDING_OVERFLOW";
+    };
+  };
+
+  /// What a base_server does when a connection exceeds its outbound budget.
+  /**
+   * Messages to a connection are held by the server once the connection's
+   * write buffer is above its limit, see
+   * base_server::set_write_buffer_limit, and the policy is applied whenever
+   * the held messages exceed their budget. Only messages sent as droppable
+   * are ever dropped; if no droppable message is held the connection is
+   * closed with close_reasons::slow_consumer(). Messages sent with a
+   * conflation key replace the held message with the same key regardless
+   * of the policy, see base_server::send_message.
+   */
+  enum class slow_consumer_policy {
+    /// Drop the oldest held droppable messages until within budget.
+    drop_oldest,
+    /// Drop every held droppable message but the newest, which supersedes
+    /// them.
+    coalesce,
+    /// Close the connection.
+    close
   };
   
+  /// Detects whether a permessage_deflate extension type can compress.
+  /**
+   * True for websocketpp's permessage_deflate::enabled extension, and false
+   * for the permessage_deflate::disabled stub used by the default configs.
+   */
+  template<typename deflate, typename = void>
+  struct has_deflate_compressor : std::false_type {};
+
+  template<typename deflate>
+  struct has_deflate_compressor<
+      deflate,
+      std::void_t<decltype(
+          std::declval<deflate&>().enable_server_no_context_takeover()
+        )>
+    > : std::true_type {};
+
   /// A WebSocket server that performs authentication and manages sessions.
   /**
    * This class wraps an underlying websocketpp::server m_server.
@@ -99,7 +159,8 @@ namespace simple_web_game_server {
    * constructable and constructable from player_id and session_id. 
    *
    * The jwt_clock and json_traits parameters must meet the requirements of
-   * such template types in JWT++ library.
+   * such template types in JWT++ library, and jwt_clock must be default
+   * constructable.
    */
   template<typename player_traits, typename jwt_clock, typename json_traits,
     typename server_config, typename close_reasons>
@@ -119,6 +180,8 @@ namespace simple_web_game_server {
     using ws_server = websocketpp::server<server_config>;
     using message_ptr = typename ws_server::message_ptr;
     using connection_ptr = typename ws_server::connection_type::ptr;
+    using con_msg_manager = typename server_config::con_msg_manager_type;
+    using deflate_type = typename server_config::permessage_deflate_type;
 
     /// The type of a client id.
     using combined_id = typename player_traits::id; 
@@ -142,6 +205,25 @@ namespace simple_web_game_server {
     using ssl_context_ptr = 
       websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context>;
 
+    /// A snapshot of the JWT verification metrics of a base_server.
+    struct verification_stats {
+      /// The number of tokens waiting in the verification queue.
+      std::size_t queue_size;
+      /// The number of tokens that passed verification.
+      std::size_t verified;
+      /// The number of tokens that failed verification.
+      std::size_t rejected;
+      /// The number of connections closed because the queue was full.
+      std::size_t dropped;
+      /// The number of verified tokens found in the token cache.
+      std::size_t cache_hits;
+      /// The mean time from receiving a token to the end of its verification.
+      std::chrono::nanoseconds mean_latency;
+      /// The longest time from receiving a token to the end of its
+      /// verification.
+      std::chrono::nanoseconds max_latency;
+    };
+
   private:
     using time_point = std::chrono::time_point<clock>;
 
@@ -151,21 +233,136 @@ namespace simple_web_game_server {
       UNSUBSCRIBE,
       IN_MESSAGE,
       OUT_MESSAGE,
-      CLOSE_CONNECTION
+      CLOSE_CONNECTION,
+      VERIFY_TOKEN,
+      TOKEN_VERIFIED,
+      TOKEN_REJECTED,
+      ACTION_TYPE_COUNT
+    };
+
+    // the results of a client's attempt to open a session
+    enum open_result {
+      OPENED,
+      INVALID_TOKEN,
+      SESSION_COMPLETE,
+      SERVER_BUSY,
+      OPEN_RESULT_COUNT
+    };
+
+    // a message waiting to be written to a connection: a prepared frame
+    // shared by the recipients of a broadcast, or a payload and opcode
+    struct outbound_message {
+      std::string msg;
+      message_ptr frame;
+      opcode::value op;
+      bool compress;
+      bool droppable;
+      std::size_t conflation_key;
+      message_tracer::time_point trace;
+
+      std::size_t size() const {
+        return frame ? frame->get_payload().size() : msg.size();
+      }
+    };
+
+    /// The state attached to each open WebSocket connection.
+    /**
+     * Created when the connection opens and bound into its message and close
+     * handlers, so actions carry it directly and need no lookup. The id
+     * member is written once, before is_verified is set, when the client's
+     * JWT is verified.
+     *
+     * While the JWT waits in the verification pool, is_verifying is set and
+     * further messages from the client are held, with their opcodes, in
+     * pending_messages, up to the server's pending message limits. If the
+     * limits are exceeded, or the token is rejected, the connection is closed
+     * and is_rejected is set so that later messages and any token result are
+     * ignored. These members are only touched by the single worker handling
+     * the connection's shard, see action_queue, while login_data is also
+     * written by the verifier holding the VERIFY_TOKEN action, before it
+     * hands the result back to that worker.
+     *
+     * Outgoing messages held while the connection's write buffer is above
+     * the server's limit wait in held, and are guarded by out_lock along
+     * with the other outbound members, see deliver.
+     */
+    struct connection_data {
+      connection_data(connection_hdl h, std::size_t s, int v, bool z, bool d,
+          std::size_t p)
+        : hdl(h), shard(s), version(v), deflate(z), shared_deflate(d),
+          protocol(p), is_verifying(false), is_rejected(false),
+          pending_bytes(0), is_verified(false),
+          messages_sent(0), bytes_sent(0), held_bytes(0),
+          is_flush_scheduled(false), is_closing(false),
+          is_outbound_closed(false) {}
+
+      connection_hdl hdl;
+      std::size_t shard;
+      int version;
+      bool deflate;
+      bool shared_deflate;
+      std::size_t protocol;
+      bool is_verifying;
+      bool is_rejected;
+      time_point verify_start_time;
+      vector<pair<std::string, opcode::value> > pending_messages;
+      std::size_t pending_bytes;
+      json login_data;
+      combined_id id;
+      atomic<bool> is_verified;
+      atomic<std::size_t> messages_sent;
+      atomic<std::size_t> bytes_sent;
+
+      mutex out_lock;
+      std::deque<outbound_message> held;
+      std::size_t held_bytes;
+      bool is_flush_scheduled;
+      // close with close_reasons::session_complete() once held is written
+      bool is_closing;
+      // set once no more messages are written to the connection
+      bool is_outbound_closed;
+    };
+
+    using connection_data_ptr = std::shared_ptr<connection_data>;
+
+    // the events counted for slow consumers
+    enum slow_consumer_event {
+      HELD,
+      DROPPED,
+      COALESCED,
+      CONFLATED,
+      CLOSED,
+      SLOW_CONSUMER_EVENT_COUNT
     };
 
     /// The type of an action that may be submitted to queue for the worker
     /// threads running the process_messages() loop.
     struct action {
-      action(action_type t, connection_hdl h) : type(t), hdl(h) {}
-      action(action_type t, connection_hdl h, std::string&& m)
-        : type(t), hdl(h), msg(std::move(m)) {}
-      action(action_type t, connection_hdl h, const std::string& m)
-        : type(t), hdl(h), msg(m) {}
+      action() : type(SUBSCRIBE), op(opcode::text), compress(false) {}
+      action(action_type t, const connection_data_ptr& c) : type(t), conn(c),
+        op(opcode::text), compress(false) {}
+      action(action_type t, const connection_data_ptr& c, std::string&& m,
+          opcode::value o = opcode::text, bool z = false)
+        : type(t), conn(c), msg(std::move(m)), op(o), compress(z) {}
+      action(action_type t, const connection_data_ptr& c, const std::string& m)
+        : type(t), conn(c), msg(m), op(opcode::text), compress(false) {}
+      action(action_type t, const connection_data_ptr& c, const message_ptr& f)
+        : type(t), conn(c), frame(f), op(f->get_opcode()), compress(false) {}
 
       action_type type;
-      connection_hdl hdl;
+      connection_data_ptr conn;
       std::string msg;
+      message_ptr frame;
+      opcode::value op;
+      // whether msg is compressed on connections that negotiated
+      // permessage-deflate
+      bool compress;
+      // whether a slow consumer policy may drop the message
+      bool droppable = false;
+      // a held message with the same nonzero key is replaced by this one
+      std::size_t conflation_key = 0;
+      // when a sampled message entered its current stage, see message_tracer
+      message_tracer::time_point trace;
     };
 
     /// The type of the result data of given session.
@@ -241,8 +438,19 @@ namespace simple_web_game_server {
         const jwt::verifier<jwt_clock, json_traits>& v,
         function<std::string(const combined_id&, const json&)> f,
         std::chrono::milliseconds t
-      ) : m_is_running(false), m_jwt_verifier(v), m_get_result_str(f),
-          m_session_release_time(t), m_player_count(0),
+      ) : m_is_running(false), m_frame_manager(
+            std::make_shared<con_msg_manager>()
+          ), m_deflate_threshold(256), m_compression_threshold(256),
+          m_write_buffer_limit(1 << 20),
+          m_slow_consumer_policy(slow_consumer_policy::drop_oldest),
+          m_max_held_messages(1024), m_max_held_bytes(4 << 20),
+          m_jwt_verifier(v), m_get_result_str(f),
+          m_session_release_time(t),
+          m_verification_queue_size(1024), m_max_pending_messages(64),
+          m_max_pending_bytes(65536), m_verifier_count(0),
+          m_verified_count(0), m_rejected_count(0), m_dropped_count(0),
+          m_cache_hit_count(0), m_total_verify_ns(0), m_max_verify_ns(0),
+          m_player_count(0), m_tracer(m_metrics),
           m_handle_http([](connection_ptr){}),
           m_handle_open([](const combined_id&, json&&){}),
           m_handle_close([](const combined_id&){}),
@@ -250,14 +458,22 @@ namespace simple_web_game_server {
     {
       m_server.init_asio();
 
+      // close and message handlers are bound per connection in on_open
       m_server.set_open_handler(bind(&base_server::on_open, this,
         simple_web_game_server::_1));
-      m_server.set_close_handler(bind(&base_server::on_close, this,
+      m_server.set_validate_handler(bind(&base_server::on_validate, this,
         simple_web_game_server::_1));
-      m_server.set_message_handler(
-          bind(&base_server::on_message, this, simple_web_game_server::_1,
-            simple_web_game_server::_2)
-        );
+
+      add_metrics();
+
+      if constexpr (has_deflate_compressor<deflate_type>::value) {
+        // every shared frame must be decodable on its own
+        m_deflate.enable_server_no_context_takeover();
+        if(m_deflate.init(true)) {
+          spdlog::error("error initializing broadcast compression");
+          m_deflate_threshold = 0;
+        }
+      }
     }
 
     /// Sets a the given function f as the http_handler for m_server.
@@ -271,6 +487,21 @@ namespace simple_web_game_server {
       }
     }
 
+    /// Serves get_metrics() to HTTP requests for the given path.
+    /**
+     * Requests for any other path are passed to the http_handler. An empty
+     * path, the default, disables the route.
+     */
+    void set_metrics_path(const std::string& path) {
+      if (!m_is_running) {
+        m_metrics_path = path;
+        m_server.set_http_handler(bind(&base_server::on_http, this,
+          simple_web_game_server::_1));
+      } else {
+        throw server_error{"set_metrics_path called on running server"};
+      }
+    }
+
     /// Sets a the given function f as the tls_init_handler for m_server.
     void set_tls_init_handler(function<ssl_context_ptr(connection_hdl)> f) {
       if(!m_is_running) {
@@ -299,6 +530,10 @@ namespace simple_web_game_server {
     }
 
     /// Sets the given function to be called when a client sends a message.
+    /**
+     * Called for text messages, and for binary messages too unless a binary
+     * message handler is set.
+     */
     void set_message_handler(function<void(const combined_id&,std::string&&)> f) {
       if(!m_is_running) {
         m_handle_message = f;
@@ -307,6 +542,257 @@ namespace simple_web_game_server {
       }
     }
 
+    /// Sets the given function to be called when a client sends binary data.
+    void set_binary_message_handler(
+        function<void(const combined_id&,std::string&&)> f
+      )
+    {
+      if(!m_is_running) {
+        m_handle_binary_message = f;
+      } else {
+        throw server_error{
+            "set_binary_message_handler called on running server"
+          };
+      }
+    }
+
+    /// Sets the number of independent shards in the action queue.
+    /**
+     * Actions are assigned to shards by connection, so each shard keeps the
+     * actions of a given connection in order. The shards are spread over
+     * the threads running process_messages(), so running as many such
+     * threads as there are shards gives each shard its own thread, while
+     * fewer threads each drain several shards. Threads beyond the shard
+     * count stay idle, so the default of a single shard is drained by one
+     * thread whatever the number started. The threads should be started
+     * once run() reports is_running(), see action_queue::add_worker.
+     */
+    void set_action_shard_count(std::size_t n) {
+      if(!m_is_running) {
+        m_actions.resize(n);
+      } else {
+        throw server_error{"set_action_shard_count called on running server"};
+      }
+    }
+
+    /// Sets the capacity of the JWT verification queue.
+    /**
+     * Only used while at least one thread runs process_verifications().
+     * Connections that send a token while the queue is full are closed with
+     * close_reasons::server_busy().
+     */
+    void set_verification_queue_size(std::size_t n) {
+      if(!m_is_running) {
+        m_verification_queue_size = n;
+      } else {
+        throw server_error{
+            "set_verification_queue_size called on running server"
+          };
+      }
+    }
+
+    /// Sets the limits on messages held while a client's token is verified.
+    /**
+     * Only used while at least one thread runs process_verifications().
+     * A client that sends more than max_messages messages, or more than
+     * max_bytes bytes in total, before its token is verified is closed with
+     * close_reasons::pending_overflow(). Defaults to 64 messages and 64 KiB.
+     */
+    void set_pending_message_limit(
+        std::size_t max_messages,
+        std::size_t max_bytes
+      )
+    {
+      if(!m_is_running) {
+        m_max_pending_messages = max_messages;
+        m_max_pending_bytes = max_bytes;
+      } else {
+        throw server_error{
+            "set_pending_message_limit called on running server"
+          };
+      }
+    }
+
+    /// Sets the number of verified tokens to cache; zero disables the cache.
+    /**
+     * A client that logs in again with a token found in the cache skips
+     * decoding and signature verification. Only tokens with an exp claim are
+     * cached, and each entry is dropped once the token expires according to
+     * the jwt_clock. The least recently used entry is evicted when the
+     * cache is full.
+     */
+    void set_token_cache_size(std::size_t n) {
+      if(!m_is_running) {
+        m_token_cache.set_capacity(n);
+      } else {
+        throw server_error{"set_token_cache_size called on running server"};
+      }
+    }
+
+    /// Sets the smallest broadcast payload, in bytes, that is compressed.
+    /**
+     * Only has an effect if server_config uses the permessage_deflate::enabled
+     * extension. Broadcasts at least this large are compressed once and the
+     * compressed frame is shared by every recipient that negotiated
+     * permessage-deflate with server_no_context_takeover. Recipients that
+     * negotiated context takeover are each sent their own copy to compress,
+     * and all other recipients share the uncompressed frame. A threshold of
+     * zero disables broadcast compression. The shared compressed frames are
+     * counted by the simple_web_game_server_broadcasts_compressed_total
+     * metric.
+     */
+    void set_broadcast_compression_threshold(std::size_t bytes) {
+      if(!m_is_running) {
+        m_deflate_threshold = bytes;
+      } else {
+        throw server_error{
+            "set_broadcast_compression_threshold called on running server"
+          };
+      }
+    }
+
+    /// Sets the smallest message payload, in bytes, that is compressed.
+    /**
+     * Only has an effect if server_config uses the permessage_deflate::enabled
+     * extension, and only for clients that negotiated permessage-deflate.
+     * Messages sent with send_message or send_messages at least this large
+     * are compressed, unless sent with compress set to false. A threshold of
+     * zero disables message compression. Whether the compression context is
+     * kept between messages is set by the server_config, see
+     * shared/websocketpp_configs/permessage_deflate.hpp.
+     */
+    void set_compression_threshold(std::size_t bytes) {
+      if(!m_is_running) {
+        m_compression_threshold = bytes;
+      } else {
+        throw server_error{
+            "set_compression_threshold called on running server"
+          };
+      }
+    }
+
+    /// Sets the bytes a connection may buffer before messages to it are held.
+    /**
+     * websocketpp buffers every message sent to a connection until the
+     * client reads it, so a client on a slow link could otherwise hold any
+     * amount of server memory. Once a connection has at least bytes waiting
+     * to be written, further messages to it are held by the server, in
+     * order, and written as the connection catches up. The held messages are
+     * bounded by set_slow_consumer_policy, so the memory taken by messages
+     * to one connection is at most about bytes, plus the last message or
+     * broadcast written, plus the held budget. The default is 1 MiB, and
+     * zero disables holding, so every message is written straight away.
+     */
+    void set_write_buffer_limit(std::size_t bytes) {
+      if(!m_is_running) {
+        m_write_buffer_limit = bytes;
+      } else {
+        throw server_error{"set_write_buffer_limit called on running server"};
+      }
+    }
+
+    /// Sets the budget of held messages and the policy applied beyond it.
+    /**
+     * The policy is applied whenever the messages held for a connection,
+     * see set_write_buffer_limit, number more than max_messages or total
+     * more than max_bytes of payload. Only messages sent with droppable set
+     * are dropped, see send_message and broadcast_message, and a connection
+     * still over budget afterwards is closed with
+     * close_reasons::slow_consumer(). The default policy is
+     * slow_consumer_policy::drop_oldest with a budget of 1024 messages and
+     * 4 MiB. Held, dropped, coalesced, and conflated messages, and closed
+     * connections, are counted in get_metrics().
+     */
+    void set_slow_consumer_policy(
+        slow_consumer_policy policy,
+        std::size_t max_messages = 1024,
+        std::size_t max_bytes = 4 << 20
+      )
+    {
+      if(!m_is_running) {
+        m_slow_consumer_policy = policy;
+        m_max_held_messages = max_messages;
+        m_max_held_bytes = max_bytes;
+      } else {
+        throw server_error{
+            "set_slow_consumer_policy called on running server"
+          };
+      }
+    }
+
+    /// Traces one in every n messages through the server; zero disables it.
+    /**
+     * The time sampled messages spend in each stage of the server is
+     * recorded in get_metrics(), see message_tracer. Tracing is disabled by
+     * default.
+     */
+    void set_trace_sample_interval(std::size_t n) {
+      if(!m_is_running) {
+        m_tracer.set_sample_interval(n);
+      } else {
+        throw server_error{
+            "set_trace_sample_interval called on running server"
+          };
+      }
+    }
+
+    /// Sets the WebSocket subprotocols the server accepts.
+    /**
+     * During the handshake the server selects the first subprotocol
+     * requested by the client that appears in protocols. Connections are
+     * assigned the index of their subprotocol in protocols, or zero if the
+     * client requested none of them, see get_protocol.
+     */
+    void set_subprotocols(const vector<std::string>& protocols) {
+      if(!m_is_running) {
+        m_subprotocols = protocols;
+      } else {
+        throw server_error{"set_subprotocols called on running server"};
+      }
+    }
+
+    /// Sets a header sent in the response to every WebSocket handshake.
+    /**
+     * Replaces any value set before for the same name, and an empty value
+     * removes the header. game_server uses this to announce message
+     * batching, see message_batch.
+     */
+    void set_handshake_header(
+        const std::string& name,
+        const std::string& value
+      )
+    {
+      if(m_is_running) {
+        throw server_error{"set_handshake_header called on running server"};
+      }
+
+      auto it = std::find_if(
+          m_handshake_headers.begin(), m_handshake_headers.end(),
+          [&name](const pair<std::string, std::string>& header){
+            return header.first == name;
+          }
+        );
+      if(it != m_handshake_headers.end()) {
+        m_handshake_headers.erase(it);
+      }
+      if(!value.empty()) {
+        m_handshake_headers.emplace_back(name, value);
+      }
+    }
+
+    /// Returns the index of the subprotocol negotiated by the given client.
+    /**
+     * Returns zero if the client is not connected or no subprotocol was
+     * negotiated.
+     */
+    std::size_t get_protocol(const combined_id& id) {
+      connection_data_ptr conn;
+      if(get_connection_from_id(conn, id)) {
+        return conn->protocol;
+      }
+      return 0;
+    }
+
     /// Runs the underlying websocketpp server m_server.
     /**
      * May be called by multiple threads if desired, so long as unlock_address
@@ -315,6 +801,8 @@ namespace simple_web_game_server {
     void run(uint16_t port, bool unlock_address) {
       if(!m_is_running) {
         spdlog::info("server is listening on port {}", port);
+        m_actions.start();
+        m_verifications.start();
         m_is_running = true;
 
         m_server.set_reuse_addr(unlock_address);
@@ -343,23 +831,25 @@ namespace simple_web_game_server {
       if(m_is_running) {
         m_is_running = false;
         m_server.stop_listening();
+        m_actions.stop();
+        m_verifications.stop();
         {
-          lock_guard<mutex> action_guard(m_action_lock);
           lock_guard<mutex> session_guard(m_session_lock);
-          lock_guard<mutex> conn_guard(m_connection_lock);
+          lock_guard<shared_mutex> conn_guard(m_connection_lock);
 
           // collect all unresolved connection actions
-          while(!m_actions.empty()) {
-            action a = m_actions.front();
-            m_actions.pop();
-            if(a.type == SUBSCRIBE || a.type == CLOSE_CONNECTION) {
-              m_new_connections.insert(a.hdl);
-            }
-          }
+          m_actions.drain([&](action& a){
+              if(a.type == SUBSCRIBE || a.type == CLOSE_CONNECTION) {
+                m_new_connections.insert(a.conn->hdl);
+              }
+            });
+
+          // connections awaiting verification are still in m_new_connections
+          m_verifications.drain([](action&){});
 
           // collect all open player connections
-          for(auto& con_pair : m_connection_ids) {
-            m_new_connections.insert(con_pair.first);
+          for(auto& id_pair : m_id_connections) {
+            m_new_connections.insert(id_pair.second->hdl);
           }
 
           // close all remaining open connections
@@ -368,14 +858,12 @@ namespace simple_web_game_server {
           }
 
           m_player_count = 0;
-          m_connection_ids.clear();
           m_id_connections.clear();
           m_new_connections.clear();
           m_locked_sessions.clear();
           m_locked_sessions.clear();
           m_session_players.clear();
         }
-        m_action_cond.notify_all();
       } else {
         throw server_error("stop called on stopped server");
       }
@@ -383,62 +871,55 @@ namespace simple_web_game_server {
 
     /// Worker loop that processes server actions.
     /**
-     * Continually pulls work from the queue m_actions.
-     * May be run by multiple threads if desired.
+     * Continually pulls work from a shard of the queue m_actions.
+     * May be run by multiple threads if desired, see set_action_shard_count.
+     * Unless some thread runs process_verifications, client JWTs are
+     * verified inline by this loop.
      */
     void process_messages() {
-      while(m_is_running) {
-        unique_lock<mutex> action_lock(m_action_lock);
+      const std::size_t worker = m_actions.add_worker();
+      action a;
 
-        while(m_actions.empty()) {
-          m_action_cond.wait(action_lock);
-          if(!m_is_running) {
-            return;
-          }
+      while(m_is_running) {
+        if(!m_actions.pop_worker(worker, a)) {
+          return;
         }
-
-        action a = m_actions.front();
-        m_actions.pop();
-
-        action_lock.unlock();
+        m_metrics.increment(m_action_metrics[a.type]);
 
         if (a.type == SUBSCRIBE) {
           spdlog::trace("processing SUBSCRIBE action");
-          unique_lock<mutex> conn_lock(m_connection_lock);
-          m_new_connections.insert(a.hdl);
+          lock_guard<shared_mutex> conn_guard(m_connection_lock);
+          m_new_connections.insert(a.conn->hdl);
         } else if (a.type == UNSUBSCRIBE) {
           spdlog::trace("processing UNSUBSCRIBE action");
-          unique_lock<mutex> conn_lock(m_connection_lock);
-
-          auto it = m_connection_ids.find(a.hdl);
-          if(it == m_connection_ids.end()) {
-            m_new_connections.erase(a.hdl);
+          close_outbound(a.conn);
+          if(!player_disconnect(a.conn)) {
+            lock_guard<shared_mutex> conn_guard(m_connection_lock);
+            m_new_connections.erase(a.conn->hdl);
             spdlog::trace(
                 "client hdl {} disconnected without opening session",
-                a.hdl.lock().get()
+                a.conn->hdl.lock().get()
               );
-          } else {
-            // connection provided a player id
-            combined_id id = it->second;
-            conn_lock.unlock();
-            player_disconnect(a.hdl, id);
           }
         } else if (a.type == IN_MESSAGE) {
           spdlog::trace("processing IN_MESSAGE action");
-          unique_lock<mutex> conn_lock(m_connection_lock);
-
-          auto it = m_connection_ids.find(a.hdl);
-          if(it == m_connection_ids.end()) {
+          if(a.conn->is_rejected) {
+            // already closed, drop anything still in flight
+          } else if(a.conn->is_verifying) {
+            hold_pending_message(a.conn, std::move(a.msg), a.op);
+          } else if(!a.conn->is_verified) {
             spdlog::trace(
                 "recieved message from client hdl {} w/no id: {}",
-                a.hdl.lock().get(),
+                a.conn->hdl.lock().get(),
                 a.msg
               );
-            conn_lock.unlock();
-            open_session(a.hdl, a.msg);
+            if(m_verifier_count > 0) {
+              queue_verification(a.conn, std::move(a.msg));
+            } else {
+              open_session(a.conn, a.msg);
+            }
           } else {
-            combined_id id = it->second;
-            conn_lock.unlock();
+            const combined_id& id = a.conn->id;
 
             spdlog::trace(
                 "player {} with session {} sent: {}",
@@ -447,53 +928,181 @@ namespace simple_web_game_server {
                 a.msg
               );
 
-            m_handle_message(id, std::move(a.msg));
+            if(message_tracer::is_traced(a.trace)) {
+              message_tracer::current() = m_tracer.record(
+                  message_tracer::action_queue, a.trace
+                );
+            }
+            handle_message(id, std::move(a.msg), a.op);
+            message_tracer::current() = message_tracer::time_point{};
           }
         } else if(a.type == OUT_MESSAGE) {
           spdlog::trace("processing OUT_MESSAGE action");
           spdlog::trace(
               "sending message to client hdl {}: {}",
-              a.hdl.lock().get(),
-              a.msg
+              a.conn->hdl.lock().get(),
+              a.frame ? (
+                  a.frame->get_compressed() ? "<compressed frame>"
+                    : a.frame->get_payload()
+                ) : a.msg
             );
-          send_to_hdl(a.hdl, a.msg);
+          deliver(a.conn, outbound_message{
+              std::move(a.msg), std::move(a.frame), a.op, a.compress,
+              a.droppable, a.conflation_key, a.trace
+            });
         } else if(a.type == CLOSE_CONNECTION) { 
           spdlog::trace("processing CLOSE_CONNECTION action");
           spdlog::trace(
               "closing client hdl {} with final message: {}",
-              a.hdl.lock().get(),
+              a.conn->hdl.lock().get(),
               a.msg
             );
 
-          send_to_hdl(a.hdl, a.msg);
-          close_hdl(a.hdl, close_reasons::session_complete());
+          finish_connection(a.conn, std::move(a.msg));
+        } else if(a.type == TOKEN_VERIFIED) {
+          spdlog::trace("processing TOKEN_VERIFIED action");
+          a.conn->is_verifying = false;
+          if(a.conn->is_rejected) {
+            continue;
+          }
+          open_session(
+              a.conn,
+              combined_id{a.conn->id},
+              std::move(a.conn->login_data)
+            );
+
+          // replay messages sent while the token was being verified
+          for(auto& msg : a.conn->pending_messages) {
+            if(a.conn->is_verified) {
+              handle_message(a.conn->id, std::move(msg.first), msg.second);
+            }
+          }
+          a.conn->pending_messages.clear();
+          a.conn->pending_bytes = 0;
+        } else if(a.type == TOKEN_REJECTED) {
+          spdlog::trace("processing TOKEN_REJECTED action");
+          a.conn->is_verifying = false;
+          if(!a.conn->is_rejected) {
+            reject_connection(a.conn, close_reasons::invalid_jwt());
+          }
         } else {
           // undefined.
         }
       }
     }
 
+    /// Worker loop that verifies client JWTs.
+    /**
+     * Once any thread runs this loop, tokens are passed from the
+     * process_messages workers to a bounded queue served by a pool of
+     * threads running this loop, and the results are handed back to the
+     * worker for the connection to set up its session. This keeps expensive
+     * signature checks from delaying regular messages. May be run by
+     * multiple threads if desired.
+     */
+    void process_verifications() {
+      ++m_verifier_count;
+      action a;
+
+      while(m_is_running) {
+        if(!m_verifications.pop(0, a)) {
+          break;
+        }
+        m_metrics.increment(m_action_metrics[a.type]);
+
+        const connection_data_ptr& conn = a.conn;
+        bool verified = verify_token(a.msg, conn->id, conn->login_data);
+        record_verification(conn->verify_start_time, verified);
+
+        if(!verified) {
+          m_metrics.increment(m_open_metrics[INVALID_TOKEN]);
+        }
+
+        // the connection's worker drops or replays its pending messages
+        a.type = verified ? TOKEN_VERIFIED : TOKEN_REJECTED;
+        a.msg.clear();
+        push_action(std::move(a));
+      }
+
+      --m_verifier_count;
+    }
+
+    /// Returns the current JWT verification metrics.
+    verification_stats get_verification_stats() {
+      std::size_t verified = m_verified_count;
+      std::size_t rejected = m_rejected_count;
+      std::size_t total = verified + rejected;
+      long long total_ns = m_total_verify_ns;
+
+      return verification_stats{
+          m_verifications.size(),
+          verified,
+          rejected,
+          m_dropped_count,
+          m_cache_hit_count,
+          std::chrono::nanoseconds{total > 0 ? total_ns / (long long)total : 0},
+          std::chrono::nanoseconds{m_max_verify_ns.load()}
+        };
+    }
+
     /// Returns the number of verified clients connected.
     std::size_t get_player_count() {
       return m_player_count;
     }
 
+    /// Returns the server metrics in the Prometheus text format.
+    std::string get_metrics() {
+      return m_metrics.render();
+    }
+
+    /// Returns the registry of the server metrics.
+    /**
+     * Metrics may only be added to the registry before the server runs.
+     */
+    metrics_registry& get_metrics_registry() {
+      return m_metrics;
+    }
+
+    /// Returns the tracer that samples messages through the server.
+    message_tracer& get_message_tracer() {
+      return m_tracer;
+    }
+
     /// Asynchronously sends a message to the given client.
     /**
-     * Submits an action to the queue m_actions to send the text msg to the
-     * client associated with id.
+     * Submits an action to the queue m_actions to send msg to the client
+     * associated with id, as a text frame unless op is opcode::binary. If
+     * compress is false the message is never compressed, e.g. for payloads
+     * that are already compressed, see set_compression_threshold. If
+     * droppable is true the message may be dropped should the client fall
+     * behind, see set_slow_consumer_policy.
+     *
+     * A nonzero conflation_key marks a message that only matters in its
+     * newest version, such as a periodic state snapshot. While messages to
+     * the client are held, see set_write_buffer_limit, a held message with
+     * the same key is dropped when the new one is queued, so a client that
+     * falls behind is sent each key at most once when it catches up. All
+     * messages, keyed or not, are still written in the order they were
+     * sent, and messages with key zero are never replaced.
      */
-    void send_message(const combined_id& id, std::string&& msg) {
-      connection_hdl hdl;
-      if(get_connection_hdl_from_id(hdl, id)) {
-        {
-          lock_guard<mutex> guard(m_action_lock);
-          spdlog::trace("out_message: {}", msg);
-          m_actions.push(
-              action{OUT_MESSAGE, hdl, std::move(msg)}
-            );
-        }
-        m_action_cond.notify_one();
+    void send_message(
+        const combined_id& id,
+        std::string&& msg,
+        opcode::value op = opcode::text,
+        bool compress = true,
+        bool droppable = false,
+        std::size_t conflation_key = 0
+      )
+    {
+      connection_data_ptr conn;
+      if(get_connection_from_id(conn, id)) {
+        spdlog::trace("out_message: {}", msg);
+        compress = compress && should_compress(msg.size());
+        action a{OUT_MESSAGE, conn, std::move(msg), op, compress};
+        a.droppable = droppable;
+        a.conflation_key = conflation_key;
+        sample_trace(a);
+        push_action(std::move(a));
       } else {
         spdlog::trace(
             "ignored message sent to player {} with session {}: connection closed",
@@ -502,6 +1111,167 @@ namespace simple_web_game_server {
       }
     }
 
+    /// Asynchronously sends each message to its associated client.
+    /**
+     * Equivalent to calling send_message for each (id, message) pair, but
+     * the connections are resolved under a single acquisition of
+     * m_connection_lock and the actions are pushed with one lock acquisition
+     * and one wakeup per action queue shard. The messages are moved out and
+     * msgs is left empty. All of the messages are sent with the opcode op.
+     */
+    void send_messages(
+        vector<pair<combined_id, std::string> >& msgs,
+        opcode::value op = opcode::text
+      )
+    {
+      push_messages(msgs, [op](pair<combined_id, std::string>& msg){
+          return std::make_tuple(&msg.first, &msg.second, op, std::size_t{0});
+        });
+    }
+
+    /// Asynchronously sends each message to its client with its own opcode.
+    /**
+     * As above, but each (id, message, opcode) tuple chooses whether its
+     * message is sent as a text or a binary frame.
+     */
+    void send_messages(
+        vector<std::tuple<combined_id, std::string, opcode::value> >& msgs
+      )
+    {
+      using tagged_message = std::tuple<combined_id, std::string, opcode::value>;
+      push_messages(msgs, [](tagged_message& msg){
+          return std::make_tuple(
+              &std::get<0>(msg), &std::get<1>(msg), std::get<2>(msg),
+              std::size_t{0}
+            );
+        });
+    }
+
+    /// Asynchronously sends each message with its opcode and conflation key.
+    /**
+     * As above, but each (id, message, opcode, key) tuple also carries the
+     * conflation key of its message, see send_message.
+     */
+    void send_messages(
+        vector<std::tuple<combined_id, std::string, opcode::value,
+          std::size_t> >& msgs
+      )
+    {
+      using keyed_message = std::tuple<combined_id, std::string, opcode::value,
+        std::size_t>;
+      push_messages(msgs, [](keyed_message& msg){
+          return std::make_tuple(
+              &std::get<0>(msg), &std::get<1>(msg), std::get<2>(msg),
+              std::get<3>(msg)
+            );
+        });
+    }
+
+    /// Asynchronously sends one message to every client in the session.
+    /**
+     * The WebSocket frame for msg is built once and the same buffer is
+     * written to each connection, so the payload is never copied per
+     * recipient. See set_broadcast_compression_threshold for compression,
+     * which is skipped if compress is false. The frame is a text frame
+     * unless op is opcode::binary. If droppable is true the message may be
+     * dropped for clients that fall behind, see set_slow_consumer_policy,
+     * and a nonzero conflation_key lets it replace an older held message,
+     * see send_message.
+     */
+    void broadcast_message(
+        const session_id& sid,
+        std::string&& msg,
+        opcode::value op = opcode::text,
+        bool compress = true,
+        bool droppable = false,
+        std::size_t conflation_key = 0
+      )
+    {
+      // reused by each calling thread to avoid an allocation per broadcast
+      thread_local vector<player_id> players;
+      players.clear();
+      {
+        lock_guard<mutex> session_guard(m_session_lock);
+        auto it = m_session_players.find(sid);
+        if(it != m_session_players.end()) {
+          players.assign(it->second.begin(), it->second.end());
+        }
+      }
+      broadcast_message(
+          sid, players, std::move(msg), op, compress, droppable, conflation_key
+        );
+    }
+
+    /// Asynchronously sends one message to the given clients in a session.
+    /**
+     * As above, the frame for msg is built once and shared by all of the
+     * recipients.
+     */
+    void broadcast_message(
+        const session_id& sid,
+        const vector<player_id>& players,
+        std::string&& msg,
+        opcode::value op = opcode::text,
+        bool compress = true,
+        bool droppable = false,
+        std::size_t conflation_key = 0
+      )
+    {
+      if(players.empty()) {
+        return;
+      }
+
+      compress = compress && m_deflate_threshold != 0
+        && msg.size() >= m_deflate_threshold;
+      message_ptr frame = prepare_frame(std::move(msg), op);
+      if(!frame) {
+        return;
+      }
+      // compressed at most once, for the first recipient that shares it
+      message_ptr deflated;
+      bool is_deflate_tried = false;
+
+      vector<vector<action> >& shard_actions = get_shard_actions();
+      {
+        shared_lock<shared_mutex> guard(m_connection_lock);
+        for(const player_id& pid : players) {
+          auto it = m_id_connections.find(combined_id{ pid, sid });
+          if(it != m_id_connections.end()) {
+            const connection_data_ptr& conn = it->second;
+            if(compress && conn->shared_deflate && !is_deflate_tried) {
+              deflated = prepare_deflated_frame(frame);
+              is_deflate_tried = true;
+              if(deflated) {
+                m_metrics.increment(m_deflated_broadcast_metric);
+              }
+            }
+            if(compress && conn->shared_deflate && deflated) {
+              shard_actions[conn->shard].emplace_back(
+                  OUT_MESSAGE, conn, deflated
+                );
+            } else if(compress && conn->deflate && !conn->shared_deflate) {
+              // a connection keeping its compression context between
+              // messages must compress its own copy of the payload
+              shard_actions[conn->shard].emplace_back(
+                  OUT_MESSAGE, conn, std::string{frame->get_payload()}, op,
+                  true
+                );
+            } else {
+              shard_actions[conn->shard].emplace_back(
+                  OUT_MESSAGE, conn, frame
+                );
+            }
+            shard_actions[conn->shard].back().droppable = droppable;
+            shard_actions[conn->shard].back().conflation_key = conflation_key;
+            sample_trace(shard_actions[conn->shard].back());
+          }
+        }
+      }
+
+      spdlog::trace("broadcast to session {}: {}", sid, frame->get_payload());
+      push_shard_actions(shard_actions);
+    }
+
     /// Asynchronously closes the given session and sends out result tokens.
     /**
      * Submits actions to close all clients associated with the given session
@@ -530,21 +1300,17 @@ namespace simple_web_game_server {
             for(const player_id& pid : it->second) {
               combined_id id{ pid, sid };
 
-              connection_hdl hdl;
-              if(get_connection_hdl_from_id(hdl, id)) {
-                {
-                  lock_guard<mutex> guard(m_action_lock);
-                  spdlog::trace("closing session {} player {}", sid, pid);
-                  m_actions.push(action(
-                        CLOSE_CONNECTION,
-                        hdl,
-                        m_get_result_str(
-                          { id.player, result.session },
-                          result.data
-                        )
-                      ));
-                }
-                m_action_cond.notify_one();
+              connection_data_ptr conn;
+              if(get_connection_from_id(conn, id)) {
+                spdlog::trace("closing session {} player {}", sid, pid);
+                push_action(action(
+                      CLOSE_CONNECTION,
+                      conn,
+                      m_get_result_str(
+                        { id.player, result.session },
+                        result.data
+                      )
+                    ));
               } else {
                 spdlog::trace(
                     "can't close player {} session {}: connection already closed",
@@ -563,10 +1329,20 @@ namespace simple_web_game_server {
     }
 
   private:
-    void player_disconnect(connection_hdl hdl, const combined_id& id) {
+    // how often a connection with held messages is polled for room in its
+    // write buffer
+    static constexpr long HELD_POLL_MS = 10;
+
+    // returns false if the connection never opened a session or was
+    // already replaced by a duplicate connection
+    bool player_disconnect(const connection_data_ptr& conn) {
+      const combined_id& id = conn->id;
       {
-        lock_guard<mutex> connection_guard(m_connection_lock);
-        m_connection_ids.erase(hdl);
+        lock_guard<shared_mutex> connection_guard(m_connection_lock);
+        if(!conn->is_verified) {
+          return false;
+        }
+        conn->is_verified = false;
         m_id_connections.erase(id);
       }
       {
@@ -583,36 +1359,385 @@ namespace simple_web_game_server {
         --m_player_count;
       }
 
-      spdlog::debug("player {} with session {} disconnected",
-          id.player, id.session);
+      spdlog::debug(
+          "player {} with session {} disconnected, {} messages ({} bytes) sent",
+          id.player, id.session, conn->messages_sent.load(),
+          conn->bytes_sent.load()
+        );
       m_handle_close(id);
+      return true;
     }
 
-    bool get_connection_hdl_from_id(
-        connection_hdl& hdl,
+    bool get_connection_from_id(
+        connection_data_ptr& conn,
         const combined_id& id
       )
     {
-      lock_guard<mutex> guard(m_connection_lock);
+      shared_lock<shared_mutex> guard(m_connection_lock);
       auto it = m_id_connections.find(id);
       if(it != m_id_connections.end()) {
-        hdl = it->second;
+        conn = it->second;
         return true;
       }
 
       return false;
     }
 
-    void send_to_hdl(connection_hdl hdl, const std::string& msg) {
-      try {
-        m_server.send(hdl, msg, websocketpp::frame::opcode::text);
-      } catch (std::exception& e) {
-        spdlog::debug(
+    // writes an outgoing message to its connection, or holds it while the
+    // connection's write buffer is full, see set_write_buffer_limit; a
+    // keyed message supersedes the held message with its key; messages sent
+    // once the session result is held are dropped, so the result is always
+    // the last message before the close
+    void deliver(const connection_data_ptr& conn, outbound_message&& out) {
+      lock_guard<mutex> guard(conn->out_lock);
+      if(conn->is_outbound_closed || conn->is_closing) {
+        return;
+      }
+
+      if(conn->held.empty() && !is_write_buffer_full(conn)) {
+        write_outbound(conn, out);
+        return;
+      }
+
+      bool is_conflated = false;
+      if(out.conflation_key != 0) {
+        // held holds at most one message per key, so the newest held
+        // message with the key is the only one; the new message is queued
+        // at the back rather than in its place, so it is never written
+        // before older messages
+        auto it = std::find_if(conn->held.rbegin(), conn->held.rend(),
+          [&out](const outbound_message& held){
+            return held.conflation_key == out.conflation_key;
+          });
+        if(it != conn->held.rend()) {
+          conn->held_bytes -= it->size();
+          conn->held.erase(std::next(it).base());
+          is_conflated = true;
+        }
+      }
+
+      m_metrics.increment(
+          m_slow_consumer_metrics[is_conflated ? CONFLATED : HELD]
+        );
+      conn->held_bytes += out.size();
+      conn->held.push_back(std::move(out));
+      flush_held(conn);
+    }
+
+    // sends the result message of a completed session and closes the
+    // connection once any held messages before it are written
+    void finish_connection(const connection_data_ptr& conn, std::string&& msg) {
+      lock_guard<mutex> guard(conn->out_lock);
+      if(conn->is_outbound_closed || conn->is_closing) {
+        return;
+      }
+
+      const bool compress = should_compress(msg.size());
+      outbound_message out{
+          std::move(msg), message_ptr{}, opcode::text, compress, false, 0, {}
+        };
+      if(conn->held.empty()) {
+        write_outbound(conn, out);
+        conn->is_outbound_closed = true;
+        close_hdl(conn->hdl, close_reasons::session_complete());
+      } else {
+        conn->held_bytes += out.size();
+        conn->held.push_back(std::move(out));
+        conn->is_closing = true;
+      }
+    }
+
+    // drops any held messages once the connection has closed
+    void close_outbound(const connection_data_ptr& conn) {
+      lock_guard<mutex> guard(conn->out_lock);
+      conn->is_outbound_closed = true;
+      conn->held.clear();
+      conn->held_bytes = 0;
+    }
+
+    // writes held messages while the connection's write buffer has room,
+    // and applies the slow consumer policy to the rest; websocketpp reports
+    // no write completions, so a connection with messages still held is
+    // polled until it catches up; assumes conn->out_lock is held
+    void flush_held(const connection_data_ptr& conn) {
+      while(!conn->held.empty() && !is_write_buffer_full(conn)) {
+        outbound_message& out = conn->held.front();
+        conn->held_bytes -= out.size();
+        write_outbound(conn, out);
+        conn->held.pop_front();
+      }
+
+      if(conn->held.empty()) {
+        if(conn->is_closing) {
+          conn->is_closing = false;
+          conn->is_outbound_closed = true;
+          close_hdl(conn->hdl, close_reasons::session_complete());
+        }
+        return;
+      }
+
+      apply_slow_consumer_policy(conn);
+      if(conn->is_outbound_closed || conn->is_flush_scheduled) {
+        return;
+      }
+
+      conn->is_flush_scheduled = true;
+      m_server.set_timer(
+          HELD_POLL_MS,
+          [this, conn](const websocketpp::lib::error_code& ec){
+            lock_guard<mutex> guard(conn->out_lock);
+            conn->is_flush_scheduled = false;
+            if(!ec && !conn->is_outbound_closed) {
+              flush_held(conn);
+            }
+          }
+        );
+    }
+
+    // assumes conn->out_lock is held
+    void apply_slow_consumer_policy(const connection_data_ptr& conn) {
+      if(!is_over_budget(conn)) {
+        return;
+      }
+
+      std::deque<outbound_message>& held = conn->held;
+      if(m_slow_consumer_policy == slow_consumer_policy::drop_oldest) {
+        auto it = held.begin();
+        while(it != held.end() && is_over_budget(conn)) {
+          if(it->droppable) {
+            conn->held_bytes -= it->size();
+            it = held.erase(it);
+            m_metrics.increment(m_slow_consumer_metrics[DROPPED]);
+          } else {
+            ++it;
+          }
+        }
+      } else if(m_slow_consumer_policy == slow_consumer_policy::coalesce) {
+        // the newest droppable message supersedes the others
+        auto newest = std::find_if(held.rbegin(), held.rend(),
+          [](const outbound_message& out){ return out.droppable; });
+        if(newest != held.rend()) {
+          const std::size_t keep = held.rend() - newest - 1;
+          std::deque<outbound_message> kept;
+          for(std::size_t i = 0; i < held.size(); ++i) {
+            if(held[i].droppable && i != keep) {
+              conn->held_bytes -= held[i].size();
+              m_metrics.increment(m_slow_consumer_metrics[COALESCED]);
+            } else {
+              kept.push_back(std::move(held[i]));
+            }
+          }
+          held.swap(kept);
+        }
+      }
+
+      if(is_over_budget(conn)) {
+        spdlog::debug(
+            "closing client hdl {}: {} messages ({} bytes) held",
+            conn->hdl.lock().get(), held.size(), conn->held_bytes
+          );
+        m_metrics.increment(m_slow_consumer_metrics[CLOSED]);
+        conn->is_outbound_closed = true;
+        held.clear();
+        conn->held_bytes = 0;
+        close_hdl(conn->hdl, close_reasons::slow_consumer());
+      }
+    }
+
+    // assumes conn->out_lock is held
+    bool is_over_budget(const connection_data_ptr& conn) const {
+      return conn->held.size() > m_max_held_messages
+        || conn->held_bytes > m_max_held_bytes;
+    }
+
+    // websocketpp updates the buffered amount under its own write lock, so
+    // this read may be slightly stale, which only shifts the moment
+    // messages start or stop being held
+    bool is_write_buffer_full(const connection_data_ptr& conn) {
+      if(m_write_buffer_limit == 0) {
+        return false;
+      }
+
+      websocketpp::lib::error_code ec;
+      connection_ptr con = m_server.get_con_from_hdl(conn->hdl, ec);
+      return !ec && con->get_buffered_amount() >= m_write_buffer_limit;
+    }
+
+    void write_outbound(
+        const connection_data_ptr& conn,
+        const outbound_message& out
+      )
+    {
+      if(out.frame) {
+        send_frame_to_connection(conn, out.frame);
+      } else {
+        send_to_connection(conn, out.msg, out.op, out.compress);
+      }
+      if(message_tracer::is_traced(out.trace)) {
+        m_tracer.record(message_tracer::send_queue, out.trace);
+      }
+    }
+
+    void send_to_connection(
+        const connection_data_ptr& conn,
+        const std::string& msg,
+        opcode::value op = opcode::text,
+        bool compress = false
+      )
+    {
+      if(send_to_hdl(conn->hdl, msg, op, compress)) {
+        ++conn->messages_sent;
+        conn->bytes_sent += msg.size();
+        record_sent(msg.size());
+      }
+    }
+
+    bool send_to_hdl(
+        connection_hdl hdl,
+        const std::string& msg,
+        opcode::value op = opcode::text,
+        bool compress = false
+      )
+    {
+      try {
+        if constexpr (has_deflate_compressor<deflate_type>::value) {
+          // websocketpp compresses every string it sends, so build the
+          // message to choose
+          message_ptr out = m_frame_manager->get_message(op, msg.size());
+          out->append_payload(msg);
+          out->set_compressed(compress);
+          m_server.send(hdl, out);
+        } else {
+          m_server.send(hdl, msg, op);
+        }
+        return true;
+      } catch (std::exception& e) {
+        spdlog::debug(
             "error sending message \"{}\": {}",
             msg,
             e.what()
           );
       }
+      return false;
+    }
+
+    // builds a complete unmasked data frame, as the hybi13 processor would,
+    // that may be written unchanged to any number of server connections
+    message_ptr prepare_frame(
+        std::string&& payload,
+        websocketpp::frame::opcode::value op
+      )
+    {
+      if(op == websocketpp::frame::opcode::text
+          && !websocketpp::utf8_validator::validate(payload))
+      {
+        spdlog::debug("error preparing message \"{}\": invalid utf8", payload);
+        return message_ptr{};
+      }
+
+      message_ptr frame = m_frame_manager->get_message(op, 0);
+      frame->get_raw_payload() = std::move(payload);
+
+      const std::size_t size = frame->get_payload().size();
+      websocketpp::frame::basic_header h(op, size, true, false, false);
+      websocketpp::frame::extended_header e(size);
+      frame->set_header(websocketpp::frame::prepare_header(h, e));
+      frame->set_prepared(true);
+
+      return frame;
+    }
+
+    // builds a compressed copy of a prepared frame for connections that
+    // negotiated permessage-deflate with server_no_context_takeover; returns
+    // an empty pointer if the frame is not worth compressing
+    message_ptr prepare_deflated_frame(const message_ptr& frame) {
+      if constexpr (has_deflate_compressor<deflate_type>::value) {
+        const std::string& payload = frame->get_payload();
+        if(m_deflate_threshold == 0 || payload.size() < m_deflate_threshold) {
+          return message_ptr{};
+        }
+
+        websocketpp::frame::opcode::value op = frame->get_opcode();
+        message_ptr deflated = m_frame_manager->get_message(op, 0);
+        std::string& out = deflated->get_raw_payload();
+        {
+          lock_guard<mutex> guard(m_deflate_lock);
+          if(m_deflate.compress(payload, out) || out.size() < 4) {
+            return message_ptr{};
+          }
+        }
+
+        // strip the trailing 0x00 0x00 0xff 0xff as required by RFC 7692
+        out.resize(out.size() - 4);
+        if(out.size() >= payload.size()) {
+          return message_ptr{};
+        }
+
+        websocketpp::frame::basic_header h(op, out.size(), true, false, true);
+        websocketpp::frame::extended_header e(out.size());
+        deflated->set_header(websocketpp::frame::prepare_header(h, e));
+        deflated->set_compressed(true);
+        deflated->set_prepared(true);
+
+        return deflated;
+      } else {
+        return message_ptr{};
+      }
+    }
+
+    // true if messages of the given size are compressed by send_message
+    bool should_compress(std::size_t size) const {
+      return m_compression_threshold != 0 && size >= m_compression_threshold;
+    }
+
+    // true if the handshake accepted permessage-deflate
+    bool accepts_deflate(const connection_ptr& con) {
+      if constexpr (has_deflate_compressor<deflate_type>::value) {
+        return con->get_response_header("Sec-WebSocket-Extensions").find(
+            "permessage-deflate"
+          ) != std::string::npos;
+      } else {
+        return false;
+      }
+    }
+
+    // true if the handshake accepted permessage-deflate such that a frame
+    // compressed without context by m_deflate may be sent on con
+    bool accepts_shared_deflate(const connection_ptr& con) {
+      if constexpr (has_deflate_compressor<deflate_type>::value) {
+        const std::string& ext = con->get_response_header(
+            "Sec-WebSocket-Extensions"
+          );
+        return ext.find("permessage-deflate") != std::string::npos
+          && ext.find("server_no_context_takeover") != std::string::npos
+          && ext.find("server_max_window_bits") == std::string::npos;
+      } else {
+        return false;
+      }
+    }
+
+    void send_frame_to_connection(
+        const connection_data_ptr& conn,
+        const message_ptr& frame
+      )
+    {
+      try {
+        if(conn->version == 0) {
+          // hybi00 uses a different framing, so let websocketpp build it
+          m_server.send(conn->hdl, frame->get_payload(), frame->get_opcode());
+        } else {
+          m_server.send(conn->hdl, frame);
+        }
+        ++conn->messages_sent;
+        conn->bytes_sent += frame->get_payload().size();
+        record_sent(frame->get_payload().size());
+      } catch (std::exception& e) {
+        spdlog::debug(
+            "error sending message \"{}\": {}",
+            frame->get_payload(),
+            e.what()
+          );
+      }
     }
 
     void close_hdl(connection_hdl hdl, const std::string& reason) {
@@ -632,6 +1757,14 @@ namespace simple_web_game_server {
       if (m_is_running) {
         try {
           connection_ptr conn = m_server.get_con_from_hdl(hdl);
+          if(is_metrics_request(conn)) {
+            conn->set_status(websocketpp::http::status_code::ok);
+            conn->append_header(
+                "Content-Type", "text/plain; version=0.0.4; charset=utf-8"
+              );
+            conn->set_body(get_metrics());
+            return;
+          }
           m_handle_http(conn);
         } catch (std::exception& e) {
           spdlog::debug("error getting http connection: {}",
@@ -640,32 +1773,284 @@ namespace simple_web_game_server {
       }
     }
 
+    // pushes the action onto the queue shard of its connection; returns
+    // false if the server is not running
+    bool push_action(action&& a) {
+      std::size_t shard = a.conn->shard;
+      return m_actions.push(shard, std::move(a));
+    }
+
     void on_open(connection_hdl hdl) {
-      {
-        lock_guard<mutex> guard(m_action_lock);
-        if(m_is_running) {
-          m_actions.push(action(SUBSCRIBE,hdl));
-        } else {
-          close_hdl(hdl, close_reasons::server_shutdown());
+      connection_ptr con;
+      try {
+        con = m_server.get_con_from_hdl(hdl);
+      } catch (std::exception& e) {
+        spdlog::debug("error getting opened connection: {}", e.what());
+        return;
+      }
+
+      // clients that requested no accepted subprotocol use the first one
+      std::size_t protocol = get_protocol_index(con->get_subprotocol());
+      if(protocol == m_subprotocols.size()) {
+        protocol = 0;
+      }
+
+      connection_data_ptr conn = std::make_shared<connection_data>(
+          hdl,
+          m_actions.get_shard(con.get()),
+          websocketpp::processor::get_websocket_version(con->get_request()),
+          accepts_deflate(con),
+          accepts_shared_deflate(con),
+          protocol
+        );
+
+      // reads begin after the open handler returns, so all further events
+      // on this connection carry its data
+      con->set_close_handler(bind(&base_server::on_close, this, conn));
+      con->set_message_handler(bind(&base_server::on_message, this, conn,
+        simple_web_game_server::_2));
+
+      if(!push_action(action(SUBSCRIBE, conn))) {
+        close_hdl(hdl, close_reasons::server_shutdown());
+      }
+    }
+
+    // adds the handshake headers and selects the first requested
+    // subprotocol that the server accepts
+    bool on_validate(connection_hdl hdl) {
+      if(m_subprotocols.empty() && m_handshake_headers.empty()) {
+        return true;
+      }
+
+      connection_ptr con;
+      try {
+        con = m_server.get_con_from_hdl(hdl);
+      } catch (std::exception& e) {
+        spdlog::debug("error getting validated connection: {}", e.what());
+        return false;
+      }
+
+      for(const pair<std::string, std::string>& header : m_handshake_headers) {
+        con->append_header(header.first, header.second);
+      }
+
+      for(const std::string& requested : con->get_requested_subprotocols()) {
+        if(get_protocol_index(requested) < m_subprotocols.size()) {
+          try {
+            con->select_subprotocol(requested);
+          } catch (std::exception& e) {
+            spdlog::debug("error selecting subprotocol: {}", e.what());
+            return false;
+          }
+          break;
         }
       }
-      m_action_cond.notify_one();
+
+      return true;
     }
 
-    void on_close(connection_hdl hdl) {
-      {
-        lock_guard<mutex> guard(m_action_lock);
-        m_actions.push(action(UNSUBSCRIBE, hdl));
+    // returns the index of protocol in m_subprotocols, or
+    // m_subprotocols.size() if the server does not accept it
+    std::size_t get_protocol_index(const std::string& protocol) {
+      auto it = std::find(
+          m_subprotocols.begin(), m_subprotocols.end(), protocol
+        );
+      return it - m_subprotocols.begin();
+    }
+
+    void on_close(const connection_data_ptr& conn) {
+      push_action(action(UNSUBSCRIBE, conn));
+    }
+
+    void on_message(const connection_data_ptr& conn, message_ptr msg) {
+      m_metrics.increment(m_received_metric);
+      m_metrics.increment(m_received_bytes_metric, msg->get_payload().size());
+      action a{
+          IN_MESSAGE,
+          conn,
+          std::move(msg->get_raw_payload()),
+          msg->get_opcode()
+        };
+      sample_trace(a);
+      push_action(std::move(a));
+    }
+
+    // passes a verified client's message to the handler for its opcode
+    void handle_message(
+        const combined_id& id,
+        std::string&& msg,
+        opcode::value op
+      )
+    {
+      if(op == opcode::binary && m_handle_binary_message) {
+        m_handle_binary_message(id, std::move(msg));
+      } else {
+        m_handle_message(id, std::move(msg));
       }
-      m_action_cond.notify_one();
     }
 
-    void on_message(connection_hdl hdl, message_ptr msg) {
+    // returns this thread's scratch lists of actions, one per queue shard;
+    // their capacity is reused so steady state batches do not allocate
+    vector<vector<action> >& get_shard_actions() {
+      thread_local vector<vector<action> > shard_actions;
+      shard_actions.resize(m_actions.shard_count());
+      return shard_actions;
+    }
+
+    // pushes each list onto its shard with one lock acquisition and empties
+    // it, even if the queue has stopped
+    void push_shard_actions(vector<vector<action> >& shard_actions) {
+      for(std::size_t i = 0; i < shard_actions.size(); ++i) {
+        m_actions.push_bulk(i, shard_actions[i]);
+        shard_actions[i].clear();
+      }
+    }
+
+    // resolves each message's connection under one shared lock, then pushes
+    // the actions with one lock acquisition per shard; get returns pointers
+    // to the id and payload of a message along with its opcode and
+    // conflation key
+    template<typename tagged, typename getter>
+    void push_messages(vector<tagged>& msgs, getter get) {
+      if(msgs.empty()) {
+        return;
+      }
+
+      vector<vector<action> >& shard_actions = get_shard_actions();
       {
-        lock_guard<mutex> guard(m_action_lock);
-        m_actions.push(action(IN_MESSAGE, hdl, std::move(msg->get_raw_payload())));
+        shared_lock<shared_mutex> guard(m_connection_lock);
+        for(tagged& msg : msgs) {
+          auto fields = get(msg);
+          const combined_id& id = *std::get<0>(fields);
+          auto it = m_id_connections.find(id);
+          if(it != m_id_connections.end()) {
+            const connection_data_ptr& conn = it->second;
+            std::string& payload = *std::get<1>(fields);
+            const bool compress = should_compress(payload.size());
+            shard_actions[conn->shard].emplace_back(
+                OUT_MESSAGE,
+                conn,
+                std::move(payload),
+                std::get<2>(fields),
+                compress
+              );
+            shard_actions[conn->shard].back().conflation_key =
+              std::get<3>(fields);
+            sample_trace(shard_actions[conn->shard].back());
+          } else {
+            spdlog::trace(
+                "ignored message sent to player {} with session {}: "
+                "connection closed",
+                id.player, id.session
+              );
+          }
+        }
+      }
+      msgs.clear();
+
+      push_shard_actions(shard_actions);
+    }
+
+    void add_metrics() {
+      const char* action_names[ACTION_TYPE_COUNT] = {
+          "subscribe", "unsubscribe", "in_message", "out_message",
+          "close_connection", "verify_token", "token_verified",
+          "token_rejected"
+        };
+      for(std::size_t i = 0; i < ACTION_TYPE_COUNT; ++i) {
+        m_action_metrics[i] = m_metrics.add_counter(
+            "simple_web_game_server_actions_total",
+            "Actions processed by type.",
+            std::string{"type=\""} + action_names[i] + "\""
+          );
+      }
+
+      const char* open_names[OPEN_RESULT_COUNT] = {
+          "opened", "invalid_token", "session_complete", "server_busy"
+        };
+      for(std::size_t i = 0; i < OPEN_RESULT_COUNT; ++i) {
+        m_open_metrics[i] = m_metrics.add_counter(
+            "simple_web_game_server_session_opens_total",
+            "Attempts to open a session by result.",
+            std::string{"result=\""} + open_names[i] + "\""
+          );
+      }
+
+      m_verify_metric = m_metrics.add_histogram(
+          "simple_web_game_server_jwt_verify_seconds",
+          "Time from receiving a token to the end of its verification."
+        );
+      m_received_metric = m_metrics.add_counter(
+          "simple_web_game_server_messages_received_total",
+          "WebSocket messages received."
+        );
+      m_received_bytes_metric = m_metrics.add_counter(
+          "simple_web_game_server_received_bytes_total",
+          "Payload bytes of the WebSocket messages received."
+        );
+      m_sent_metric = m_metrics.add_counter(
+          "simple_web_game_server_messages_sent_total",
+          "WebSocket messages sent."
+        );
+      m_sent_bytes_metric = m_metrics.add_counter(
+          "simple_web_game_server_sent_bytes_total",
+          "Uncompressed payload bytes of the WebSocket messages sent."
+        );
+      m_deflated_broadcast_metric = m_metrics.add_counter(
+          "simple_web_game_server_broadcasts_compressed_total",
+          "Broadcast frames compressed once and shared by their recipients."
+        );
+
+      const char* slow_consumer_names[SLOW_CONSUMER_EVENT_COUNT] = {
+          "held", "dropped", "coalesced", "conflated", "closed"
+        };
+      for(std::size_t i = 0; i < SLOW_CONSUMER_EVENT_COUNT; ++i) {
+        m_slow_consumer_metrics[i] = m_metrics.add_counter(
+            "simple_web_game_server_slow_consumer_events_total",
+            "Messages held, dropped, coalesced, and conflated, and "
+            "connections closed, for clients that fall behind.",
+            std::string{"event=\""} + slow_consumer_names[i] + "\""
+          );
       }
-      m_action_cond.notify_one();
+
+      m_metrics.add_gauge(
+          "simple_web_game_server_action_queue_depth",
+          "Actions waiting in the action queue.",
+          [this](){ return static_cast<double>(m_actions.size()); }
+        );
+      m_metrics.add_gauge(
+          "simple_web_game_server_verification_queue_depth",
+          "Tokens waiting in the verification queue.",
+          [this](){ return static_cast<double>(m_verifications.size()); }
+        );
+      m_metrics.add_gauge(
+          "simple_web_game_server_players",
+          "Verified clients connected.",
+          [this](){ return static_cast<double>(m_player_count.load()); }
+        );
+    }
+
+    // stamps the action with the current time if it is sampled
+    void sample_trace(action& a) {
+      if(m_tracer.sample()) {
+        a.trace = message_tracer::clock::now();
+      }
+    }
+
+    void record_sent(std::size_t bytes) {
+      m_metrics.increment(m_sent_metric);
+      m_metrics.increment(m_sent_bytes_metric, bytes);
+    }
+
+    // true if the request is for the metrics route
+    bool is_metrics_request(const connection_ptr& conn) {
+      if(m_metrics_path.empty()) {
+        return false;
+      }
+      const std::string& resource = conn->get_resource();
+      return resource.compare(
+          0, resource.find('?'), m_metrics_path
+        ) == 0;
     }
 
     // assumes that m_session_lock is acquired
@@ -684,8 +2069,17 @@ namespace simple_web_game_server {
       }
     }
 
-    void setup_connection_id(connection_hdl hdl, const combined_id& id) {
-      lock_guard<mutex> connection_guard(m_connection_lock);
+    // returns false if the connection has already been closed
+    bool setup_connection_id(
+        const connection_data_ptr& conn,
+        const combined_id& id
+      )
+    {
+      lock_guard<shared_mutex> connection_guard(m_connection_lock);
+
+      if(m_new_connections.find(conn->hdl) == m_new_connections.end()) {
+        return false;
+      }
 
       // immediately close duplicate connections to avoid complications
       auto id_connections_it = m_id_connections.find(id);
@@ -696,22 +2090,118 @@ namespace simple_web_game_server {
             id.session
           );
 
-        close_hdl(id_connections_it->second, close_reasons::duplicate_connection());
+        close_hdl(
+            id_connections_it->second->hdl,
+            close_reasons::duplicate_connection()
+          );
 
-        m_connection_ids.erase(id_connections_it->second);
+        id_connections_it->second->is_verified = false;
         m_id_connections.erase(id_connections_it);
       } else {
         ++m_player_count;
       }
 
-      m_connection_ids.emplace(hdl, id);
-      m_id_connections.emplace(id, hdl);
-      m_new_connections.erase(hdl);
+      conn->id = id;
+      conn->is_verified = true;
+      m_id_connections.emplace(id, conn);
+      m_new_connections.erase(conn->hdl);
+
+      return true;
     }
 
-    void open_session(connection_hdl hdl, const std::string& login_token) {
-      combined_id id;
-      json login_json;
+    // hands the token to the verification pool, or closes the connection
+    // if the pool is saturated
+    void queue_verification(
+        const connection_data_ptr& conn,
+        std::string&& login_token
+      )
+    {
+      conn->is_verifying = true;
+      conn->verify_start_time = clock::now();
+
+      if(!m_verifications.try_push(
+            0,
+            action(VERIFY_TOKEN, conn, std::move(login_token)),
+            m_verification_queue_size
+          ))
+      {
+        if(m_is_running) {
+          ++m_dropped_count;
+          m_metrics.increment(m_open_metrics[SERVER_BUSY]);
+          spdlog::debug("verification queue full, closing connection");
+          conn->is_verifying = false;
+          reject_connection(conn, close_reasons::server_busy());
+        }
+      }
+    }
+
+    // holds a message sent while the connection's token is verified, or
+    // closes the connection if it exceeds the pending message limits
+    void hold_pending_message(
+        const connection_data_ptr& conn,
+        std::string&& msg,
+        opcode::value op
+      )
+    {
+      std::size_t bytes = conn->pending_bytes + msg.size();
+      if(conn->pending_messages.size() >= m_max_pending_messages
+          || bytes > m_max_pending_bytes)
+      {
+        spdlog::debug("pending message limit exceeded, closing connection");
+        reject_connection(conn, close_reasons::pending_overflow());
+        return;
+      }
+
+      conn->pending_bytes = bytes;
+      conn->pending_messages.emplace_back(std::move(msg), op);
+    }
+
+    // closes a connection whose login failed, dropping any messages held
+    // while its token was verified
+    void reject_connection(
+        const connection_data_ptr& conn,
+        const std::string& reason
+      )
+    {
+      conn->is_rejected = true;
+      conn->pending_messages.clear();
+      conn->pending_bytes = 0;
+      close_hdl(conn->hdl, reason);
+    }
+
+    void record_verification(time_point start_time, bool verified) {
+      long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock::now() - start_time
+        ).count();
+
+      if(verified) {
+        ++m_verified_count;
+      } else {
+        ++m_rejected_count;
+      }
+      m_total_verify_ns += ns;
+      m_metrics.observe(m_verify_metric, std::chrono::nanoseconds{ns});
+
+      long long max_ns = m_max_verify_ns;
+      while(ns > max_ns && !m_max_verify_ns.compare_exchange_weak(max_ns, ns));
+    }
+
+    // decodes and verifies the token, returning true and setting id and
+    // login_json on success
+    bool verify_token(
+        const std::string& login_token,
+        combined_id& id,
+        json& login_json
+      )
+    {
+      cached_token cached;
+      if(m_token_cache.get(login_token, cached, m_jwt_clock.now())) {
+        ++m_cache_hit_count;
+        id = cached.first;
+        login_json = std::move(cached.second);
+        return true;
+      }
+
       bool completed = false;
       try {
         jwt::decoded_jwt<json_traits> decoded_token =
@@ -727,6 +2217,15 @@ namespace simple_web_game_server {
         login_json = claim_map.at("data").to_json();
         id = combined_id{pid, sid};
         completed = true;
+
+        if(decoded_token.has_expires_at()) {
+          m_token_cache.put(
+              login_token,
+              cached_token{ id, login_json },
+              decoded_token.get_expires_at(),
+              m_jwt_clock.now()
+            );
+        }
       } catch(std::out_of_range& e) {
         spdlog::debug(
             "connection provided jwt without id and/or data claims: {}",
@@ -746,13 +2245,46 @@ namespace simple_web_game_server {
         spdlog::debug("connection provided jwt with invalid claims: {}", e.what());
       }
 
-      if(completed) {
+      return completed;
+    }
+
+    void open_session(
+        const connection_data_ptr& conn,
+        const std::string& login_token
+      )
+    {
+      time_point start_time = clock::now();
+      combined_id id;
+      json login_json;
+      bool verified = verify_token(login_token, id, login_json);
+      record_verification(start_time, verified);
+
+      if(verified) {
+        open_session(conn, id, std::move(login_json));
+      } else {
+        m_metrics.increment(m_open_metrics[INVALID_TOKEN]);
+        close_hdl(conn->hdl, close_reasons::invalid_jwt());
+      }
+    }
+
+    // sets up the session for a connection whose token has been verified
+    void open_session(
+        const connection_data_ptr& conn,
+        const combined_id& id,
+        json&& login_json
+      )
+    {
+      {
         lock_guard<mutex> session_guard(m_session_lock);
         update_session_locks();
 
         if(!m_locked_sessions.contains(id.session)) {
-          setup_connection_id(hdl, id);
+          if(!setup_connection_id(conn, id)) {
+            // the connection closed while its token was being verified
+            return;
+          }
           m_session_players[id.session].insert(id.player);
+          m_metrics.increment(m_open_metrics[OPENED]);
           spdlog::debug(
               "player {} connected with session {}: {}",
               id.player,
@@ -761,17 +2293,16 @@ namespace simple_web_game_server {
             );
           m_handle_open(id, std::move(login_json));
         } else {
-          send_to_hdl(
-              hdl,
+          m_metrics.increment(m_open_metrics[SESSION_COMPLETE]);
+          send_to_connection(
+              conn,
               m_get_result_str(
                   { id.player, m_locked_sessions.at(id.session).session },
                   m_locked_sessions.at(id.session).data
                 )
             );
-          close_hdl(hdl, close_reasons::session_complete());
+          close_hdl(conn->hdl, close_reasons::session_complete());
         }
-      } else {
-        close_hdl(hdl, close_reasons::invalid_jwt());
       }
     }
 
@@ -779,20 +2310,42 @@ namespace simple_web_game_server {
     ws_server m_server;
     atomic<bool> m_is_running;
 
+    // creates the shared frames used for broadcasts
+    typename con_msg_manager::ptr m_frame_manager;
+
+    // compresses shared frames; m_deflate_lock guards m_deflate
+    deflate_type m_deflate;
+    mutex m_deflate_lock;
+    std::size_t m_deflate_threshold;
+
+    // the smallest message sent to a single client that is compressed
+    std::size_t m_compression_threshold;
+
+    // messages to a connection are held once it has m_write_buffer_limit
+    // bytes waiting to be written, and the policy is applied once the held
+    // messages exceed their budget
+    std::size_t m_write_buffer_limit;
+    slow_consumer_policy m_slow_consumer_policy;
+    std::size_t m_max_held_messages;
+    std::size_t m_max_held_bytes;
+
+    // the subprotocols accepted during the handshake
+    vector<std::string> m_subprotocols;
+    vector<pair<std::string, std::string> > m_handshake_headers;
+
     jwt::verifier<jwt_clock, json_traits> m_jwt_verifier;
+    // the verifier does not expose its clock, so token expiry in the cache
+    // is checked with a clock of the same type
+    jwt_clock m_jwt_clock;
     function<std::string(const combined_id&, const json&)> m_get_result_str;
 
     set<connection_hdl, std::owner_less<connection_hdl> > m_new_connections;
-    map<
-        connection_hdl,
-        combined_id,
-        std::owner_less<connection_hdl>
-      > m_connection_ids;
-    combined_id_map<connection_hdl> m_id_connections;
+    combined_id_map<connection_data_ptr> m_id_connections;
 
-    // m_connection_lock guards the members m_new_connections,
-    // m_id_connections, and m_connection_ids
-    mutex m_connection_lock;
+    // m_connection_lock guards the members m_new_connections and
+    // m_id_connections, and the is_verified member of each connection_data;
+    // lookups for outgoing messages only take it shared
+    shared_mutex m_connection_lock;
 
     time_point m_last_session_update_time;
     std::chrono::milliseconds m_session_release_time;
@@ -804,17 +2357,52 @@ namespace simple_web_game_server {
     // m_session_players
     mutex m_session_lock;
 
-    queue<action> m_actions;
-    mutex m_action_lock;        // m_action_lock guards the member m_actions
-    condition_variable m_action_cond;
+    action_queue<action> m_actions;
+
+    // tokens waiting for the process_verifications pool, on a single shard
+    action_queue<action> m_verifications;
+    std::size_t m_verification_queue_size;
+    std::size_t m_max_pending_messages;
+    std::size_t m_max_pending_bytes;
+    atomic<std::size_t> m_verifier_count;
+
+    atomic<std::size_t> m_verified_count;
+    atomic<std::size_t> m_rejected_count;
+    atomic<std::size_t> m_dropped_count;
+    atomic<std::size_t> m_cache_hit_count;
+    atomic<long long> m_total_verify_ns;
+    atomic<long long> m_max_verify_ns;
+
+    // the ids and data of recently verified tokens
+    using cached_token = pair<combined_id, json>;
+    token_cache<cached_token> m_token_cache;
 
     atomic<std::size_t> m_player_count;
 
+    // counters and histograms recorded without locks by each thread
+    metrics_registry m_metrics;
+    std::size_t m_action_metrics[ACTION_TYPE_COUNT];
+    std::size_t m_open_metrics[OPEN_RESULT_COUNT];
+    std::size_t m_verify_metric;
+    std::size_t m_received_metric;
+    std::size_t m_received_bytes_metric;
+    std::size_t m_sent_metric;
+    std::size_t m_sent_bytes_metric;
+    std::size_t m_deflated_broadcast_metric;
+    std::size_t m_slow_consumer_metrics[SLOW_CONSUMER_EVENT_COUNT];
+
+    // the path at which get_metrics() is served, if not empty
+    std::string m_metrics_path;
+
+    // samples messages and records their latency in m_metrics
+    message_tracer m_tracer;
+
     // functions to handle client actions
     function<void(connection_ptr)> m_handle_http;
     function<void(const combined_id&, json&&)> m_handle_open;
     function<void(const combined_id&)> m_handle_close;
     function<void(const combined_id&, std::string&&)> m_handle_message;
+    function<void(const combined_id&, std::string&&)> m_handle_binary_message;
   };
 }
 
@@ -23,19 +23,28 @@
 #ifndef JWT_GAME_SERVER_BASE_CLIENT_HPP
 #define JWT_GAME_SERVER_BASE_CLIENT_HPP
 
+#include "send_queue.hpp"
+#include "message_batch.hpp"
+
 #include <websocketpp/client.hpp>
 
 #include <jwt-cpp/jwt.h> 
 #include <spdlog/spdlog.h>
 
+#include <cstddef>
+#include <vector>
+#include <string>
 #include <mutex>
+#include <atomic>
 #include <functional>
+#include <utility>
 
 #include <exception>
 
 namespace simple_web_game_server {
   // websocketpp types
   using websocketpp::connection_hdl;
+  namespace opcode = websocketpp::frame::opcode;
 
   // functional types
   using std::function;
@@ -57,6 +66,9 @@ namespace simple_web_game_server {
     using message_ptr = typename ws_client::message_ptr;
 
   public:
+    /// The outcome of queueing a message with async_send.
+    using push_result = send_queue::push_result;
+
     /// The class representing errors with the client.
     class client_error : public std::runtime_error {
     public:
@@ -70,6 +82,8 @@ namespace simple_web_game_server {
   public:
     /// Constructs the client with empty handler functions.
     client() : m_is_running{false}, m_has_failed{false},
+      m_high_water_mark{65536}, m_is_flush_scheduled{false},
+      m_buffered_amount{0}, m_is_batched{false},
       m_handle_open{[](){}}, m_handle_close{[](){}},
       m_handle_message{[](const std::string& s){}}
     {
@@ -91,6 +105,8 @@ namespace simple_web_game_server {
         std::function<void()> cf,
         std::function<void(const std::string&)> mf
       ) : m_is_running{false}, m_has_failed{false},
+          m_high_water_mark{65536}, m_is_flush_scheduled{false},
+          m_buffered_amount{0}, m_is_batched{false},
           m_handle_open{of}, m_handle_close{cf},
           m_handle_message{mf}
     {
@@ -107,7 +123,14 @@ namespace simple_web_game_server {
     }
 
     client(const client& c) :
-      client{c.m_handle_open, c.m_handle_close, c.m_handle_message} {}
+      client{c.m_handle_open, c.m_handle_close, c.m_handle_message}
+    {
+      m_handle_binary_message = c.m_handle_binary_message;
+      m_handle_drain = c.m_handle_drain;
+      m_subprotocols = c.m_subprotocols;
+      m_high_water_mark = c.m_high_water_mark;
+      m_send_queue.set_limit(c.m_send_queue.limit());
+    }
 
     /// Connects to a server at the given URI and sends the given string.
     void connect(const std::string& uri, const std::string& jwt) {
@@ -117,6 +140,8 @@ namespace simple_web_game_server {
       }
 
       m_jwt = jwt;
+      m_is_flush_scheduled = false;
+      m_buffered_amount = 0;
 
       websocketpp::lib::error_code ec;
       m_connection = m_client.get_connection(uri, ec);
@@ -124,6 +149,9 @@ namespace simple_web_game_server {
         spdlog::debug(ec.message());
       } else {
         try {
+          for(const std::string& protocol : m_subprotocols) {
+            m_connection->add_subprotocol(protocol);
+          }
           m_client.connect(m_connection);
           m_is_running = true;
           m_has_failed = false;
@@ -172,14 +200,14 @@ namespace simple_web_game_server {
     }
 
     /// Synchronously send the given string to the server.
-    void send(const std::string& msg) {
+    /**
+     * The string is sent as a text frame unless op is opcode::binary.
+     */
+    void send(const std::string& msg, opcode::value op = opcode::text) {
       if(m_is_running) {
         try {
-          m_connection->send(
-              msg,
-              websocketpp::frame::opcode::text
-            );
-          spdlog::debug("client sent message: {}", msg);
+          m_connection->send(msg, op);
+          spdlog::trace("client sent {} byte message", msg.size());
         } catch(std::exception& e) {
           spdlog::error("error sending client message \"{}\": {}", msg,
             e.what());
@@ -192,6 +220,130 @@ namespace simple_web_game_server {
       }
     }
 
+    /// Synchronously send the given bytes to the server as a binary frame.
+    void send_binary(const std::string& data) {
+      send(data, opcode::binary);
+    }
+
+    /// Queues the given string to be sent to the server without blocking.
+    /**
+     * Queued messages are handed to the connection in order once it is
+     * open, while it has fewer than get_high_water_mark() bytes waiting to
+     * be written. If the send queue is full the message is not queued and
+     * push_result::full is returned, so the caller may throttle until the
+     * drain handler is called. If given, on_sent is called with true once
+     * the message is handed to the connection, or with false if the
+     * connection fails to send it or it is dropped because the connection
+     * closed.
+     */
+    push_result async_send(
+        const std::string& msg,
+        opcode::value op = opcode::text,
+        send_queue::sent_handler on_sent = nullptr
+      )
+    {
+      if(!m_is_running) {
+        throw client_error{"async_send called on stopped client"};
+      }
+
+      push_result result = m_send_queue.push(msg, op, std::move(on_sent));
+      schedule_flush();
+      return result;
+    }
+
+    /// Queues a message superseding any queued message with the same key.
+    /**
+     * As async_send, except that if a message queued with the same key has
+     * not yet been handed to the connection, it is removed and its on_sent
+     * handler is called with false. The new message is queued at the back,
+     * behind any messages sent before it. Suits state updates where
+     * only the latest matters, e.g. the player's position.
+     */
+    push_result async_send_latest(
+        const std::string& key,
+        const std::string& msg,
+        opcode::value op = opcode::text,
+        send_queue::sent_handler on_sent = nullptr
+      )
+    {
+      if(!m_is_running) {
+        throw client_error{"async_send_latest called on stopped client"};
+      }
+
+      push_result result = m_send_queue.push_latest(
+          key, msg, op, std::move(on_sent)
+        );
+      schedule_flush();
+      return result;
+    }
+
+    /// Sets the maximum number of messages queued by async_send.
+    void set_send_queue_limit(std::size_t n) {
+      if(!m_is_running) {
+        m_send_queue.set_limit(n);
+      } else {
+        throw client_error{"set_send_queue_limit called on running client"};
+      }
+    }
+
+    /// Sets the bytes the connection may buffer before queued sends wait.
+    void set_high_water_mark(std::size_t bytes) {
+      if(!m_is_running) {
+        m_high_water_mark = bytes;
+      } else {
+        throw client_error{"set_high_water_mark called on running client"};
+      }
+    }
+
+    /// Returns the bytes the connection may buffer before queued sends wait.
+    std::size_t get_high_water_mark() const {
+      return m_high_water_mark;
+    }
+
+    /// Returns the bytes the connection had buffered at the last flush.
+    /**
+     * Sampled each time queued messages are handed to the connection.
+     */
+    std::size_t get_buffered_amount() const {
+      return m_buffered_amount;
+    }
+
+    /// Returns the bytes of messages waiting in the send queue.
+    std::size_t get_queued_amount() {
+      return m_send_queue.bytes();
+    }
+
+    /// Sets the function called when the send queue empties after filling.
+    /**
+     * Called once the queue empties after an async_send was refused or
+     * held back by the high-water mark, so a throttled producer may resume.
+     */
+    void set_drain_handler(std::function<void()> f) {
+      if(!m_is_running) {
+        m_handle_drain = f;
+      } else {
+        throw client_error{"set_drain_handler called on running client"};
+      }
+    }
+
+    /// Sets the WebSocket subprotocols to request, in order of preference.
+    void set_subprotocols(const std::vector<std::string>& protocols) {
+      if(!m_is_running) {
+        m_subprotocols = protocols;
+      } else {
+        throw client_error{"set_subprotocols called on running client"};
+      }
+    }
+
+    /// Returns the subprotocol selected by the server, if any.
+    std::string get_subprotocol() {
+      if(m_connection) {
+        // websocketpp only records the subprotocol on server connections
+        return m_connection->get_response_header("Sec-WebSocket-Protocol");
+      }
+      return std::string{};
+    }
+
     /// Sets the given function to be called when the client connects.
     void set_open_handler(std::function<void()> f) {
       if(!m_is_running) {
@@ -211,6 +363,10 @@ namespace simple_web_game_server {
     }
 
     /// Sets the given function to be called when the client gets a message.
+    /**
+     * Called for text messages, and for binary messages too unless a binary
+     * message handler is set.
+     */
     void set_message_handler(std::function<void(const std::string&)> f) {
       if(!m_is_running) {
         m_handle_message = f;
@@ -219,20 +375,95 @@ namespace simple_web_game_server {
       }
     }
 
+    /// Sets the given function to be called when the client gets binary data.
+    void set_binary_message_handler(std::function<void(const std::string&)> f) {
+      if(!m_is_running) {
+        m_handle_binary_message = f;
+      } else {
+        throw client_error{
+            "set_binary_message_handler called on running client"
+          };
+      }
+    }
+
   private:
+    // websocketpp reports no write completions, so a blocked send queue
+    // polls the connection's buffer at this interval
+    static constexpr long DRAIN_POLL_MS = 1;
+
+    // flushes the send queue on the client's thread
+    void schedule_flush() {
+      if(!m_is_flush_scheduled.exchange(true)) {
+        m_client.get_io_service().post([this](){ flush_send_queue(); });
+      }
+    }
+
+    // only called on the client's thread; messages queued before the
+    // connection opens wait for on_open to flush them
+    void flush_send_queue() {
+      m_is_flush_scheduled = false;
+      if(!m_is_running
+          || m_connection->get_state() != websocketpp::session::state::open)
+      {
+        return;
+      }
+
+      send_queue::flush_result result = m_send_queue.flush(
+          m_high_water_mark,
+          [this](){ return m_connection->get_buffered_amount(); },
+          [this](const std::string& msg, opcode::value op){
+            websocketpp::lib::error_code ec = m_connection->send(msg, op);
+            if(ec) {
+              spdlog::error("error sending queued client message: {}",
+                ec.message());
+            }
+            return ec;
+          }
+        );
+      m_buffered_amount = m_connection->get_buffered_amount();
+
+      if(result == send_queue::flush_result::blocked) {
+        if(!m_is_flush_scheduled.exchange(true)) {
+          m_client.set_timer(
+              DRAIN_POLL_MS,
+              [this](const websocketpp::lib::error_code& ec){
+                if(ec) {
+                  m_is_flush_scheduled = false;
+                } else {
+                  flush_send_queue();
+                }
+              }
+            );
+        }
+      } else if(result == send_queue::flush_result::drained
+          && m_handle_drain)
+      {
+        try {
+          m_handle_drain();
+        } catch(std::exception& e) {
+          spdlog::error("error in drain handler: {}", e.what());
+        }
+      }
+    }
+
     void on_open(connection_hdl hdl) {
       spdlog::trace("client connection opened");
+      m_is_batched = !m_connection->get_response_header(
+          message_batch::handshake_header()
+        ).empty();
       this->send(m_jwt);
       try {
         m_handle_open();
       } catch(std::exception& e) {
         spdlog::error("error in open handler: {}", e.what());
       }
+      flush_send_queue();
     }
 
     void on_close(connection_hdl hdl) {
       spdlog::trace("client connection closed");
       m_is_running = false;
+      m_send_queue.clear();
       try {
         m_handle_close();
       } catch(std::exception& e) {
@@ -242,8 +473,26 @@ namespace simple_web_game_server {
 
     void on_message(connection_hdl hdl, message_ptr msg) {
       spdlog::trace("client received message: {}", msg->get_payload());
+      if(m_is_batched && msg->get_opcode() == opcode::binary) {
+        bool is_valid = message_batch::unpack(msg->get_payload(),
+          [this](const std::string& payload, opcode::value op){
+            handle_message(payload, op);
+          });
+        if(!is_valid) {
+          spdlog::error("client received a malformed message bundle");
+        }
+      } else {
+        handle_message(msg->get_payload(), msg->get_opcode());
+      }
+    }
+
+    void handle_message(const std::string& payload, opcode::value op) {
       try {
-        m_handle_message(msg->get_payload());
+        if(op == opcode::binary && m_handle_binary_message) {
+          m_handle_binary_message(payload);
+        } else {
+          m_handle_message(payload);
+        }
       } catch(std::exception& e) {
         spdlog::error("error in message handler: {}", e.what());
       }
@@ -255,9 +504,18 @@ namespace simple_web_game_server {
     bool m_is_running;
     bool m_has_failed;
     std::string m_jwt;
+    std::vector<std::string> m_subprotocols;
+    send_queue m_send_queue;
+    std::size_t m_high_water_mark;
+    atomic<bool> m_is_flush_scheduled;
+    atomic<std::size_t> m_buffered_amount;
+    // set on open if the server bundles messages, see message_batch
+    bool m_is_batched;
+    function<void()> m_handle_drain;
     function<void()> m_handle_open;
     function<void()> m_handle_close;
     function<void(const std::string&)> m_handle_message;
+    function<void(const std::string&)> m_handle_binary_message;
   };
 }
 
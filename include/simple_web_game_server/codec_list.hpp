@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_CODEC_LIST_HPP
+#define JWT_GAME_SERVER_CODEC_LIST_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+namespace simple_web_game_server {
+  /// The message codecs a game_server offers its clients.
+  /**
+   * Each codec is a traits struct, see shared/codec_traits, providing
+   *
+   *   using value_type = ...;
+   *   static constexpr bool is_binary;
+   *   static const char* subprotocol();
+   *   static bool decode(value_type& v, const std::string& data);
+   *   static std::string encode(const value_type& v);
+   *
+   * where decode returns false, rather than throwing, on malformed data.
+   * All codecs must share the same value_type. Codecs are referred to by
+   * their index in the list, which is also the order of the subprotocols
+   * offered during the WebSocket handshake. Clients that request none of
+   * the subprotocols use the first codec.
+   *
+   * The empty list codec_list<> means games exchange raw strings.
+   */
+  template<typename... codecs>
+  struct codec_list {
+    using value_type = std::string;
+
+    static constexpr std::size_t size = sizeof...(codecs);
+
+    /// Returns the subprotocol names of the codecs in order.
+    static std::vector<std::string> subprotocols() {
+      return std::vector<std::string>{};
+    }
+  };
+
+  template<typename first, typename... rest>
+  struct codec_list<first, rest...> {
+    using value_type = typename first::value_type;
+
+    static_assert(
+        (std::is_same<typename rest::value_type, value_type>::value && ...),
+        "every codec in a codec_list must have the same value_type"
+      );
+
+    static constexpr std::size_t size = 1 + sizeof...(rest);
+
+    /// Returns the subprotocol names of the codecs in order.
+    static std::vector<std::string> subprotocols() {
+      return std::vector<std::string>{
+          first::subprotocol(), rest::subprotocol()...
+        };
+    }
+
+    /// Decodes data with the codec at index i.
+    static bool decode(std::size_t i, value_type& v, const std::string& data) {
+      using decoder = bool (*)(value_type&, const std::string&);
+      static constexpr decoder decoders[] = {
+          &first::decode, &rest::decode...
+        };
+      return decoders[i](v, data);
+    }
+
+    /// Encodes v with the codec at index i.
+    static std::string encode(std::size_t i, const value_type& v) {
+      using encoder = std::string (*)(const value_type&);
+      static constexpr encoder encoders[] = {
+          &first::encode, &rest::encode...
+        };
+      return encoders[i](v);
+    }
+
+    /// Returns true if the codec at index i must be sent in binary frames.
+    static bool is_binary(std::size_t i) {
+      static constexpr bool binary[] = { first::is_binary, rest::is_binary... };
+      return binary[i];
+    }
+  };
+}
+
+#endif // JWT_GAME_SERVER_CODEC_LIST_HPP
@@ -24,25 +24,121 @@
 #define JWT_GAME_SERVER_GAME_SERVER_HPP
 
 #include "base_server.hpp"
+#include "tick_scheduler.hpp"
+#include "update_pool.hpp"
+#include "codec_list.hpp"
+#include "message_batch.hpp"
 
 #include <chrono>
 #include <algorithm>
-
-#if __cpp_lib_execution >= 201603
-  #include <execution>
-#endif
+#include <tuple>
+#include <type_traits>
 
 namespace simple_web_game_server {
   // time literals to initialize time-step variables
   using namespace std::chrono_literals;
 
+  /// Detects whether a game's update function accepts a list of broadcasts.
+  /**
+   * A game may optionally define
+   * update(out_messages, broadcasts, in_messages, delta_time), where
+   * broadcasts is a vector<std::string> of messages to be sent to every
+   * player connected to the game session.
+   */
+  template<typename game_instance, typename message,
+    typename broadcast = std::string, typename = void>
+  struct has_broadcast_update : std::false_type {};
+
+  template<typename game_instance, typename message, typename broadcast>
+  struct has_broadcast_update<
+      game_instance,
+      message,
+      broadcast,
+      std::void_t<decltype(std::declval<game_instance&>().update(
+          std::declval<vector<message>&>(),
+          std::declval<vector<broadcast>&>(),
+          std::declval<const vector<message>&>(),
+          0L
+        ))>
+    > : std::true_type {};
+
+  /// Detects whether a game tags its messages with WebSocket opcodes.
+  /**
+   * True if game_instance::message is
+   * std::tuple<player_id, std::string, opcode::value>. Such a game receives
+   * the opcode of each incoming message, chooses the opcode of each outgoing
+   * message, and its broadcasts are pair<std::string, opcode::value>.
+   */
+  template<typename game_instance, typename player_id, typename = void>
+  struct has_message_opcodes : std::false_type {};
+
+  template<typename game_instance, typename player_id>
+  struct has_message_opcodes<
+      game_instance,
+      player_id,
+      std::void_t<typename game_instance::message>
+    > : std::is_same<
+        typename game_instance::message,
+        std::tuple<player_id, std::string, opcode::value>
+      > {};
+
+  /// Detects whether a game tags its outgoing messages with conflation keys.
+  /**
+   * A game may optionally define get_conflation_key(const message&) and
+   * get_broadcast_conflation_key(const broadcast&), each returning a
+   * std::size_t. A nonzero key marks a message that only matters in its
+   * newest version, e.g. a periodic clock update, and zero a reliable
+   * message, see base_server::send_message.
+   */
+  template<typename game_instance, typename message, typename = void>
+  struct has_conflation_key : std::false_type {};
+
+  template<typename game_instance, typename message>
+  struct has_conflation_key<
+      game_instance,
+      message,
+      std::void_t<decltype(std::declval<const game_instance&>()
+        .get_conflation_key(std::declval<const message&>()))>
+    > : std::true_type {};
+
+  template<typename game_instance, typename broadcast, typename = void>
+  struct has_broadcast_conflation_key : std::false_type {};
+
+  template<typename game_instance, typename broadcast>
+  struct has_broadcast_conflation_key<
+      game_instance,
+      broadcast,
+      std::void_t<decltype(std::declval<const game_instance&>()
+        .get_broadcast_conflation_key(std::declval<const broadcast&>()))>
+    > : std::true_type {};
+
   /// A game server built on the base_server class.
   /**
    * This class wraps base_server
    * that runs game sessions for connected clients.
+   *
+   * Running games are stored contiguously and are moved when other games
+   * end, so the game_instance type must be move constructible and move
+   * assignable.
+   *
+   * Games exchange text messages unless game_instance::message carries an
+   * opcode, see has_message_opcodes, in which case binary frames are passed
+   * through to and from the game unchanged.
+   *
+   * If codecs is a non-empty codec_list, each client is assigned a codec by
+   * the WebSocket subprotocol it requests and games exchange decoded values
+   * instead of strings: messages are pair<player_id, codecs::value_type> and
+   * broadcasts are codecs::value_type. Messages are decoded and encoded by
+   * the update threads, and each broadcast is encoded once per codec in use
+   * by the players of its game.
+   *
+   * Games may tag messages and broadcasts that are superseded by newer ones
+   * with conflation keys, see has_conflation_key, so that clients that fall
+   * behind are only sent the newest of each.
    */
   template<typename game_instance, typename jwt_clock, typename json_traits,
-    typename server_config, typename close_reasons = default_close_reasons>
+    typename server_config, typename close_reasons = default_close_reasons,
+    typename codecs = codec_list<> >
   class game_server {
   // type definitions
   private:
@@ -60,27 +156,131 @@ namespace simple_web_game_server {
     template<typename value>
     using session_id_map = typename jwt_base_server::template session_id_map<value>;
 
-    using message = pair<player_id, std::string>;
+    static constexpr bool has_codecs = codecs::size > 0;
+    static constexpr bool has_opcodes = !has_codecs
+      && has_message_opcodes<game_instance, player_id>::value;
+
+    // without codecs value_type is std::string, so text only games exchange
+    // (player, text) pairs and text broadcasts
+    using value_type = typename codecs::value_type;
+    using message = std::conditional_t<
+        has_opcodes,
+        std::tuple<player_id, std::string, opcode::value>,
+        pair<player_id, value_type>
+      >;
+    using broadcast = std::conditional_t<
+        has_opcodes,
+        pair<std::string, opcode::value>,
+        value_type
+      >;
+    // with codecs, messages are queued undecoded
+    using in_message = std::conditional_t<
+        has_codecs,
+        pair<player_id, std::string>,
+        message
+      >;
+    using session_message = pair<session_id, in_message>;
+    using session_trace = pair<session_id, message_tracer::time_point>;
+    // an encoded message with its opcode and conflation key
+    using out_message = std::tuple<
+        combined_id, std::string, opcode::value, std::size_t
+      >;
+    // an encoded broadcast with the codec it was encoded for and its
+    // conflation key
+    using encoded_broadcast = std::tuple<std::size_t, std::string, std::size_t>;
 
     using json = typename jwt_base_server::json;
     using clock = typename jwt_base_server::clock;
 
     using ssl_context_ptr = typename jwt_base_server::ssl_context_ptr;
 
+    // A running game stored together with its message buffers.
+    struct game_slot {
+      game_slot(const session_id& s, game_instance&& g) : sid(s),
+        game(std::move(g)), protocol_players(codecs::size) {}
+
+      session_id sid;
+      game_instance game;
+      vector<in_message> in_messages;
+      vector<message> out_messages;
+      vector<broadcast> broadcasts;
+
+      // only used with codecs: the decoded inbox, the encoded output, the
+      // protocol of each player, and the connected players of each protocol
+      vector<message> decoded_messages;
+      vector<out_message> encoded_messages;
+      vector<encoded_broadcast> encoded_broadcasts;
+      vector<pair<player_id, std::size_t> > protocols;
+      vector<vector<player_id> > protocol_players;
+
+      // when a sampled message in the inbox was queued, and then when the
+      // update consuming it started, see message_tracer
+      message_tracer::time_point trace;
+    };
+
+    // Gathers the messages of one tick bound for the same recipients: a lone
+    // text message is kept as it is and anything more is bundled, see
+    // message_batch.
+    struct message_bundle {
+      message_bundle() : op(opcode::text), count(0) {}
+
+      void add(std::string&& msg, opcode::value msg_op) {
+        if(count == 0 && msg_op == opcode::text) {
+          payload = std::move(msg);
+          op = opcode::text;
+        } else {
+          if(count == 1 && op == opcode::text) {
+            std::string first = std::move(payload);
+            payload.clear();
+            message_batch::append(payload, first, opcode::text);
+          }
+          message_batch::append(payload, msg, msg_op);
+          op = opcode::binary;
+        }
+        ++count;
+      }
+
+      // returns the bundle and empties it for reuse, leaving op as it was
+      std::string take() {
+        std::string msg = std::move(payload);
+        payload.clear();
+        count = 0;
+        return msg;
+      }
+
+      // a message sent on its own to a batched connection, where every
+      // binary frame must be a bundle
+      static std::string single(std::string&& msg, opcode::value msg_op) {
+        if(msg_op == opcode::text) {
+          return std::move(msg);
+        }
+        std::string bundle;
+        message_batch::append(bundle, msg, msg_op);
+        return bundle;
+      }
+
+      std::string payload;
+      opcode::value op;
+      std::size_t count;
+    };
+
     // The data associated to a connecting or disconnecting client.
     struct connection_update {
-      connection_update(const combined_id& i) : id(i), disconnection(true) {}
-      connection_update(const combined_id& i, json&& d) : id(i),
-        data(std::move(d)), disconnection(false) {}
+      connection_update(const combined_id& i) : id(i), protocol(0),
+        disconnection(true) {}
+      connection_update(const combined_id& i, json&& d, std::size_t p)
+        : id(i), data(std::move(d)), protocol(p), disconnection(false) {}
 
       combined_id id;
       json data;
+      std::size_t protocol;
       bool disconnection;
     };
 
   // main class body
   public:
     using connection_ptr = typename jwt_base_server::connection_ptr;
+    using verification_stats = typename jwt_base_server::verification_stats;
 
     ///The constructor for the game_server class.
     /**
@@ -90,7 +290,10 @@ namespace simple_web_game_server {
         const jwt::verifier<jwt_clock, json_traits>& v,
         function<std::string(const combined_id&, const json&)> f,
         std::chrono::milliseconds t
-      ) : m_game_count(0), m_jwt_server(v, f, t) 
+      ) : m_game_count(0), m_tick_policy(catch_up_policy::skip),
+          m_max_catch_up_ticks(4), m_update_thread_count(0),
+          m_pin_update_threads(false), m_batch_messages(false),
+          m_jwt_server(v, f, t)
     {
       m_jwt_server.set_open_handler(
           bind(
@@ -108,12 +311,38 @@ namespace simple_web_game_server {
           )
         );
       m_jwt_server.set_message_handler(
-          bind(
-            &game_server::process_message,
-            this,
-            simple_web_game_server::_1,
-            simple_web_game_server::_2
-          )
+          [this](const combined_id& id, std::string&& data){
+            process_message(id, std::move(data), opcode::text);
+          }
+        );
+      if constexpr (has_opcodes) {
+        m_jwt_server.set_binary_message_handler(
+            [this](const combined_id& id, std::string&& data){
+              process_message(id, std::move(data), opcode::binary);
+            }
+          );
+      }
+      if constexpr (has_codecs) {
+        m_jwt_server.set_subprotocols(codecs::subprotocols());
+      }
+
+      metrics_registry& metrics = m_jwt_server.get_metrics_registry();
+      m_tick_metric = metrics.add_histogram(
+          "simple_web_game_server_tick_seconds",
+          "Time spent running each tick of the game loop."
+        );
+      m_games_created_metric = metrics.add_counter(
+          "simple_web_game_server_games_created_total",
+          "Game sessions created."
+        );
+      m_games_finished_metric = metrics.add_counter(
+          "simple_web_game_server_games_finished_total",
+          "Game sessions that finished."
+        );
+      metrics.add_gauge(
+          "simple_web_game_server_games",
+          "Game sessions running.",
+          [this](){ return static_cast<double>(m_game_count.load()); }
         );
     }
 
@@ -134,6 +363,111 @@ namespace simple_web_game_server {
       m_jwt_server.set_tls_init_handler(f);
     }
 
+    /// Sets the HTTP path at which the base_server serves get_metrics().
+    void set_metrics_path(const std::string& path) {
+      m_jwt_server.set_metrics_path(path);
+    }
+
+    /// Traces one in every n messages through the server and its games.
+    void set_trace_sample_interval(std::size_t n) {
+      m_jwt_server.set_trace_sample_interval(n);
+    }
+
+    /// Sets the number of action queue shards for the underlying base_server.
+    void set_action_shard_count(std::size_t n) {
+      m_jwt_server.set_action_shard_count(n);
+    }
+
+    /// Sets the capacity of the underlying base_server's verification queue.
+    void set_verification_queue_size(std::size_t n) {
+      m_jwt_server.set_verification_queue_size(n);
+    }
+
+    /// Sets the underlying base_server's limits on messages held during JWT
+    /// verification.
+    void set_pending_message_limit(
+        std::size_t max_messages,
+        std::size_t max_bytes
+      )
+    {
+      m_jwt_server.set_pending_message_limit(max_messages, max_bytes);
+    }
+
+    /// Sets how update_games catches up when game updates overrun a tick.
+    /**
+     * Takes effect the next time update_games is called. The max_catch_up
+     * parameter is only used by catch_up_policy::clamp.
+     */
+    void set_tick_policy(catch_up_policy policy, std::size_t max_catch_up = 4) {
+      m_tick_policy = policy;
+      m_max_catch_up_ticks = max_catch_up;
+    }
+
+    /// Sets the number of threads used to update games in parallel.
+    /**
+     * The count includes the thread running update_games, and zero, the
+     * default, uses one thread per hardware thread. If pin is true, each
+     * helper thread is pinned to its own CPU where supported. Takes effect
+     * the next time update_games is called.
+     */
+    void set_update_threads(std::size_t count, bool pin = false) {
+      m_update_thread_count = count;
+      m_pin_update_threads = pin;
+    }
+
+    /// Sets the number of verified tokens the base_server caches.
+    void set_token_cache_size(std::size_t n) {
+      m_jwt_server.set_token_cache_size(n);
+    }
+
+    /// Sets the smallest broadcast payload the base_server compresses.
+    void set_broadcast_compression_threshold(std::size_t bytes) {
+      m_jwt_server.set_broadcast_compression_threshold(bytes);
+    }
+
+    /// Sets the smallest message payload the base_server compresses.
+    void set_compression_threshold(std::size_t bytes) {
+      m_jwt_server.set_compression_threshold(bytes);
+    }
+
+    /// Sets the bytes a connection may buffer before messages to it are held.
+    void set_write_buffer_limit(std::size_t bytes) {
+      m_jwt_server.set_write_buffer_limit(bytes);
+    }
+
+    /// Sets the budget of held messages and the policy applied beyond it.
+    void set_slow_consumer_policy(
+        slow_consumer_policy policy,
+        std::size_t max_messages = 1024,
+        std::size_t max_bytes = 4 << 20
+      )
+    {
+      m_jwt_server.set_slow_consumer_policy(policy, max_messages, max_bytes);
+    }
+
+    /// Sends the messages of each tick to a player in as few frames as possible.
+    /**
+     * When enabled, the messages a game sends one player in a tick are
+     * bundled into a single binary frame, see message_batch, as are the
+     * broadcasts of a game in a tick, so each player receives at most two
+     * frames a tick rather than one per message. A lone text message is
+     * still sent as it is. Messages and broadcasts with a conflation key,
+     * see has_conflation_key, are sent in a frame of their own, a binary one
+     * as a bundle of one message, so that they may be replaced while held.
+     * They keep their place among the other messages of the tick, and only
+     * the newest message to a player with each key is sent in a tick. The server names message_batch's handshake
+     * header in each handshake response, so client and multiplex_client
+     * unpack bundles before calling their message handlers; other clients
+     * must unpack them themselves. Disabled by default. Throws if called on
+     * a running server.
+     */
+    void set_message_batching(bool batch) {
+      m_jwt_server.set_handshake_header(
+          message_batch::handshake_header(), batch ? "1" : ""
+        );
+      m_batch_messages = batch;
+    }
+
     /// Runs the underlying base_server.
     void run(uint16_t port, bool unlock_address = false) {
       m_jwt_server.run(port, unlock_address);
@@ -144,6 +478,11 @@ namespace simple_web_game_server {
       m_jwt_server.process_messages();
     }
 
+    /// Runs the process_verifications loop on the underlying base_server.
+    void process_verifications() {
+      m_jwt_server.process_verifications();
+    }
+
     /// Stops, clears, and resets the server so it may be run again.
     void reset() {
       stop();
@@ -153,17 +492,23 @@ namespace simple_web_game_server {
     /// Stops the server and clears all data and connections.
     void stop() {
       m_jwt_server.stop();
+      {
+        // ensure the game loop is waiting or will see the server stopped
+        lock_guard<mutex> guard(m_connection_update_list_lock);
+      }
       m_game_condition.notify_one();
       {
         lock_guard<mutex> guard(m_game_list_lock);
         m_games.clear();
-        m_out_messages.clear();
+        m_game_index.clear();
         m_connection_updates.second.clear();
         m_in_messages.second.clear();
+        m_in_traces.second.clear();
       }
       {
         lock_guard<mutex> guard(m_in_message_list_lock);
         m_in_messages.first.clear();
+        m_in_traces.first.clear();
       }
       {
         lock_guard<mutex> guard(m_connection_update_list_lock);
@@ -179,6 +524,21 @@ namespace simple_web_game_server {
       return m_jwt_server.get_player_count();
     }
 
+    /// Returns the JWT verification metrics of the underlying base_server.
+    verification_stats get_verification_stats() {
+      return m_jwt_server.get_verification_stats();
+    }
+
+    /// Returns the timing statistics of the update_games loop.
+    tick_stats get_tick_stats() {
+      return m_game_ticks.get_stats();
+    }
+
+    /// Returns the server metrics in the Prometheus text format.
+    std::string get_metrics() {
+      return m_jwt_server.get_metrics();
+    }
+
     bool is_running() {
       return m_jwt_server.is_running();
     }
@@ -187,80 +547,126 @@ namespace simple_web_game_server {
     /**
      * Processes player connections and disconnections, executes the
      * game loop for all running games, and sends all associated messages.
-     * Should only be called by one thread
-     * (but note that the game loops are marked to be run in parallel if
-     * possible).
+     * Should only be called by one thread (but note that the games are
+     * updated in parallel by a pool of threads, see set_update_threads).
      */
     void update_games(std::chrono::milliseconds timestep) {
-      auto time_start = clock::now();
       vector<session_id> finished_games;
+      m_game_ticks.start(timestep, m_tick_policy, m_max_catch_up_ticks);
+      m_update_pool.start(m_update_thread_count, m_pin_update_threads);
 
       while(m_jwt_server.is_running()) {
-        const auto delta_time =
-          std::chrono::duration_cast<std::chrono::milliseconds>(
-            clock::now() - time_start
-          );
-
         unique_lock<mutex> game_lock(m_game_list_lock);
         if(m_games.empty()) {
           game_lock.unlock();
-          unique_lock<mutex> conn_lock(m_connection_update_list_lock);
-          while(m_connection_updates.first.empty()) {
-            m_game_condition.wait(conn_lock);
-            if(!m_jwt_server.is_running()) {
-              return;
+          {
+            unique_lock<mutex> conn_lock(m_connection_update_list_lock);
+            if(m_connection_updates.first.empty()) {
+              m_game_condition.wait(conn_lock, [this](){
+                  return !m_connection_updates.first.empty()
+                    || !m_jwt_server.is_running();
+                });
+              if(!m_jwt_server.is_running()) {
+                break;
+              }
+              m_game_ticks.restart();
             }
-            time_start = clock::now();
           }
           game_lock.lock();
         }
 
-        if(delta_time < timestep) {
+        const tick_scheduler::time_point now = tick_scheduler::clock::now();
+        if(now < m_game_ticks.get_deadline()) {
+          // block until the deadline, waking early only to stop
           game_lock.unlock();
-          std::this_thread::sleep_for(std::min(1ms, timestep-delta_time));
+          unique_lock<mutex> conn_lock(m_connection_update_list_lock);
+          m_game_condition.wait_until(
+              conn_lock,
+              m_game_ticks.get_deadline(),
+              [this](){ return !m_jwt_server.is_running(); }
+            );
         } else {
-          time_start = clock::now();
+          const auto delta_time =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+              m_game_ticks.tick(now)
+            );
           process_connection_updates();
 
           // we remove game data here to catch any possible players submitting
           // new connections in the last time-step when the game session ends
-          {
-            for(session_id sid : finished_games) {
-              spdlog::trace("erasing game session {}", sid);
-              m_out_messages.erase(sid);
-              m_games.erase(sid);
-              --m_game_count;
-            }
+          for(session_id sid : finished_games) {
+            spdlog::trace("erasing game session {}", sid);
+            erase_game(sid);
           }
           finished_games.clear();
 
           process_game_updates(delta_time.count());
 
-          for(auto it = m_out_messages.begin(); it != m_out_messages.end();
-              ++it)
-          {
-            for(message& msg : it->second) {
-              m_jwt_server.send_message(
-                  { msg.first, it->first },
-                  std::move(msg.second)
-                );
+          // flush the whole tick's output in one batch
+          for(game_slot& slot : m_games) {
+            const std::size_t first = m_send_buffer.size();
+            if constexpr (has_codecs) {
+              for(out_message& msg : slot.encoded_messages) {
+                m_send_buffer.push_back(std::move(msg));
+              }
+              slot.encoded_messages.clear();
+            } else {
+              for(message& msg : slot.out_messages) {
+                const std::size_t key = get_conflation_key(slot.game, msg);
+                m_send_buffer.emplace_back(
+                    combined_id{ std::get<0>(msg), slot.sid },
+                    std::move(std::get<1>(msg)),
+                    get_opcode(msg),
+                    key
+                  );
+              }
+              slot.out_messages.clear();
+            }
+            if(m_batch_messages) {
+              batch_messages(first);
+            }
+          }
+          m_jwt_server.send_messages(m_send_buffer);
+
+          for(game_slot& slot : m_games) {
+            if(m_batch_messages) {
+              send_batched_broadcasts(slot);
+            } else {
+              send_broadcasts(slot);
             }
-            it->second.clear();
           }
 
-          for(auto it = m_games.begin(); it != m_games.end(); ++it) {
-            if(it->second.is_done()) {
-              spdlog::debug("game session {} ended", it->first);
+          for(game_slot& slot : m_games) {
+            if(message_tracer::is_traced(slot.trace)) {
+              m_jwt_server.get_message_tracer().record(
+                  message_tracer::game_update, slot.trace
+                );
+              slot.trace = message_tracer::time_point{};
+            }
+            if(slot.game.is_done()) {
+              spdlog::debug("game session {} ended", slot.sid);
               m_jwt_server.complete_session(
-                  it->first,
-                  it->first,
-                  it->second.get_state()
+                  slot.sid,
+                  slot.sid,
+                  slot.game.get_state()
+                );
+              finished_games.push_back(slot.sid);
+              m_jwt_server.get_metrics_registry().increment(
+                  m_games_finished_metric
                 );
-              finished_games.push_back(it->first);
             }
           }
+
+          m_jwt_server.get_metrics_registry().observe(
+              m_tick_metric,
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                tick_scheduler::clock::now() - now
+              )
+            );
         }
       }
+
+      m_update_pool.stop();
     }
 
     /// Returns the number of running game sessions.
@@ -269,6 +675,195 @@ namespace simple_web_game_server {
     }
 
   private:
+    void send_broadcasts(game_slot& slot) {
+      if constexpr (has_codecs) {
+        for(encoded_broadcast& msg : slot.encoded_broadcasts) {
+          send_encoded_broadcast(slot, msg);
+        }
+        slot.encoded_broadcasts.clear();
+      } else {
+        for(broadcast& msg : slot.broadcasts) {
+          send_broadcast(slot, msg);
+        }
+        slot.broadcasts.clear();
+      }
+    }
+
+    void send_encoded_broadcast(game_slot& slot, encoded_broadcast& msg) {
+      const std::size_t protocol = std::get<0>(msg);
+      m_jwt_server.broadcast_message(
+          slot.sid,
+          slot.protocol_players[protocol],
+          std::move(std::get<1>(msg)),
+          get_codec_opcode(protocol),
+          true,
+          false,
+          std::get<2>(msg)
+        );
+    }
+
+    void send_broadcast(game_slot& slot, broadcast& msg) {
+      const std::size_t key = get_broadcast_conflation_key(slot.game, msg);
+      if constexpr (has_opcodes) {
+        m_jwt_server.broadcast_message(
+            slot.sid, std::move(msg.first), msg.second, true, false, key
+          );
+      } else {
+        m_jwt_server.broadcast_message(
+            slot.sid, std::move(msg), opcode::text, true, false, key
+          );
+      }
+    }
+
+    // sends the tick's broadcasts of a game as one frame, or with codecs
+    // one frame for the players of each codec; a broadcast with a conflation
+    // key is sent in a frame of its own, so the base_server may replace it,
+    // between the bundles of the broadcasts before and after it
+    void send_batched_broadcasts(game_slot& slot) {
+      if constexpr (has_codecs) {
+        for(std::size_t i = 0; i < codecs::size; ++i) {
+          const opcode::value op = get_codec_opcode(i);
+          message_bundle bundle;
+          auto flush = [&](){
+              if(bundle.count > 0) {
+                m_jwt_server.broadcast_message(
+                    slot.sid,
+                    slot.protocol_players[i],
+                    bundle.take(),
+                    bundle.op
+                  );
+              }
+            };
+          for(encoded_broadcast& msg : slot.encoded_broadcasts) {
+            if(std::get<0>(msg) != i) {
+              continue;
+            }
+            if(std::get<2>(msg) == 0) {
+              bundle.add(std::move(std::get<1>(msg)), op);
+            } else {
+              flush();
+              m_jwt_server.broadcast_message(
+                  slot.sid,
+                  slot.protocol_players[i],
+                  message_bundle::single(std::move(std::get<1>(msg)), op),
+                  op,
+                  true,
+                  false,
+                  std::get<2>(msg)
+                );
+            }
+          }
+          flush();
+        }
+        slot.encoded_broadcasts.clear();
+      } else {
+        message_bundle bundle;
+        auto flush = [&](){
+            if(bundle.count > 0) {
+              m_jwt_server.broadcast_message(
+                  slot.sid, bundle.take(), bundle.op
+                );
+            }
+          };
+        for(broadcast& msg : slot.broadcasts) {
+          const std::size_t key = get_broadcast_conflation_key(slot.game, msg);
+          std::string* payload;
+          opcode::value op;
+          if constexpr (has_opcodes) {
+            payload = &msg.first;
+            op = msg.second;
+          } else {
+            payload = &msg;
+            op = opcode::text;
+          }
+
+          if(key == 0) {
+            bundle.add(std::move(*payload), op);
+          } else {
+            flush();
+            m_jwt_server.broadcast_message(
+                slot.sid,
+                message_bundle::single(std::move(*payload), op),
+                op,
+                true,
+                false,
+                key
+              );
+          }
+        }
+        flush();
+        slot.broadcasts.clear();
+      }
+    }
+
+    // replaces the messages in m_send_buffer from first on, which are all
+    // for the players of one game, with one message or bundle per player;
+    // a message with a conflation key is sent in a frame of its own between
+    // the bundles of the player's messages before and after it, and is
+    // dropped if a later message to the player has the same key
+    void batch_messages(std::size_t first) {
+      const std::size_t last = m_send_buffer.size();
+      for(std::size_t i = first; i < last; ++i) {
+        out_message& msg = m_send_buffer[i];
+        const std::size_t key = std::get<3>(msg);
+        if(key != 0 && std::any_of(
+              m_send_buffer.begin() + i + 1, m_send_buffer.begin() + last,
+              [&msg, key](const out_message& later){
+                return std::get<3>(later) == key
+                  && std::get<0>(later) == std::get<0>(msg);
+              }
+            ))
+        {
+          continue;
+        }
+
+        auto it = std::find_if(
+            m_batches.begin(), m_batches.end(),
+            [&msg](const pair<combined_id, message_bundle>& batch){
+              return batch.first == std::get<0>(msg);
+            }
+          );
+        if(it == m_batches.end()) {
+          m_batches.emplace_back(std::get<0>(msg), message_bundle{});
+          it = m_batches.end() - 1;
+        }
+
+        message_bundle& bundle = it->second;
+        if(key == 0) {
+          bundle.add(std::move(std::get<1>(msg)), std::get<2>(msg));
+        } else {
+          if(bundle.count > 0) {
+            m_batched_messages.emplace_back(
+                it->first, bundle.take(), bundle.op, 0
+              );
+          }
+          m_batched_messages.emplace_back(
+              std::get<0>(msg),
+              message_bundle::single(
+                  std::move(std::get<1>(msg)), std::get<2>(msg)
+                ),
+              std::get<2>(msg),
+              key
+            );
+        }
+      }
+
+      for(pair<combined_id, message_bundle>& batch : m_batches) {
+        if(batch.second.count > 0) {
+          m_batched_messages.emplace_back(
+              batch.first, batch.second.take(), batch.second.op, 0
+            );
+        }
+      }
+      m_batches.clear();
+
+      m_send_buffer.resize(first);
+      for(out_message& msg : m_batched_messages) {
+        m_send_buffer.push_back(std::move(msg));
+      }
+      m_batched_messages.clear();
+    }
+
     void process_connection_updates() {
       {
         lock_guard<mutex> conn_guard(m_connection_update_list_lock);
@@ -276,18 +871,18 @@ namespace simple_web_game_server {
       }
 
       for(connection_update& update : m_connection_updates.second) {
-        auto games_it = m_games.find(update.id.session);
-        auto out_messages_it = m_out_messages.find(update.id.session);
+        auto index_it = m_game_index.find(update.id.session);
 
         if(update.disconnection) {
-          if(games_it != m_games.end()) {
-            games_it->second.disconnect(
-                out_messages_it->second,
-                update.id.player
-              );
+          if(index_it != m_game_index.end()) {
+            game_slot& slot = m_games[index_it->second];
+            slot.game.disconnect(slot.out_messages, update.id.player);
+            if constexpr (has_codecs) {
+              remove_protocol_player(slot, update.id.player);
+            }
           }
         } else {
-          if(games_it == m_games.end()) {
+          if(index_it == m_game_index.end()) {
             game_instance game{update.data};
 
             if(!game.is_valid()) {
@@ -299,70 +894,280 @@ namespace simple_web_game_server {
             }
 
             spdlog::debug("creating game session {}", update.id.session);
-            games_it = m_games.emplace(
-                update.id.session, std::move(game)
+            index_it = m_game_index.emplace(
+                update.id.session, m_games.size()
               ).first;
-            out_messages_it = m_out_messages.emplace(
-                update.id.session, vector<message>{}
-              ).first;
-            {
-              ++m_game_count;
-            }
+            m_games.emplace_back(update.id.session, std::move(game));
+            ++m_game_count;
+            m_jwt_server.get_metrics_registry().increment(
+                m_games_created_metric
+              );
           }
      
-          games_it->second.connect(out_messages_it->second, update.id.player);
+          game_slot& slot = m_games[index_it->second];
+          slot.game.connect(slot.out_messages, update.id.player);
+          if constexpr (has_codecs) {
+            set_protocol(slot, update.id.player, update.protocol);
+          }
         }
       }
 
       m_connection_updates.second.clear();
     }
 
+    // removes a game in constant time by moving the last game into its slot
+    void erase_game(const session_id& sid) {
+      auto index_it = m_game_index.find(sid);
+      if(index_it == m_game_index.end()) {
+        return;
+      }
+
+      const std::size_t index = index_it->second;
+      m_game_index.erase(index_it);
+      if(index + 1 != m_games.size()) {
+        m_games[index] = std::move(m_games.back());
+        m_game_index[m_games[index].sid] = index;
+      }
+      m_games.pop_back();
+      --m_game_count;
+    }
+
     void process_game_updates(long delta_time) {
       {
         lock_guard<mutex> msg_guard(m_in_message_list_lock);
         std::swap(m_in_messages.first, m_in_messages.second);
+        std::swap(m_in_traces.first, m_in_traces.second);
       }
 
-      // game updates are completely independent, so exec in parallel
-      std::for_each(
-          #if __cpp_lib_execution >= 201603
-            std::execution::par,
-          #endif
-          m_games.begin(),
-          m_games.end(),
-          [&](auto& key_val_pair){
-            auto in_msg_it = m_in_messages.second.find(key_val_pair.first);
-            if(in_msg_it != m_in_messages.second.end()) {
-              key_val_pair.second.update(
-                  m_out_messages.at(key_val_pair.first),
-                  in_msg_it->second,
-                  delta_time
-                );
-            } else {
-              key_val_pair.second.update(
-                  m_out_messages.at(key_val_pair.first),
-                  vector<message>{},
-                  delta_time
-                );
-            }
+      // each game traces the first sampled message in its inbox
+      for(session_trace& trace : m_in_traces.second) {
+        auto index_it = m_game_index.find(trace.first);
+        if(index_it != m_game_index.end()) {
+          game_slot& slot = m_games[index_it->second];
+          if(!message_tracer::is_traced(slot.trace)) {
+            slot.trace = trace.second;
           }
-        );
-      
+        }
+      }
+      m_in_traces.second.clear();
+
+      // deliver the tick's messages to the inbox of each game; messages for
+      // sessions without a running game are dropped
+      for(session_message& msg : m_in_messages.second) {
+        auto index_it = m_game_index.find(msg.first);
+        if(index_it != m_game_index.end()) {
+          m_games[index_it->second].in_messages.push_back(
+              std::move(msg.second)
+            );
+        }
+      }
       m_in_messages.second.clear();
+
+      // game updates are completely independent, so exec in parallel
+      auto update = [&](std::size_t i){
+          update_game(m_games[i], delta_time);
+        };
+      m_update_pool.run(m_games.size(), update);
     }
 
-    void process_message(const combined_id& id, std::string&& data) {
+    void update_game(game_slot& slot, long delta_time) {
+      if(message_tracer::is_traced(slot.trace)) {
+        slot.trace = m_jwt_server.get_message_tracer().record(
+            message_tracer::tick_wait, slot.trace
+          );
+      }
+
+      if constexpr (has_codecs) {
+        decode_messages(slot);
+        update_game(slot, slot.decoded_messages, delta_time);
+        slot.decoded_messages.clear();
+        encode_messages(slot);
+      } else {
+        update_game(slot, slot.in_messages, delta_time);
+      }
+      slot.in_messages.clear();
+    }
+
+    void update_game(
+        game_slot& slot,
+        const vector<message>& in_messages,
+        long delta_time
+      )
+    {
+      if constexpr (
+          has_broadcast_update<game_instance, message, broadcast>::value
+        ) {
+        slot.game.update(
+            slot.out_messages,
+            slot.broadcasts,
+            in_messages,
+            delta_time
+          );
+      } else {
+        slot.game.update(slot.out_messages, in_messages, delta_time);
+      }
+    }
+
+    // decodes the inbox of a game with the codec of each sender
+    void decode_messages(game_slot& slot) {
+      for(in_message& msg : slot.in_messages) {
+        value_type value;
+        if(codecs::decode(get_protocol(slot, msg.first), value, msg.second)) {
+          slot.decoded_messages.emplace_back(msg.first, std::move(value));
+        } else {
+          spdlog::debug(
+              "player {} sent a message that could not be decoded", msg.first
+            );
+        }
+      }
+    }
+
+    // encodes each message with the codec of its recipient, and each
+    // broadcast once for every codec with a connected player
+    void encode_messages(game_slot& slot) {
+      for(message& msg : slot.out_messages) {
+        std::size_t protocol = get_protocol(slot, msg.first);
+        slot.encoded_messages.emplace_back(
+            combined_id{ msg.first, slot.sid },
+            codecs::encode(protocol, msg.second),
+            get_codec_opcode(protocol),
+            get_conflation_key(slot.game, msg)
+          );
+      }
+      slot.out_messages.clear();
+
+      for(broadcast& msg : slot.broadcasts) {
+        const std::size_t key = get_broadcast_conflation_key(slot.game, msg);
+        for(std::size_t i = 0; i < codecs::size; ++i) {
+          if(!slot.protocol_players[i].empty()) {
+            slot.encoded_broadcasts.emplace_back(
+                i, codecs::encode(i, msg), key
+              );
+          }
+        }
+      }
+      slot.broadcasts.clear();
+    }
+
+    // returns the protocol of a player, or zero if the player never connected
+    static std::size_t get_protocol(const game_slot& slot, const player_id& id) {
+      for(const pair<player_id, std::size_t>& p : slot.protocols) {
+        if(p.first == id) {
+          return p.second;
+        }
+      }
+      return 0;
+    }
+
+    // records the protocol of a connecting player; a player's protocol is
+    // kept after disconnecting so late messages are still decoded correctly
+    static void set_protocol(
+        game_slot& slot,
+        const player_id& id,
+        std::size_t protocol
+      )
+    {
+      remove_protocol_player(slot, id);
+      slot.protocol_players[protocol].push_back(id);
+
+      for(pair<player_id, std::size_t>& p : slot.protocols) {
+        if(p.first == id) {
+          p.second = protocol;
+          return;
+        }
+      }
+      slot.protocols.emplace_back(id, protocol);
+    }
+
+    static void remove_protocol_player(game_slot& slot, const player_id& id) {
+      for(vector<player_id>& players : slot.protocol_players) {
+        players.erase(
+            std::remove(players.begin(), players.end(), id),
+            players.end()
+          );
+      }
+    }
+
+    static opcode::value get_codec_opcode(std::size_t protocol) {
+      if constexpr (has_codecs) {
+        return codecs::is_binary(protocol) ? opcode::binary : opcode::text;
+      } else {
+        return opcode::text;
+      }
+    }
+
+    static opcode::value get_opcode(const message& msg) {
+      if constexpr (has_opcodes) {
+        return std::get<2>(msg);
+      } else {
+        return opcode::text;
+      }
+    }
+
+    // returns the conflation key the game gives a message, or zero
+    static std::size_t get_conflation_key(
+        const game_instance& game,
+        const message& msg
+      )
+    {
+      if constexpr (has_conflation_key<game_instance, message>::value) {
+        return game.get_conflation_key(msg);
+      } else {
+        return 0;
+      }
+    }
+
+    static std::size_t get_broadcast_conflation_key(
+        const game_instance& game,
+        const broadcast& msg
+      )
+    {
+      if constexpr (
+          has_broadcast_conflation_key<game_instance, broadcast>::value
+        ) {
+        return game.get_broadcast_conflation_key(msg);
+      } else {
+        return 0;
+      }
+    }
+
+    void process_message(
+        const combined_id& id,
+        std::string&& data,
+        opcode::value op
+      )
+    {
       lock_guard<mutex> msg_guard(m_in_message_list_lock);
-      m_in_messages.first[id.session].emplace_back(
-          id.player, std::move(data)
-        );
+      if constexpr (has_opcodes) {
+        m_in_messages.first.emplace_back(
+            id.session, in_message{ id.player, std::move(data), op }
+          );
+      } else {
+        m_in_messages.first.emplace_back(
+            id.session, in_message{ id.player, std::move(data) }
+          );
+      }
+
+      const message_tracer::time_point trace = message_tracer::current();
+      if(message_tracer::is_traced(trace)) {
+        m_in_traces.first.emplace_back(
+            id.session,
+            m_jwt_server.get_message_tracer().record(
+              message_tracer::dispatch, trace
+            )
+          );
+      }
     }
 
     void player_connect(const combined_id& id, json&& data) {
+      std::size_t protocol = 0;
+      if constexpr (has_codecs) {
+        protocol = m_jwt_server.get_protocol(id);
+      }
       {
         lock_guard<mutex> guard(m_connection_update_list_lock);
         m_connection_updates.first.emplace_back(
-            id, std::move(data)
+            id, std::move(data), protocol
           );
       }
       m_game_condition.notify_one();
@@ -374,15 +1179,18 @@ namespace simple_web_game_server {
     }
 
     // member variables
-    session_id_map<game_instance> m_games;
+
+    // running games are stored densely so each tick is a linear scan;
+    // m_game_index maps each session to the index of its game slot
+    vector<game_slot> m_games;
+    session_id_map<std::size_t> m_game_index;
     mutex m_game_list_lock;
 
     atomic<std::size_t> m_game_count;
 
-    pair<
-        session_id_map<vector<message> >,
-        session_id_map<vector<message> >
-      > m_in_messages;
+    pair<vector<session_message>, vector<session_message> > m_in_messages;
+    // the sessions and queue times of sampled messages in m_in_messages
+    pair<vector<session_trace>, vector<session_trace> > m_in_traces;
     mutex m_in_message_list_lock;
 
     pair<
@@ -393,7 +1201,29 @@ namespace simple_web_game_server {
 
     condition_variable m_game_condition;
 
-    session_id_map<vector<message> > m_out_messages;
+    // schedules the ticks of update_games
+    tick_scheduler m_game_ticks;
+    catch_up_policy m_tick_policy;
+    std::size_t m_max_catch_up_ticks;
+
+    // updates games in parallel
+    update_pool m_update_pool;
+    std::size_t m_update_thread_count;
+    bool m_pin_update_threads;
+
+    vector<out_message> m_send_buffer;
+
+    // whether each tick's messages are bundled, and the bundles and keyed
+    // messages of the players of the game being batched, see
+    // set_message_batching
+    bool m_batch_messages;
+    vector<pair<combined_id, message_bundle> > m_batches;
+    vector<out_message> m_batched_messages;
+
+    // indices of the game loop metrics in the base_server's registry
+    std::size_t m_tick_metric;
+    std::size_t m_games_created_metric;
+    std::size_t m_games_finished_metric;
 
     jwt_base_server m_jwt_server;
   };
@@ -24,19 +24,108 @@
 #define JWT_GAME_SERVER_MATCHMAKING_SERVER_HPP
 
 #include "base_server.hpp"
+#include "tick_scheduler.hpp"
+#include "rating_index.hpp"
 
 #include <chrono>
 #include <functional>
 #include <tuple>
+#include <type_traits>
+#include <map>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <string>
 
 namespace simple_web_game_server {
   // Time literals to initialize timestep variables
   using namespace std::chrono_literals;
 
+  /// Detects whether a matchmaker ranks its sessions by rating.
+  /**
+   * True if the matchmaker defines get_rating(const session_data&), in which
+   * case type is the rating type it returns.
+   */
+  template<typename matchmaker, typename = void>
+  struct matchmaker_rating : std::false_type {
+    using type = int;
+  };
+
+  template<typename matchmaker>
+  struct matchmaker_rating<
+      matchmaker,
+      std::void_t<decltype(
+          std::declval<matchmaker&>().get_rating(
+            std::declval<const typename matchmaker::session_data&>()
+          )
+        )>
+    > : std::true_type
+  {
+    using type = std::decay_t<decltype(
+        std::declval<matchmaker&>().get_rating(
+          std::declval<const typename matchmaker::session_data&>()
+        )
+      )>;
+  };
+
+  /// Detects whether a matchmaker is driven by session events.
+  /**
+   * True if the matchmaker defines on_join(session_id, const session_data&),
+   * on_update(session_id, const session_data&), on_leave(session_id), and a
+   * can_match() taking no arguments.
+   */
+  template<typename matchmaker, typename = void>
+  struct has_matchmaker_events : std::false_type {};
+
+  template<typename matchmaker>
+  struct has_matchmaker_events<
+      matchmaker,
+      std::void_t<
+          decltype(std::declval<matchmaker&>().on_join(
+            std::declval<typename matchmaker::session_id>(),
+            std::declval<const typename matchmaker::session_data&>()
+          )),
+          decltype(std::declval<matchmaker&>().on_update(
+            std::declval<typename matchmaker::session_id>(),
+            std::declval<const typename matchmaker::session_data&>()
+          )),
+          decltype(std::declval<matchmaker&>().on_leave(
+            std::declval<typename matchmaker::session_id>()
+          )),
+          decltype(std::declval<matchmaker&>().can_match())
+        >
+    > : std::true_type {};
+
   /// A matchmaking server built on the base_server class.
   /**
    * This class wraps an underlying base_server
    * and performs matchmaking between connected client sessions.
+   *
+   * Sessions may be split into named partitions, e.g. one per game mode or
+   * region, chosen from each session's JWT data by the partition handler.
+   * Every partition has its own session map, matchmaker instance, and lock,
+   * and is matched by its own match_partition loop, so one busy partition
+   * never delays another. Without partitions every session waits in the
+   * default partition matched by match_players.
+   *
+   * If the matchmaker defines get_rating(const session_data&), the server
+   * keeps a rating_index of the waiting sessions, inserting and erasing
+   * sessions as they connect, disconnect, and finish. The matchmaker's
+   * match function is then passed the index after the session map, so it can
+   * pair sessions without rescanning every waiting session each tick.
+   *
+   * If the matchmaker instead defines the events detected by
+   * has_matchmaker_events, the server passes it deltas rather than
+   * snapshots: on_join when a session starts waiting, on_update when a
+   * later connection to a waiting session brings new valid data, and on_leave
+   * when a waiting session cancels or disconnects. The matchmaker keeps its
+   * own structures, so can_match() and match(games, messages, delta_time)
+   * take no session map, and the server applies updates as they arrive and
+   * only ticks once can_match() reports a possible match. Sessions returned
+   * in a game should be dropped by the matchmaker itself, which should
+   * ignore any on_update or on_leave for such a session that arrives before
+   * its game token is sent. The session_data type must then be move
+   * assignable.
    */
   template<typename matchmaker, typename jwt_clock, typename json_traits,
     typename server_config, typename close_reasons = default_close_reasons>
@@ -60,12 +149,23 @@ namespace simple_web_game_server {
  
     using json = typename jwt_base_server::json;
     using clock = typename jwt_base_server::clock;
+    using time_point = typename clock::time_point;
 
     using game = std::tuple<vector<session_id>, session_id, json>;
     using message = pair<session_id, std::string>;
     using session_data = typename matchmaker::session_data;
 
     using ssl_context_ptr = typename jwt_base_server::ssl_context_ptr;
+    using server_error = typename jwt_base_server::server_error;
+
+    static constexpr bool has_events = has_matchmaker_events<matchmaker>::value;
+    static constexpr bool has_rating = matchmaker_rating<matchmaker>::value
+      && !has_events;
+    using rating_index_type = rating_index<
+        session_id,
+        typename matchmaker_rating<matchmaker>::type,
+        typename combined_id::hash
+      >;
 
     /// The data associated to a connecting or disconnecting client.
     struct connection_update {
@@ -79,9 +179,78 @@ namespace simple_web_game_server {
       bool disconnection;
     };
 
+    /// When a session started waiting, and its data if it may overflow.
+    struct waiting_session {
+      time_point since;
+      json data;
+    };
+
+    /// An independent matchmaking queue with its own matchmaker and thread.
+    struct partition {
+      partition() : overflow(nullptr), overflow_wait(0), waiting(0), joined(0),
+        matched(0), games(0), cancelled(0), overflowed(0) {}
+
+      matchmaker mm;
+
+      session_id_map<session_data> session_data_map;
+      session_id_map<set<player_id> > session_players;
+      // waiting sessions in rating order, only filled if the matchmaker rates
+      rating_index_type ratings;
+      mutex match_lock;
+
+      pair<
+          vector<connection_update>,
+          vector<connection_update>
+        > connection_updates;
+      mutex connection_update_list_lock;
+
+      condition_variable match_condition;
+
+      // schedules the ticks of match_players
+      tick_scheduler match_ticks;
+
+      // sessions not yet matched, cancelled, or overflowed
+      session_id_map<waiting_session> waiting_sessions;
+
+      // sessions waiting longer than overflow_wait move to overflow
+      partition* overflow;
+      std::chrono::milliseconds overflow_wait;
+      std::deque<pair<time_point, session_id> > overflow_order;
+
+      std::atomic<std::size_t> waiting;
+      std::atomic<std::size_t> joined;
+      std::atomic<std::size_t> matched;
+      std::atomic<std::size_t> games;
+      std::atomic<std::size_t> cancelled;
+      std::atomic<std::size_t> overflowed;
+    };
+
   // main class body
   public:
     using connection_ptr = typename jwt_base_server::connection_ptr;
+    using verification_stats = typename jwt_base_server::verification_stats;
+
+    /// Throughput metrics for one matchmaking partition.
+    /**
+     * The counters are totals since the server was constructed; callers
+     * sample them periodically to compute rates.
+     */
+    struct partition_stats {
+      /// Sessions currently waiting to be matched.
+      std::size_t waiting;
+      /// Sessions that started waiting, including those overflowed in.
+      std::size_t joined;
+      /// Sessions placed into games.
+      std::size_t matched;
+      /// Games created.
+      std::size_t games;
+      /// Waiting sessions that cancelled, disconnected, or were invalid.
+      std::size_t cancelled;
+      /// Waiting sessions moved to the overflow partition.
+      std::size_t overflowed;
+      /// Timing statistics of the partition's match_players loop.
+      tick_stats ticks;
+    };
 
     /// The constructor for the matchmaking_server class.
     /**
@@ -92,8 +261,11 @@ namespace simple_web_game_server {
         const jwt::verifier<jwt_clock, json_traits>& v,
         function<std::string(const combined_id&, const json&)> f,
         std::chrono::milliseconds t
-      ) : m_jwt_server{v, f, t}
+      ) : m_tick_policy(catch_up_policy::skip), m_max_catch_up_ticks(4),
+          m_jwt_server{v, f, t}
     {
+      m_partitions.emplace(std::string{}, std::make_unique<partition>());
+
       m_jwt_server.set_open_handler(
           bind(
             &matchmaking_server::player_connect,
@@ -117,6 +289,16 @@ namespace simple_web_game_server {
             simple_web_game_server::_2
           )
         );
+
+      metrics_registry& metrics = m_jwt_server.get_metrics_registry();
+      m_pass_metric = metrics.add_histogram(
+          "simple_web_game_server_matchmaking_pass_seconds",
+          "Time spent running each matchmaking pass."
+        );
+      m_games_created_metric = metrics.add_counter(
+          "simple_web_game_server_games_created_total",
+          "Game sessions created."
+        );
     }
 
     /// Constructs the underlying base_server with a default time-step.
@@ -135,6 +317,114 @@ namespace simple_web_game_server {
       m_jwt_server.set_tls_init_handler(f);
     }
 
+    /// Sets the HTTP path at which the base_server serves get_metrics().
+    void set_metrics_path(const std::string& path) {
+      m_jwt_server.set_metrics_path(path);
+    }
+
+    /// Traces one in every n messages through the underlying base_server.
+    void set_trace_sample_interval(std::size_t n) {
+      m_jwt_server.set_trace_sample_interval(n);
+    }
+
+    /// Sets the number of action queue shards for the underlying base_server.
+    void set_action_shard_count(std::size_t n) {
+      m_jwt_server.set_action_shard_count(n);
+    }
+
+    /// Sets the capacity of the underlying base_server's verification queue.
+    void set_verification_queue_size(std::size_t n) {
+      m_jwt_server.set_verification_queue_size(n);
+    }
+
+    /// Sets the underlying base_server's limits on messages held during JWT
+    /// verification.
+    void set_pending_message_limit(
+        std::size_t max_messages,
+        std::size_t max_bytes
+      )
+    {
+      m_jwt_server.set_pending_message_limit(max_messages, max_bytes);
+    }
+
+    /// Sets how match_players catches up when matching overruns a tick.
+    /**
+     * Takes effect the next time match_players is called. The max_catch_up
+     * parameter is only used by catch_up_policy::clamp.
+     */
+    void set_tick_policy(catch_up_policy policy, std::size_t max_catch_up = 4) {
+      m_tick_policy = policy;
+      m_max_catch_up_ticks = max_catch_up;
+    }
+
+    /// Sets the number of verified tokens the base_server caches.
+    void set_token_cache_size(std::size_t n) {
+      m_jwt_server.set_token_cache_size(n);
+    }
+
+    /// Sets the bytes a connection may buffer before messages to it are held.
+    void set_write_buffer_limit(std::size_t bytes) {
+      m_jwt_server.set_write_buffer_limit(bytes);
+    }
+
+    /// Sets the budget of held messages and the policy applied beyond it.
+    void set_slow_consumer_policy(
+        slow_consumer_policy policy,
+        std::size_t max_messages = 1024,
+        std::size_t max_bytes = 4 << 20
+      )
+    {
+      m_jwt_server.set_slow_consumer_policy(policy, max_messages, max_bytes);
+    }
+
+    /// Adds a named matchmaking partition; may only be called while stopped.
+    /**
+     * Each partition has its own session map, matchmaker instance, and
+     * match_players loop, so matching in one partition never waits on
+     * another. The default partition, with an empty name, always exists.
+     */
+    void add_partition(const std::string& name) {
+      if(is_running()) {
+        throw server_error{"add_partition called on running server"};
+      }
+      if(m_partitions.count(name) == 0) {
+        m_partitions.emplace(name, std::make_unique<partition>());
+      }
+    }
+
+    /// Sets the function choosing the partition of a new session.
+    /**
+     * The function is passed the session's JWT data and returns a partition
+     * name. Sessions assigned to an unknown partition wait in the default
+     * partition. Without a handler every session uses the default partition.
+     */
+    void set_partition_handler(function<std::string(const json&)> f) {
+      if(is_running()) {
+        throw server_error{"set_partition_handler called on running server"};
+      }
+      m_partition_handler = f;
+    }
+
+    /// Moves sessions left unmatched too long in one partition to another.
+    /**
+     * Sessions waiting in partition from for longer than wait are removed
+     * from its matchmaker and rejoin partition to, e.g. to merge a sparse
+     * regional queue into a global one. Both partitions must exist.
+     */
+    void set_partition_overflow(
+        const std::string& from,
+        const std::string& to,
+        std::chrono::milliseconds wait
+      )
+    {
+      if(is_running()) {
+        throw server_error{"set_partition_overflow called on running server"};
+      }
+      partition& source = get_partition(from);
+      source.overflow = &get_partition(to);
+      source.overflow_wait = wait;
+    }
+
     /// Runs the underlying base_server.
     void run(uint16_t port, bool unlock_address = false) {
       m_jwt_server.run(port, unlock_address);
@@ -145,6 +435,11 @@ namespace simple_web_game_server {
       m_jwt_server.process_messages();
     }
 
+    /// Runs the process_verifications loop on the underlying base_server.
+    void process_verifications() {
+      m_jwt_server.process_verifications();
+    }
+
     /// Stops, clears, and resets the server so it may be run again.
     void reset() {
       stop();
@@ -154,17 +449,28 @@ namespace simple_web_game_server {
     /// Stops the server and clears all data and connections.
     void stop() {
       m_jwt_server.stop();
-      {
-        lock_guard<mutex> guard(m_match_lock);
-        m_session_data.clear();
-        m_session_players.clear();
-        m_connection_updates.second.clear();
+      for(auto& ppair : m_partitions) {
+        partition& p = *ppair.second;
+        {
+          lock_guard<mutex> guard(p.match_lock);
+          p.session_data_map.clear();
+          p.session_players.clear();
+          p.ratings.clear();
+          p.waiting_sessions.clear();
+          p.overflow_order.clear();
+          p.waiting = 0;
+          p.connection_updates.second.clear();
+        }
+        {
+          lock_guard<mutex> guard(p.connection_update_list_lock);
+          p.connection_updates.first.clear();
+        }
+        p.match_condition.notify_one();
       }
       {
-        lock_guard<mutex> guard(m_connection_update_list_lock);
-        m_connection_updates.first.clear();
+        lock_guard<mutex> guard(m_partition_lock);
+        m_session_partitions.clear();
       }
-      m_match_condition.notify_one();
     }
 
     /// Returns the number of verified clients connected.
@@ -172,56 +478,127 @@ namespace simple_web_game_server {
       return m_jwt_server.get_player_count();
     }
 
+    /// Returns the JWT verification metrics of the underlying base_server.
+    verification_stats get_verification_stats() {
+      return m_jwt_server.get_verification_stats();
+    }
+
+    /// Returns the timing statistics of the default partition's loop.
+    tick_stats get_tick_stats() {
+      return get_partition(std::string{}).match_ticks.get_stats();
+    }
+
+    /// Returns the server metrics in the Prometheus text format.
+    std::string get_metrics() {
+      return m_jwt_server.get_metrics();
+    }
+
+    /// Returns the throughput metrics of the named partition.
+    partition_stats get_partition_stats(const std::string& name) {
+      partition& p = get_partition(name);
+      return partition_stats{
+          p.waiting,
+          p.joined,
+          p.matched,
+          p.games,
+          p.cancelled,
+          p.overflowed,
+          p.match_ticks.get_stats()
+        };
+    }
+
     bool is_running() {
       return m_jwt_server.is_running();
     }
 
-    /// Loop to match players.
+    /// Loop to match players in the default partition.
     /**
      * Processes client connections and disconnections and matches connected
      * client sessions together. It may also send out any messages broadcast by
      * the matchmaking function. Should only be called by one thread.
      */
-
     void match_players(std::chrono::milliseconds timestep) {
-      auto time_start = clock::now();
+      match_partition(std::string{}, timestep);
+    }
+
+    /// Loop to match players in the named partition.
+    /**
+     * Behaves as match_players(timestep) for the sessions of one partition.
+     * Should only be called by one thread per partition.
+     */
+    void match_partition(
+        const std::string& name,
+        std::chrono::milliseconds timestep
+      )
+    {
+      partition& p = get_partition(name);
       pair<vector<session_id>, vector<session_id> > finished_sessions;
+      p.match_ticks.start(timestep, m_tick_policy, m_max_catch_up_ticks);
 
       while(m_jwt_server.is_running()) {
-        unique_lock<mutex> match_lock(m_match_lock);
+        unique_lock<mutex> match_lock(p.match_lock);
 
-        if(!m_matchmaker.can_match(m_session_data)) {
+        if(!has_work(p)) {
           match_lock.unlock();
-          unique_lock<mutex> conn_lock(m_connection_update_list_lock);
-          while(m_connection_updates.first.empty()) {
-            m_match_condition.wait(conn_lock);
-            if(!m_jwt_server.is_running()) {
-              return;
+          {
+            unique_lock<mutex> conn_lock(p.connection_update_list_lock);
+            if(p.connection_updates.first.empty()) {
+              p.match_condition.wait(conn_lock, [this, &p](){
+                  return !p.connection_updates.first.empty()
+                    || !m_jwt_server.is_running();
+                });
+              if(!m_jwt_server.is_running()) {
+                return;
+              }
+              p.match_ticks.restart();
             }
           }
           match_lock.lock();
-        }
 
-        auto delta_time =
-          std::chrono::duration_cast<std::chrono::milliseconds>(
-            clock::now() - time_start
-          );
-        const long dt_count = delta_time.count();
+          if constexpr (has_events) {
+            // apply the updates now and keep sleeping until they make a
+            // match possible, rather than ticking to find out
+            process_connection_updates(p, finished_sessions.second);
+            if(!has_work(p)) {
+              continue;
+            }
+          }
+        }
 
-        if(delta_time < timestep) {
+        const tick_scheduler::time_point now = tick_scheduler::clock::now();
+        if(now < p.match_ticks.get_deadline()) {
+          // block until the deadline, waking early only to stop
           match_lock.unlock();
-          std::this_thread::sleep_for(std::min(1us, timestep-delta_time+1us));
+          unique_lock<mutex> conn_lock(p.connection_update_list_lock);
+          p.match_condition.wait_until(
+              conn_lock,
+              p.match_ticks.get_deadline(),
+              [this](){ return !m_jwt_server.is_running(); }
+            );
         } else {
-          time_start = clock::now();
+          const long dt_count =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+              p.match_ticks.tick(now)
+            ).count();
 
-          process_connection_updates(finished_sessions.second);
+          process_connection_updates(p, finished_sessions.second);
 
           // we remove data here to catch any possible players submitting
           // connections in the last timestep when the session ends
-          for(const session_id& sid : finished_sessions.first) {
-            spdlog::trace("erasing data for session {}", sid);
-            m_session_data.erase(sid);
-            m_session_players.erase(sid);
+          if(!finished_sessions.first.empty()) {
+            lock_guard<mutex> guard(m_partition_lock);
+            for(const session_id& sid : finished_sessions.first) {
+              spdlog::trace("erasing data for session {}", sid);
+              p.session_data_map.erase(sid);
+              p.session_players.erase(sid);
+              p.ratings.erase(sid);
+              p.waiting_sessions.erase(sid);
+
+              auto it = m_session_partitions.find(sid);
+              if(it != m_session_partitions.end() && it->second == &p) {
+                m_session_partitions.erase(it);
+              }
+            }
           }
           finished_sessions.first.clear();
           std::swap(finished_sessions.first, finished_sessions.second);
@@ -229,18 +606,28 @@ namespace simple_web_game_server {
           vector<game> games;
           {
             vector<pair<session_id, std::string> > messages;
-            m_matchmaker.match(games, messages, m_session_data, dt_count);
+            if constexpr (has_events) {
+              p.mm.match(games, messages, dt_count);
+            } else if constexpr (has_rating) {
+              p.mm.match(
+                  games, messages, p.session_data_map, p.ratings, dt_count
+                );
+            } else {
+              p.mm.match(games, messages, p.session_data_map, dt_count);
+            }
 
+            vector<pair<combined_id, std::string> > out_messages;
             for(message& msg : messages) {
-              auto session_players_it = m_session_players.find(msg.first);
-              if(session_players_it != m_session_players.end()) {
+              auto session_players_it = p.session_players.find(msg.first);
+              if(session_players_it != p.session_players.end()) {
                 for(player_id pid : session_players_it->second) {
-                  m_jwt_server.send_message(
-                      { pid, msg.first }, std::move(msg.second)
+                  out_messages.emplace_back(
+                      combined_id{ pid, msg.first }, msg.second
                     );
                 }
               }
             }
+            m_jwt_server.send_messages(out_messages);
           }
  
           for(game& g : games) {
@@ -255,64 +642,265 @@ namespace simple_web_game_server {
               m_jwt_server.complete_session(
                   sid, game_sid, game_data
                 );
+              p.waiting_sessions.erase(sid);
               finished_sessions.first.push_back(sid);
             }
+
+            p.matched += sessions.size();
+            ++p.games;
           }
+          m_jwt_server.get_metrics_registry().increment(
+              m_games_created_metric, games.size()
+            );
+
+          if(p.overflow != nullptr) {
+            overflow_sessions(p, clock::now());
+          }
+          p.waiting = p.waiting_sessions.size();
+
+          m_jwt_server.get_metrics_registry().observe(
+              m_pass_metric,
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                tick_scheduler::clock::now() - now
+              )
+            );
         }
       }
     }
 
   private:
-    void process_connection_updates(vector<session_id>& finished_sessions) {
+    partition& get_partition(const std::string& name) {
+      auto it = m_partitions.find(name);
+      if(it == m_partitions.end()) {
+        throw server_error{"unknown matchmaking partition " + name};
+      }
+      return *it->second;
+    }
+
+    bool can_match(partition& p) {
+      if constexpr (has_events) {
+        return p.mm.can_match();
+      } else {
+        return p.mm.can_match(p.session_data_map);
+      }
+    }
+
+    // a partition must keep ticking while sessions may still overflow
+    bool has_work(partition& p) {
+      return can_match(p) || !p.overflow_order.empty();
+    }
+
+    // appends updates to a partition's list and wakes its loop
+    void push_updates(partition& p, vector<connection_update>& updates) {
+      {
+        lock_guard<mutex> guard(p.connection_update_list_lock);
+        for(connection_update& update : updates) {
+          p.connection_updates.first.push_back(std::move(update));
+        }
+      }
+      updates.clear();
+      p.match_condition.notify_one();
+    }
+
+    void process_connection_updates(
+        partition& p,
+        vector<session_id>& finished_sessions
+      )
+    {
       {
-        unique_lock<mutex> conn_lock(m_connection_update_list_lock);
-        std::swap(m_connection_updates.first, m_connection_updates.second);
+        unique_lock<mutex> conn_lock(p.connection_update_list_lock);
+        std::swap(p.connection_updates.first, p.connection_updates.second);
       }
 
-      for(connection_update& update : m_connection_updates.second) {
-        auto it = m_session_data.find(update.id.session);
+      // sessions may have overflowed to another partition after their
+      // update was routed here, so forward those to where they now wait
+      std::map<partition*, vector<connection_update> > forwarded;
+      {
+        lock_guard<mutex> guard(m_partition_lock);
+        vector<connection_update>& updates = p.connection_updates.second;
+        std::size_t kept = 0;
+        for(std::size_t i = 0; i < updates.size(); ++i) {
+          session_id sid = updates[i].id.session;
+          auto it = m_session_partitions.find(sid);
+          if(it == m_session_partitions.end()) {
+            if(!updates[i].disconnection) {
+              m_session_partitions.emplace(sid, &p);
+            }
+          } else if(it->second != &p) {
+            forwarded[it->second].push_back(std::move(updates[i]));
+            continue;
+          }
+          if(kept != i) {
+            updates[kept] = std::move(updates[i]);
+          }
+          ++kept;
+        }
+        updates.erase(updates.begin() + kept, updates.end());
+      }
+      for(auto& fpair : forwarded) {
+        push_updates(*fpair.first, fpair.second);
+      }
+
+      for(connection_update& update : p.connection_updates.second) {
+        auto it = p.session_data_map.find(update.id.session);
         if(update.disconnection) {
-          if(it != m_session_data.end()) {
+          if(it != p.session_data_map.end()) {
             spdlog::trace(
                 "processing disconnection for session {}", update.id.session
               );
             m_jwt_server.complete_session(
                 update.id.session,
                 update.id.session,
-                m_matchmaker.get_cancel_data()
+                p.mm.get_cancel_data()
               );
-            m_session_data.erase(it);
-            m_session_players.erase(update.id.session);
+            p.session_data_map.erase(it);
+            p.session_players.erase(update.id.session);
+            p.ratings.erase(update.id.session);
+            if(p.waiting_sessions.erase(update.id.session) > 0) {
+              ++p.cancelled;
+            }
+            if constexpr (has_events) {
+              p.mm.on_leave(update.id.session);
+            }
             finished_sessions.push_back(update.id.session);
           }
         } else {
           spdlog::trace(
               "processing connection for session {}", update.id.session
             );
-          if(it == m_session_data.end()) {
+          if(it == p.session_data_map.end()) {
             session_data data{update.data};
 
             if(data.is_valid()) {
-              m_session_data.emplace(
+              auto data_it = p.session_data_map.emplace(
                   update.id.session, std::move(data)
-                );
-              m_session_players.emplace(
+                ).first;
+              p.session_players.emplace(
                   update.id.session, set<player_id>{ update.id.player }
                 );
+              if constexpr (has_events) {
+                p.mm.on_join(update.id.session, data_it->second);
+              } else if constexpr (has_rating) {
+                p.ratings.insert(
+                    update.id.session,
+                    p.mm.get_rating(data_it->second)
+                  );
+              }
+              const time_point since = clock::now();
+              if(p.overflow != nullptr) {
+                // keep the data so the session can rejoin another partition
+                p.waiting_sessions[update.id.session] =
+                  waiting_session{ since, std::move(update.data) };
+                p.overflow_order.emplace_back(since, update.id.session);
+              } else {
+                p.waiting_sessions[update.id.session] =
+                  waiting_session{ since, json{} };
+              }
+              ++p.joined;
             } else {
               m_jwt_server.complete_session(
                   update.id.session,
                   update.id.session,
-                  m_matchmaker.get_cancel_data()
+                  p.mm.get_cancel_data()
                 );
+              ++p.cancelled;
               finished_sessions.push_back(update.id.session);
             }
           } else {
-            m_session_players.at(update.id.session).insert(update.id.player);
+            p.session_players.at(update.id.session).insert(update.id.player);
+            if constexpr (has_events) {
+              session_data data{update.data};
+              if(data.is_valid()) {
+                it->second = std::move(data);
+                p.mm.on_update(update.id.session, it->second);
+              }
+            }
           }
         }
       }
-      m_connection_updates.second.clear();
+      p.connection_updates.second.clear();
+      p.waiting = p.waiting_sessions.size();
+    }
+
+    // moves sessions that have waited too long to the overflow partition
+    void overflow_sessions(partition& p, time_point now) {
+      vector<connection_update> moved;
+
+      while(!p.overflow_order.empty()) {
+        const time_point since = p.overflow_order.front().first;
+        const session_id sid = p.overflow_order.front().second;
+
+        // drop sessions that were matched, cancelled, or rejoined since
+        auto it = p.waiting_sessions.find(sid);
+        if(it == p.waiting_sessions.end() || it->second.since != since) {
+          p.overflow_order.pop_front();
+          continue;
+        }
+
+        if(now < since + p.overflow_wait) {
+          break;
+        }
+        p.overflow_order.pop_front();
+
+        spdlog::trace("overflowing session {}", sid);
+        for(const player_id& pid : p.session_players.at(sid)) {
+          moved.emplace_back(combined_id{ pid, sid }, json{it->second.data});
+        }
+
+        p.waiting_sessions.erase(it);
+        p.session_data_map.erase(sid);
+        p.session_players.erase(sid);
+        p.ratings.erase(sid);
+        if constexpr (has_events) {
+          p.mm.on_leave(sid);
+        }
+        ++p.overflowed;
+
+        lock_guard<mutex> guard(m_partition_lock);
+        m_session_partitions[sid] = p.overflow;
+      }
+
+      if(!moved.empty()) {
+        push_updates(*p.overflow, moved);
+      }
+    }
+
+    // routes an update to the partition its session waits in
+    void route_update(connection_update&& update) {
+      partition* p = nullptr;
+      {
+        lock_guard<mutex> guard(m_partition_lock);
+        auto it = m_session_partitions.find(update.id.session);
+        if(it != m_session_partitions.end()) {
+          p = it->second;
+        } else if(!update.disconnection) {
+          p = &choose_partition(update.data);
+          m_session_partitions.emplace(update.id.session, p);
+        }
+      }
+
+      if(p == nullptr) {
+        spdlog::trace(
+            "dropping update for finished session {}", update.id.session
+          );
+        return;
+      }
+
+      {
+        lock_guard<mutex> guard(p->connection_update_list_lock);
+        p->connection_updates.first.push_back(std::move(update));
+      }
+      p->match_condition.notify_one();
+    }
+
+    partition& choose_partition(const json& data) {
+      if(m_partition_handler) {
+        auto it = m_partitions.find(m_partition_handler(data));
+        if(it != m_partitions.end()) {
+          return *it->second;
+        }
+      }
+      return *m_partitions.at(std::string{});
     }
 
     // proper procedure for client to cancel matchmaking is to send a message
@@ -321,45 +909,31 @@ namespace simple_web_game_server {
     // player disconnects after the match function is called, but before a game
     // token is successfully sent to them
     void process_message(const combined_id& id, std::string&& data) {
-      {
-        lock_guard<mutex> guard(m_connection_update_list_lock);
-        m_connection_updates.first.emplace_back(id);
-      }
-      m_match_condition.notify_one();
+      route_update(connection_update{id});
     }
 
     void player_connect(const combined_id& id, json&& data) {
-      {
-        lock_guard<mutex> guard(m_connection_update_list_lock);
-        m_connection_updates.first.emplace_back(
-            id, std::move(data)
-          );
-      }
-      m_match_condition.notify_one();
+      route_update(connection_update{id, std::move(data)});
     }
 
     void player_disconnect(const combined_id& id) {
-      {
-        lock_guard<mutex> guard(m_connection_update_list_lock);
-        m_connection_updates.first.emplace_back(id);
-      }
-      m_match_condition.notify_one();
+      route_update(connection_update{id});
     }
 
     // member variables
-    matchmaker m_matchmaker;
+    std::map<std::string, std::unique_ptr<partition> > m_partitions;
+    function<std::string(const json&)> m_partition_handler;
 
-    session_id_map<session_data> m_session_data;
-    session_id_map<set<player_id> > m_session_players;
-    mutex m_match_lock;
+    // the partition each waiting session was routed to
+    session_id_map<partition*> m_session_partitions;
+    mutex m_partition_lock;
 
-    pair<
-        vector<connection_update>,
-        vector<connection_update>
-      > m_connection_updates;
-    mutex m_connection_update_list_lock;
+    catch_up_policy m_tick_policy;
+    std::size_t m_max_catch_up_ticks;
 
-    condition_variable m_match_condition;
+    // indices of the matchmaking metrics in the base_server's registry
+    std::size_t m_pass_metric;
+    std::size_t m_games_created_metric;
 
     jwt_base_server m_jwt_server;
   };
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_MESSAGE_BATCH_HPP
+#define JWT_GAME_SERVER_MESSAGE_BATCH_HPP
+
+#include <websocketpp/frame.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace simple_web_game_server {
+  /// Bundles several messages into the payload of one binary frame.
+  /**
+   * A bundle is a sequence of entries, each a one byte WebSocket opcode,
+   * the payload length as four bytes in network byte order, and then the
+   * payload. A server that sends bundles names the handshake_header() in
+   * its handshake response; on such a connection every binary frame is a
+   * bundle, while a text frame is a single text message as usual. The
+   * client and multiplex_client unpack bundles before calling their
+   * message handlers.
+   */
+  struct message_batch {
+    using opcode_value = websocketpp::frame::opcode::value;
+
+    /// The handshake response header announcing that bundles are sent.
+    static const char* handshake_header() {
+      return "X-Message-Batch";
+    }
+
+    /// Appends a message with the given opcode to bundle.
+    static void append(
+        std::string& bundle,
+        const std::string& payload,
+        opcode_value op
+      )
+    {
+      const std::uint32_t size = static_cast<std::uint32_t>(payload.size());
+      bundle.reserve(bundle.size() + HEADER_SIZE + payload.size());
+      bundle.push_back(static_cast<char>(op));
+      for(int shift = 24; shift >= 0; shift -= 8) {
+        bundle.push_back(static_cast<char>((size >> shift) & 0xff));
+      }
+      bundle.append(payload);
+    }
+
+    /// Calls f(payload, op) for each message in bundle, in order.
+    /**
+     * Returns false, having called f for the messages before it, if bundle
+     * is malformed.
+     */
+    template<typename function>
+    static bool unpack(const std::string& bundle, function&& f) {
+      std::string payload;
+      std::size_t pos = 0;
+      while(pos < bundle.size()) {
+        if(bundle.size() - pos < HEADER_SIZE) {
+          return false;
+        }
+
+        const opcode_value op = static_cast<opcode_value>(
+            static_cast<unsigned char>(bundle[pos])
+          );
+        std::uint32_t size = 0;
+        for(std::size_t i = 1; i < HEADER_SIZE; ++i) {
+          size = (size << 8) | static_cast<unsigned char>(bundle[pos + i]);
+        }
+        pos += HEADER_SIZE;
+
+        if(bundle.size() - pos < size) {
+          return false;
+        }
+        payload.assign(bundle, pos, size);
+        pos += size;
+        f(payload, op);
+      }
+      return true;
+    }
+
+  private:
+    static constexpr std::size_t HEADER_SIZE = 5;
+  };
+}
+
+#endif // JWT_GAME_SERVER_MESSAGE_BATCH_HPP
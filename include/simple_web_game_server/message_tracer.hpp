@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_MESSAGE_TRACER_HPP
+#define JWT_GAME_SERVER_MESSAGE_TRACER_HPP
+
+#include "metrics.hpp"
+
+#include <cstddef>
+#include <string>
+#include <chrono>
+
+namespace simple_web_game_server {
+  /// Samples messages and records the time they spend in each server stage.
+  /**
+   * A sampled message is stamped with the time it reaches a stage, and when
+   * it reaches the next stage the difference is recorded in the histogram
+   * of the stage it left, in the metrics_registry given on construction. The
+   * stages of an incoming message are
+   *
+   *   action_queue: from the socket read to its worker taking it from the
+   *     action queue,
+   *   dispatch: from there to the game_server queueing it for its game,
+   *   tick_wait: from there to the start of the update of its game,
+   *   game_update: from there to the end of the tick, once the tick's
+   *     output has been queued to be sent,
+   *
+   * and outgoing messages are sampled separately for
+   *
+   *   send_queue: from being queued to be sent to being written to the
+   *     socket by a worker.
+   *
+   * Sampling costs a thread local counter per message, and only sampled
+   * messages read the clock, so tracing may be left on in production with a
+   * suitable interval.
+   */
+  class message_tracer {
+  public:
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+
+    /// The stages timed for each sampled message.
+    enum stage {
+      action_queue,
+      dispatch,
+      tick_wait,
+      game_update,
+      send_queue,
+      stage_count
+    };
+
+    /// Adds a histogram of the latency of each stage to metrics.
+    explicit message_tracer(metrics_registry& metrics)
+      : m_metrics(metrics), m_sample_interval(0)
+    {
+      const char* names[stage_count] = {
+          "action_queue", "dispatch", "tick_wait", "game_update", "send_queue"
+        };
+      for(std::size_t i = 0; i < stage_count; ++i) {
+        m_stage_metrics[i] = metrics.add_histogram(
+            "simple_web_game_server_message_stage_seconds",
+            "Time sampled messages spend in each stage of the server.",
+            metrics_registry::log_linear_buckets(0.000001, 10.0, 2),
+            std::string{"stage=\""} + names[i] + "\""
+          );
+      }
+    }
+
+    /// Samples one in every n messages on each thread; zero disables tracing.
+    /**
+     * Must not be called while messages are being traced.
+     */
+    void set_sample_interval(std::size_t n) {
+      m_sample_interval = n;
+    }
+
+    /// Returns the sampling interval, see set_sample_interval.
+    std::size_t get_sample_interval() const {
+      return m_sample_interval;
+    }
+
+    /// Returns true if the next message on the calling thread is sampled.
+    bool sample() {
+      if(m_sample_interval == 0) {
+        return false;
+      }
+
+      thread_local std::size_t count = 0;
+      if(++count < m_sample_interval) {
+        return false;
+      }
+      count = 0;
+      return true;
+    }
+
+    /// Records the time since start for stage s and returns the current time.
+    time_point record(stage s, time_point start) {
+      const time_point now = clock::now();
+      m_metrics.observe(
+          m_stage_metrics[s],
+          std::chrono::duration_cast<std::chrono::nanoseconds>(now - start)
+        );
+      return now;
+    }
+
+    /// The time at which the message being handled on this thread was stamped.
+    /**
+     * Set while a base_server handler runs, so the handler can carry the
+     * trace of a sampled message on; time_point{} if it was not sampled.
+     */
+    static time_point& current() {
+      thread_local time_point trace;
+      return trace;
+    }
+
+    /// Returns true if the time point t marks a sampled message.
+    static bool is_traced(time_point t) {
+      return t != time_point{};
+    }
+
+  private:
+    metrics_registry& m_metrics;
+    std::size_t m_stage_metrics[stage_count];
+    std::size_t m_sample_interval;
+  };
+}
+
+#endif // JWT_GAME_SERVER_MESSAGE_TRACER_HPP
@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_METRICS_HPP
+#define JWT_GAME_SERVER_METRICS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+#include <atomic>
+#include <mutex>
+
+namespace simple_web_game_server {
+  /// Counters, histograms, and gauges rendered in the Prometheus text format.
+  /**
+   * Counters and histograms are added before anything is recorded, and are
+   * identified by the index returned when they are added. Each thread that
+   * records is given its own block of values the first time it records, and
+   * only ever writes to that block, so recording takes no locks and never
+   * contends with other threads. render() sums the blocks of every thread
+   * that has recorded. When a thread exits its values are folded into a
+   * retired total and its block is freed, so threads may come and go
+   * without the registry growing. Gauges are functions evaluated by
+   * render().
+   *
+   * Metrics with the same name must be added one after another with the
+   * same type and help text, and are told apart by their labels, given
+   * in the Prometheus form, e.g. type="in_message".
+   */
+  class metrics_registry {
+  public:
+    using duration = std::chrono::nanoseconds;
+
+    /// Returns the default histogram bucket upper bounds, in seconds.
+    static std::vector<double> default_buckets() {
+      return {
+          0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005,
+          0.01, 0.05, 0.1, 0.5, 1.0
+        };
+    }
+
+    /// Returns HDR style bucket upper bounds, in seconds.
+    /**
+     * The first bound is lowest, and each following power of two multiple
+     * of lowest is split into sub_buckets equal buckets, so every bucket is
+     * within a fixed relative error of its values. Buckets are added until
+     * one reaches highest.
+     */
+    static std::vector<double> log_linear_buckets(
+        double lowest,
+        double highest,
+        std::size_t sub_buckets
+      )
+    {
+      std::vector<double> bounds{ lowest };
+      for(double base = lowest; bounds.back() < highest; base *= 2) {
+        for(std::size_t i = 1; i <= sub_buckets; ++i) {
+          bounds.push_back(base + base * i / sub_buckets);
+        }
+      }
+      return bounds;
+    }
+
+    metrics_registry() : m_id(next_id()), m_slot_count(0),
+      m_is_frozen(false), m_blocks(std::make_shared<block_list>()) {}
+
+    metrics_registry(const metrics_registry&) = delete;
+    metrics_registry& operator=(const metrics_registry&) = delete;
+
+    /// Adds a counter and returns its index for increment().
+    std::size_t add_counter(
+        const std::string& name,
+        const std::string& help,
+        const std::string& labels = std::string{}
+      )
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      check_unfrozen();
+      std::size_t index = m_slot_count++;
+      m_metrics.push_back(metric{counter, name, help, labels, index, {}});
+      return index;
+    }
+
+    /// Adds a histogram and returns its index for observe().
+    /**
+     * The bounds are the upper bounds of the buckets in seconds, in
+     * increasing order, and exclude the implicit +Inf bucket.
+     */
+    std::size_t add_histogram(
+        const std::string& name,
+        const std::string& help,
+        const std::vector<double>& bounds = default_buckets(),
+        const std::string& labels = std::string{}
+      )
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      check_unfrozen();
+
+      histogram h;
+      h.offset = m_slot_count;
+      for(double bound : bounds) {
+        h.bounds.push_back(bound);
+        h.bounds_ns.push_back(std::llround(bound * 1e9));
+      }
+      // a slot for each bucket, the +Inf bucket, and the sum
+      m_slot_count += bounds.size() + 2;
+
+      std::size_t index = m_histograms.size();
+      m_histograms.push_back(std::move(h));
+      m_metrics.push_back(metric{histogram_type, name, help, labels, index, {}});
+      return index;
+    }
+
+    /// Adds a gauge whose value is read by calling f on each render().
+    void add_gauge(
+        const std::string& name,
+        const std::string& help,
+        std::function<double()> f,
+        const std::string& labels = std::string{}
+      )
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_metrics.push_back(metric{gauge, name, help, labels, 0, std::move(f)});
+    }
+
+    /// Adds n to the counter with the given index.
+    void increment(std::size_t counter, std::uint64_t n = 1) {
+      add(get_block().slots[counter], n);
+    }
+
+    /// Records a duration in the histogram with the given index.
+    void observe(std::size_t index, duration d) {
+      const histogram& h = m_histograms[index];
+      const std::int64_t ns = d.count();
+
+      // the first bucket whose bound is at least ns
+      const std::size_t bucket = std::lower_bound(
+          h.bounds_ns.begin(), h.bounds_ns.end(), ns
+        ) - h.bounds_ns.begin();
+
+      std::atomic<std::uint64_t>* slots = get_block().slots.get() + h.offset;
+      add(slots[bucket], 1);
+      add(slots[h.bounds.size() + 1], ns > 0 ? ns : 0);
+    }
+
+    /// Returns the number of running threads that have recorded values.
+    std::size_t thread_count() {
+      std::lock_guard<std::mutex> guard(m_blocks->lock);
+      return m_blocks->blocks.size();
+    }
+
+    /// Returns every metric in the Prometheus text exposition format.
+    std::string render() {
+      std::lock_guard<std::mutex> guard(m_lock);
+
+      std::vector<std::uint64_t> totals(m_slot_count, 0);
+      {
+        std::lock_guard<std::mutex> blocks_guard(m_blocks->lock);
+        if(!m_blocks->retired.empty()) {
+          totals = m_blocks->retired;
+        }
+        for(const std::unique_ptr<thread_block>& block : m_blocks->blocks) {
+          for(std::size_t i = 0; i < m_slot_count; ++i) {
+            totals[i] += block->slots[i].load(std::memory_order_relaxed);
+          }
+        }
+      }
+
+      std::string out;
+      std::set<std::string> described;
+      for(const metric& m : m_metrics) {
+        if(described.insert(m.name).second) {
+          out += "# HELP " + m.name + " " + m.help + "\n";
+          out += "# TYPE " + m.name + " " + type_name(m.type) + "\n";
+        }
+
+        if(m.type == counter) {
+          out += m.name + braces(m.labels) + " "
+            + std::to_string(totals[m.index]) + "\n";
+        } else if(m.type == gauge) {
+          out += m.name + braces(m.labels) + " "
+            + format_double(m.value()) + "\n";
+        } else {
+          const histogram& h = m_histograms[m.index];
+          const std::string prefix = m.labels.empty() ? m.labels
+            : m.labels + ",";
+
+          std::uint64_t count = 0;
+          for(std::size_t i = 0; i <= h.bounds.size(); ++i) {
+            count += totals[h.offset + i];
+            const std::string le = i < h.bounds.size()
+              ? format_double(h.bounds[i]) : std::string{"+Inf"};
+            out += m.name + "_bucket{" + prefix + "le=\"" + le + "\"} "
+              + std::to_string(count) + "\n";
+          }
+
+          const double sum = totals[h.offset + h.bounds.size() + 1] / 1e9;
+          out += m.name + "_sum" + braces(m.labels) + " "
+            + format_double(sum) + "\n";
+          out += m.name + "_count" + braces(m.labels) + " "
+            + std::to_string(count) + "\n";
+        }
+      }
+
+      return out;
+    }
+
+  private:
+    enum metric_type {
+      counter,
+      gauge,
+      histogram_type
+    };
+
+    struct metric {
+      metric_type type;
+      std::string name;
+      std::string help;
+      std::string labels;
+      // the slot of a counter, or the index of a histogram
+      std::size_t index;
+      std::function<double()> value;
+    };
+
+    struct histogram {
+      std::size_t offset;
+      std::vector<double> bounds;
+      std::vector<std::int64_t> bounds_ns;
+    };
+
+    // the values recorded by one thread
+    struct thread_block {
+      explicit thread_block(std::size_t n)
+        : slots(new std::atomic<std::uint64_t>[n]()) {}
+
+      std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+    };
+
+    // the blocks of the running threads, and the values of exited threads;
+    // shared with those threads so an exiting thread can retire its block
+    // even if the registry is being destroyed
+    struct block_list {
+      // folds the values of an exiting thread into the retired totals
+      void retire(thread_block* block) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = std::find_if(blocks.begin(), blocks.end(),
+          [block](const std::unique_ptr<thread_block>& b){
+            return b.get() == block;
+          });
+        if(it == blocks.end()) {
+          return;
+        }
+
+        for(std::size_t i = 0; i < retired.size(); ++i) {
+          retired[i] += block->slots[i].load(std::memory_order_relaxed);
+        }
+        std::swap(*it, blocks.back());
+        blocks.pop_back();
+      }
+
+      std::vector<std::unique_ptr<thread_block> > blocks;
+      std::vector<std::uint64_t> retired;
+      std::mutex lock;
+    };
+
+    // the blocks a thread holds, retired when the thread exits
+    struct thread_blocks {
+      struct entry {
+        std::size_t id;
+        std::weak_ptr<block_list> list;
+        thread_block* block;
+      };
+
+      ~thread_blocks() {
+        for(entry& e : entries) {
+          if(std::shared_ptr<block_list> list = e.list.lock()) {
+            list->retire(e.block);
+          }
+        }
+      }
+
+      std::vector<entry> entries;
+    };
+
+    // registry ids are never reused, so a thread never mistakes the block of
+    // a destroyed registry for one of a new registry at the same address
+    static std::size_t next_id() {
+      static std::atomic<std::size_t> id{0};
+      return ++id;
+    }
+
+    // only the owning thread writes a slot, so no read-modify-write is needed
+    static void add(std::atomic<std::uint64_t>& slot, std::uint64_t n) {
+      slot.store(
+          slot.load(std::memory_order_relaxed) + n,
+          std::memory_order_relaxed
+        );
+    }
+
+    // returns the calling thread's block, creating it on first use
+    thread_block& get_block() {
+      thread_local thread_blocks owned;
+      for(const thread_blocks::entry& e : owned.entries) {
+        if(e.id == m_id) {
+          return *e.block;
+        }
+      }
+
+      // forget the blocks of registries destroyed since
+      owned.entries.erase(
+          std::remove_if(owned.entries.begin(), owned.entries.end(),
+            [](const thread_blocks::entry& e){ return e.list.expired(); }),
+          owned.entries.end()
+        );
+
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_is_frozen = true;
+      std::lock_guard<std::mutex> blocks_guard(m_blocks->lock);
+      m_blocks->retired.resize(m_slot_count, 0);
+      m_blocks->blocks.push_back(std::make_unique<thread_block>(m_slot_count));
+      thread_block* block = m_blocks->blocks.back().get();
+      owned.entries.push_back(thread_blocks::entry{m_id, m_blocks, block});
+      return *block;
+    }
+
+    // assumes that m_lock is acquired
+    void check_unfrozen() const {
+      if(m_is_frozen) {
+        throw std::logic_error{"metric added after recording started"};
+      }
+    }
+
+    static const char* type_name(metric_type type) {
+      if(type == counter) {
+        return "counter";
+      } else if(type == gauge) {
+        return "gauge";
+      }
+      return "histogram";
+    }
+
+    static std::string braces(const std::string& labels) {
+      return labels.empty() ? labels : "{" + labels + "}";
+    }
+
+    static std::string format_double(double v) {
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%.9g", v);
+      return std::string{buffer};
+    }
+
+    const std::size_t m_id;
+
+    std::vector<metric> m_metrics;
+    std::vector<histogram> m_histograms;
+    std::size_t m_slot_count;
+
+    // m_lock guards the metric definitions and m_is_frozen, which is set
+    // once any thread records; the blocks are only read under the lock of
+    // m_blocks, and are written without it by their own threads
+    bool m_is_frozen;
+    std::shared_ptr<block_list> m_blocks;
+    std::mutex m_lock;
+  };
+}
+
+#endif // JWT_GAME_SERVER_METRICS_HPP
@@ -0,0 +1,459 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_MULTIPLEX_CLIENT_HPP
+#define JWT_GAME_SERVER_MULTIPLEX_CLIENT_HPP
+
+#include "message_batch.hpp"
+
+#include <websocketpp/client.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+
+#include <exception>
+
+namespace simple_web_game_server {
+  // websocketpp types
+  using websocketpp::connection_hdl;
+  namespace opcode = websocketpp::frame::opcode;
+
+  // threading type implementations
+  using std::atomic;
+  using std::mutex;
+  using std::lock_guard;
+
+  /// A WebSocket client that runs many base_server connections at once.
+  /**
+   * Unlike client, which blocks a thread for its one connection, every
+   * connection of a multiplex_client is driven by one asio io_context,
+   * either its own, run by any number of threads calling run(), or one
+   * supplied on construction and run by its owner. Each connection has its
+   * own handlers and JWT, connect() returns without waiting for the
+   * connection to open, and shutdown() closes every connection so the
+   * io_context runs out of work.
+   *
+   * Handlers are called on the threads running the io_context, and the
+   * handlers of one connection are never called concurrently.
+   */
+  template<typename client_config>
+  class multiplex_client {
+  // type definitions
+  private:
+    using ws_client = websocketpp::client<client_config>;
+    using connection_ptr = typename ws_client::connection_ptr;
+    using message_ptr = typename ws_client::message_ptr;
+
+  public:
+    /// The asio io_context type driving the connections.
+    using io_context = typename std::remove_pointer<
+        typename ws_client::transport_type::io_service_ptr
+      >::type;
+
+    /// Identifies a connection of this client.
+    using connection_id = std::size_t;
+
+    /// The class representing errors with the client.
+    class client_error : public std::runtime_error {
+    public:
+      using super = std::runtime_error;
+      explicit client_error(const std::string& what_arg) noexcept :
+        super(what_arg) {}
+      explicit client_error(const char* what_arg) noexcept : super(what_arg) {}
+    };
+
+    /// The handlers of a connection, any of which may be left empty.
+    /**
+     * Each is passed the id of the connection, which may be called before
+     * connect() has returned it, so one set of handlers may serve many
+     * connections.
+     */
+    struct handlers {
+      /// Called once the connection opens and its JWT has been sent.
+      std::function<void(connection_id)> open;
+      /// Called when an open connection closes.
+      std::function<void(connection_id)> close;
+      /// Called if the connection fails to open.
+      std::function<void(connection_id)> fail;
+      /// Called for text messages, and binary ones if binary_message is empty.
+      std::function<void(connection_id, const std::string&)> message;
+      /// Called for binary messages.
+      std::function<void(connection_id, const std::string&)> binary_message;
+    };
+
+  // main class body
+  public:
+    /// Constructs the client with its own io_context, driven by run().
+    multiplex_client() : m_next_id(1), m_is_stopping(false) {
+      m_client.init_asio();
+      m_client.start_perpetual();
+    }
+
+    /// Constructs the client on an io_context run by the caller.
+    /**
+     * The io_context must outlive the client, and keeps running until
+     * shutdown() is called and every connection has closed.
+     */
+    explicit multiplex_client(io_context& ios)
+      : m_next_id(1), m_is_stopping(false)
+    {
+      m_client.init_asio(&ios);
+      m_client.start_perpetual();
+    }
+
+    multiplex_client(const multiplex_client&) = delete;
+    multiplex_client& operator=(const multiplex_client&) = delete;
+
+    /// Starts connecting to the server at uri and returns the connection id.
+    /**
+     * Returns immediately; once the connection opens the jwt is sent and
+     * h.open is called, or h.fail is called if it could not open. Throws
+     * client_error if the uri is invalid or the client is shutting down.
+     */
+    connection_id connect(
+        const std::string& uri,
+        const std::string& jwt,
+        handlers h
+      )
+    {
+      if(m_is_stopping) {
+        throw client_error{"connect called on stopping client"};
+      }
+
+      websocketpp::lib::error_code ec;
+      connection_ptr con = m_client.get_connection(uri, ec);
+      if(ec) {
+        throw client_error{"invalid uri " + uri + ": " + ec.message()};
+      }
+
+      const connection_id id = m_next_id++;
+      auto h_ptr = std::make_shared<connection_handlers>(std::move(h));
+
+      for(const std::string& protocol : m_subprotocols) {
+        con->add_subprotocol(protocol);
+      }
+      con->set_open_handler([this, id, jwt, h_ptr](connection_hdl hdl){
+          on_open(id, jwt, *h_ptr);
+        });
+      con->set_close_handler([this, id, h_ptr](connection_hdl hdl){
+          on_close(id, *h_ptr);
+        });
+      con->set_fail_handler([this, id, h_ptr](connection_hdl hdl){
+          on_fail(id, *h_ptr);
+        });
+      con->set_message_handler(
+          [this, id, h_ptr](connection_hdl hdl, message_ptr msg){
+            on_message(id, *h_ptr, msg);
+          }
+        );
+
+      {
+        lock_guard<mutex> guard(m_connection_lock);
+        m_connections.emplace(id, entry{con, false});
+      }
+
+      m_client.connect(con);
+      return id;
+    }
+
+    /// Runs the client's own io_context until shutdown() completes.
+    /**
+     * May be called from several threads to drive the connections with a
+     * thread pool. Not used when the client was given an io_context.
+     */
+    void run() {
+      m_client.run();
+    }
+
+    /// Closes every connection and stops accepting new ones.
+    /**
+     * Connections still opening are closed as soon as they open. Once every
+     * connection has closed, the io_context has no work left from this
+     * client, so run() returns.
+     */
+    void shutdown() {
+      m_is_stopping = true;
+      m_client.stop_perpetual();
+
+      std::vector<connection_ptr> open_connections;
+      {
+        lock_guard<mutex> guard(m_connection_lock);
+        for(const auto& c : m_connections) {
+          if(c.second.is_open) {
+            open_connections.push_back(c.second.con);
+          }
+        }
+      }
+
+      for(const connection_ptr& con : open_connections) {
+        close(con);
+      }
+    }
+
+    /// Returns whether shutdown() has been called.
+    bool is_stopping() const {
+      return m_is_stopping;
+    }
+
+    /// Returns whether the connection with the given id is open.
+    bool is_open(connection_id id) {
+      lock_guard<mutex> guard(m_connection_lock);
+      auto it = m_connections.find(id);
+      return (it != m_connections.end()) && it->second.is_open;
+    }
+
+    /// Returns the number of connections opening or open.
+    std::size_t connection_count() {
+      lock_guard<mutex> guard(m_connection_lock);
+      return m_connections.size();
+    }
+
+    /// Sends the given string on the connection with the given id.
+    /**
+     * The string is sent as a text frame unless op is opcode::binary.
+     * Throws client_error if the connection is not open.
+     */
+    void send(
+        connection_id id,
+        const std::string& msg,
+        opcode::value op = opcode::text
+      )
+    {
+      connection_ptr con = get_open_connection(id);
+      if(!con) {
+        throw client_error{
+            "send called on connection " + std::to_string(id)
+              + " which is not open"
+          };
+      }
+
+      websocketpp::lib::error_code ec = con->send(msg, op);
+      if(ec) {
+        spdlog::error("error sending client message \"{}\": {}", msg,
+          ec.message());
+      }
+    }
+
+    /// Sends the given bytes on the given connection as a binary frame.
+    void send_binary(connection_id id, const std::string& data) {
+      send(id, data, opcode::binary);
+    }
+
+    /// Closes the connection with the given id.
+    /**
+     * Throws client_error if the connection is not open.
+     */
+    void disconnect(connection_id id) {
+      connection_ptr con = get_open_connection(id);
+      if(!con) {
+        throw client_error{
+            "disconnect called on connection " + std::to_string(id)
+              + " which is not open"
+          };
+      }
+      close(con);
+    }
+
+    /// Sets the WebSocket subprotocols to request, in order of preference.
+    /**
+     * Applies to connections started after the call.
+     */
+    void set_subprotocols(const std::vector<std::string>& protocols) {
+      m_subprotocols = protocols;
+    }
+
+    /// Returns the subprotocol the server selected for the given connection.
+    std::string get_subprotocol(connection_id id) {
+      connection_ptr con = get_open_connection(id);
+      if(con) {
+        // websocketpp only records the subprotocol on server connections
+        return con->get_response_header("Sec-WebSocket-Protocol");
+      }
+      return std::string{};
+    }
+
+  private:
+    struct entry {
+      connection_ptr con;
+      bool is_open;
+    };
+
+    // the handlers of a connection, and whether the server bundles
+    // messages to it, see message_batch
+    struct connection_handlers : handlers {
+      explicit connection_handlers(handlers&& h) : handlers(std::move(h)),
+        is_batched(false) {}
+
+      bool is_batched;
+    };
+
+    connection_ptr get_open_connection(connection_id id) {
+      lock_guard<mutex> guard(m_connection_lock);
+      auto it = m_connections.find(id);
+      if(it == m_connections.end() || !it->second.is_open) {
+        return connection_ptr{};
+      }
+      return it->second.con;
+    }
+
+    void close(const connection_ptr& con) {
+      websocketpp::lib::error_code ec;
+      con->close(
+          websocketpp::close::status::normal,
+          "client closed connection",
+          ec
+        );
+      if(ec) {
+        spdlog::debug("error closing client connection: {}", ec.message());
+      }
+    }
+
+    void on_open(
+        connection_id id,
+        const std::string& jwt,
+        connection_handlers& h
+      )
+    {
+      spdlog::trace("client connection {} opened", id);
+
+      connection_ptr con;
+      {
+        lock_guard<mutex> guard(m_connection_lock);
+        entry& e = m_connections.at(id);
+        e.is_open = true;
+        con = e.con;
+      }
+
+      if(m_is_stopping) {
+        close(con);
+        return;
+      }
+
+      h.is_batched = !con->get_response_header(
+          message_batch::handshake_header()
+        ).empty();
+      websocketpp::lib::error_code ec = con->send(jwt, opcode::text);
+      if(ec) {
+        spdlog::error("error sending client JWT: {}", ec.message());
+      }
+
+      if(h.open) {
+        try {
+          h.open(id);
+        } catch(std::exception& e) {
+          spdlog::error("error in open handler: {}", e.what());
+        }
+      }
+    }
+
+    void on_close(connection_id id, handlers& h) {
+      spdlog::trace("client connection {} closed", id);
+      {
+        lock_guard<mutex> guard(m_connection_lock);
+        m_connections.erase(id);
+      }
+
+      if(h.close) {
+        try {
+          h.close(id);
+        } catch(std::exception& e) {
+          spdlog::error("error in close handler: {}", e.what());
+        }
+      }
+    }
+
+    void on_fail(connection_id id, handlers& h) {
+      spdlog::debug("client connection {} failed", id);
+      {
+        lock_guard<mutex> guard(m_connection_lock);
+        m_connections.erase(id);
+      }
+
+      if(h.fail) {
+        try {
+          h.fail(id);
+        } catch(std::exception& e) {
+          spdlog::error("error in fail handler: {}", e.what());
+        }
+      }
+    }
+
+    void on_message(
+        connection_id id,
+        connection_handlers& h,
+        message_ptr msg
+      )
+    {
+      spdlog::trace("client received message: {}", msg->get_payload());
+      if(h.is_batched && msg->get_opcode() == opcode::binary) {
+        bool is_valid = message_batch::unpack(msg->get_payload(),
+          [id, &h](const std::string& payload, opcode::value op){
+            handle_message(id, h, payload, op);
+          });
+        if(!is_valid) {
+          spdlog::error("client connection {} received a malformed message "
+            "bundle", id);
+        }
+      } else {
+        handle_message(id, h, msg->get_payload(), msg->get_opcode());
+      }
+    }
+
+    static void handle_message(
+        connection_id id,
+        handlers& h,
+        const std::string& payload,
+        opcode::value op
+      )
+    {
+      try {
+        if(op == opcode::binary && h.binary_message) {
+          h.binary_message(id, payload);
+        } else if(h.message) {
+          h.message(id, payload);
+        }
+      } catch(std::exception& e) {
+        spdlog::error("error in message handler: {}", e.what());
+      }
+    }
+
+    // member variables
+    ws_client m_client;
+    std::atomic<connection_id> m_next_id;
+    atomic<bool> m_is_stopping;
+    std::vector<std::string> m_subprotocols;
+
+    std::unordered_map<connection_id, entry> m_connections;
+    mutex m_connection_lock;
+  };
+}
+
+#endif // JWT_GAME_SERVER_MULTIPLEX_CLIENT_HPP
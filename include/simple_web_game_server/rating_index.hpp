@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_RATING_INDEX_HPP
+#define JWT_GAME_SERVER_RATING_INDEX_HPP
+
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <iterator>
+#include <functional>
+
+namespace simple_web_game_server {
+  /// An ordered index of waiting sessions keyed by rating.
+  /**
+   * Sessions are kept in rating order, so inserting or erasing a session
+   * costs O(log n) and the closest rated partners of a session are its
+   * neighbors in the index.
+   *
+   * A session left unpaired by a matching pass has no neighbor within the
+   * maximum difference, and erasing sessions only widens the gaps, so it can
+   * only gain a partner when a session is inserted next to it. The index
+   * therefore remembers the sessions inserted since the last pass, and
+   * match_pairs() only examines those, so a pass costs
+   * O((inserted + matched) log n) rather than rescanning every waiting
+   * session each tick.
+   *
+   * Not thread safe; the matchmaking_server only touches the index while
+   * holding its match lock.
+   */
+  template<typename key, typename rating = int,
+    typename hash = std::hash<key> >
+  class rating_index {
+  private:
+    struct entry {
+      key k;
+      bool pending;
+    };
+
+    using entry_map = std::multimap<rating, entry>;
+    using iterator = typename entry_map::iterator;
+
+  public:
+    rating_index() : m_max_difference{}, m_has_matched(false) {}
+
+    /// Inserts a session, or moves an existing session to a new rating.
+    void insert(const key& k, const rating& r) {
+      erase(k);
+      iterator it = m_entries.emplace(r, entry{ k, true });
+      m_keys.emplace(k, it);
+      m_pending.push_back(k);
+    }
+
+    /// Removes a session if present, returning true if it was removed.
+    bool erase(const key& k) {
+      auto key_it = m_keys.find(k);
+      if(key_it == m_keys.end()) {
+        return false;
+      }
+
+      m_entries.erase(key_it->second);
+      m_keys.erase(key_it);
+      return true;
+    }
+
+    /// Returns true if the session is in the index.
+    bool contains(const key& k) const {
+      return m_keys.count(k) > 0;
+    }
+
+    /// Returns the number of sessions in the index.
+    std::size_t size() const {
+      return m_keys.size();
+    }
+
+    /// Returns true if the index holds no sessions.
+    bool empty() const {
+      return m_keys.empty();
+    }
+
+    /// Removes all sessions.
+    void clear() {
+      m_entries.clear();
+      m_keys.clear();
+      m_pending.clear();
+      m_has_matched = false;
+    }
+
+    /// Pairs newly inserted sessions with their closest rated neighbor.
+    /**
+     * Each session inserted since the last pass is paired with whichever
+     * adjacent session is closest in rating, so long as the difference is at
+     * most max_difference. Both sessions of a pair are erased from the index
+     * before f(a, b) is called. Returns the number of pairs made.
+     *
+     * If max_difference is larger than in the previous pass, every session
+     * is examined again, costing O(n log n) for that pass.
+     */
+    template<typename function>
+    std::size_t match_pairs(const rating& max_difference, function&& f) {
+      if(m_has_matched && m_max_difference < max_difference) {
+        for(iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+          if(!it->second.pending) {
+            it->second.pending = true;
+            m_pending.push_back(it->second.k);
+          }
+        }
+      }
+      m_max_difference = max_difference;
+      m_has_matched = true;
+
+      std::size_t matched = 0;
+      for(std::size_t i = 0; i < m_pending.size(); ++i) {
+        auto key_it = m_keys.find(m_pending[i]);
+        if(key_it == m_keys.end() || !key_it->second->second.pending) {
+          continue;
+        }
+
+        iterator it = key_it->second;
+        it->second.pending = false;
+
+        iterator best = m_entries.end();
+        rating best_difference{};
+        if(it != m_entries.begin()) {
+          iterator prev = std::prev(it);
+          rating difference = it->first - prev->first;
+          if(!(max_difference < difference)) {
+            best = prev;
+            best_difference = difference;
+          }
+        }
+
+        iterator next = std::next(it);
+        if(next != m_entries.end()) {
+          rating difference = next->first - it->first;
+          if(!(max_difference < difference)
+              && (best == m_entries.end() || difference < best_difference)) {
+            best = next;
+          }
+        }
+
+        if(best != m_entries.end()) {
+          key a = it->second.k;
+          key b = best->second.k;
+          erase(a);
+          erase(b);
+          f(a, b);
+          ++matched;
+        }
+      }
+      m_pending.clear();
+
+      return matched;
+    }
+
+  private:
+    entry_map m_entries;
+    std::unordered_map<key, iterator, hash> m_keys;
+    // keys inserted since the last pass; stale keys are skipped
+    std::vector<key> m_pending;
+    rating m_max_difference;
+    bool m_has_matched;
+  };
+}
+
+#endif // JWT_GAME_SERVER_RATING_INDEX_HPP
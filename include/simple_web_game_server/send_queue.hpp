@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_SEND_QUEUE_HPP
+#define JWT_GAME_SERVER_SEND_QUEUE_HPP
+
+#include <websocketpp/frame.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <cstddef>
+#include <string>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+#include <mutex>
+
+namespace simple_web_game_server {
+  /// A bounded queue of outgoing messages that applies backpressure.
+  /**
+   * Messages are pushed by producers and handed to a connection by flush(),
+   * which stops while the connection has more than a high-water mark of
+   * bytes buffered, so a slow connection fills this queue rather than
+   * growing the connection's write buffer without bound. Once the queue
+   * holds limit() messages, pushes are refused and the producer is expected
+   * to throttle. A message pushed with push_latest() removes any queued
+   * message with the same key, so superseded state is never sent.
+   *
+   * Each message may carry a handler called with true once the message is
+   * handed to the connection, or with false if the connection refuses it or
+   * it is superseded or cleared.
+   * Handlers are called without the queue's lock held.
+   *
+   * All member functions are thread safe.
+   */
+  class send_queue {
+  public:
+    using opcode_value = websocketpp::frame::opcode::value;
+    using sent_handler = std::function<void(bool)>;
+
+    /// The outcome of pushing a message.
+    enum class push_result {
+      /// The message was added to the back of the queue.
+      queued,
+      /// The message superseded a queued message with the same key.
+      coalesced,
+      /// The queue was full and the message was not added.
+      full
+    };
+
+    /// The state of the queue after a flush.
+    enum class flush_result {
+      /// Messages remain, held back by the high-water mark.
+      blocked,
+      /// The queue is empty, and nothing was held back or refused since the
+      /// last time it emptied.
+      empty,
+      /// The queue emptied after messages were held back or refused, so
+      /// producers waiting on backpressure may resume.
+      drained
+    };
+
+    /// Constructs an empty queue holding at most limit messages.
+    explicit send_queue(std::size_t limit = 1024) : m_limit(limit),
+      m_bytes(0), m_has_backpressure(false) {}
+
+    /// Sets the maximum number of queued messages.
+    /**
+     * Messages already queued beyond a lowered limit are kept.
+     */
+    void set_limit(std::size_t limit) {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_limit = limit;
+    }
+
+    /// Returns the maximum number of queued messages.
+    std::size_t limit() const {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_limit;
+    }
+
+    /// Returns the number of queued messages.
+    std::size_t size() const {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_messages.size();
+    }
+
+    /// Returns the total payload bytes of the queued messages.
+    std::size_t bytes() const {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_bytes;
+    }
+
+    /// Adds a message to the back of the queue unless it is full.
+    push_result push(
+        std::string payload,
+        opcode_value op,
+        sent_handler on_sent = nullptr
+      )
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      if(m_messages.size() >= m_limit) {
+        m_has_backpressure = true;
+        return push_result::full;
+      }
+
+      m_bytes += payload.size();
+      m_messages.push_back(
+          message{std::string{}, std::move(payload), op, std::move(on_sent)}
+        );
+      return push_result::queued;
+    }
+
+    /// Adds a message, removing any queued message with the same key.
+    /**
+     * The new message always goes to the back of the queue, so it is never
+     * sent ahead of messages pushed before it, and the superseded message's
+     * handler is called with false. An empty key never matches, as with
+     * push().
+     */
+    push_result push_latest(
+        const std::string& key,
+        std::string payload,
+        opcode_value op,
+        sent_handler on_sent = nullptr
+      )
+    {
+      sent_handler superseded;
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        auto it = m_messages.rend();
+        if(!key.empty()) {
+          it = std::find_if(m_messages.rbegin(), m_messages.rend(),
+            [&key](const message& msg){ return msg.key == key; });
+        }
+
+        if(it == m_messages.rend()) {
+          if(m_messages.size() >= m_limit) {
+            m_has_backpressure = true;
+            return push_result::full;
+          }
+
+          m_bytes += payload.size();
+          m_messages.push_back(
+              message{key, std::move(payload), op, std::move(on_sent)}
+            );
+          return push_result::queued;
+        }
+
+        m_bytes -= it->payload.size();
+        superseded = std::move(it->on_sent);
+        m_messages.erase(std::next(it).base());
+
+        m_bytes += payload.size();
+        m_messages.push_back(
+            message{key, std::move(payload), op, std::move(on_sent)}
+          );
+      }
+
+      if(superseded) {
+        superseded(false);
+      }
+      return push_result::coalesced;
+    }
+
+    /// Hands queued messages to send while buffered() is below high_water.
+    /**
+     * Calls send(payload, op) for each message in order, checking
+     * buffered(), the bytes the connection has yet to write, before each.
+     * send returns a websocketpp::lib::error_code, and a message it fails
+     * to send is dropped and its handler called with false.
+     */
+    template<typename buffered_function, typename send_function>
+    flush_result flush(
+        std::size_t high_water,
+        buffered_function&& buffered,
+        send_function&& send
+      )
+    {
+      std::vector<std::pair<sent_handler, bool> > sent;
+      flush_result result;
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        while(!m_messages.empty() && buffered() < high_water) {
+          message& msg = m_messages.front();
+          websocketpp::lib::error_code ec = send(msg.payload, msg.op);
+          m_bytes -= msg.payload.size();
+          if(msg.on_sent) {
+            sent.emplace_back(std::move(msg.on_sent), !ec);
+          }
+          m_messages.pop_front();
+        }
+
+        if(!m_messages.empty()) {
+          m_has_backpressure = true;
+          result = flush_result::blocked;
+        } else if(m_has_backpressure) {
+          m_has_backpressure = false;
+          result = flush_result::drained;
+        } else {
+          result = flush_result::empty;
+        }
+      }
+
+      for(auto& h : sent) {
+        h.first(h.second);
+      }
+      return result;
+    }
+
+    /// Removes every queued message, calling their handlers with false.
+    void clear() {
+      std::deque<message> cleared;
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        cleared.swap(m_messages);
+        m_bytes = 0;
+        m_has_backpressure = false;
+      }
+
+      for(message& msg : cleared) {
+        if(msg.on_sent) {
+          msg.on_sent(false);
+        }
+      }
+    }
+
+  private:
+    struct message {
+      std::string key;
+      std::string payload;
+      opcode_value op;
+      sent_handler on_sent;
+    };
+
+    std::deque<message> m_messages;
+    std::size_t m_limit;
+    std::size_t m_bytes;
+    bool m_has_backpressure;
+    mutable std::mutex m_lock;
+  };
+}
+
+#endif // JWT_GAME_SERVER_SEND_QUEUE_HPP
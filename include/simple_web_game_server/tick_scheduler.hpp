@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_TICK_SCHEDULER_HPP
+#define JWT_GAME_SERVER_TICK_SCHEDULER_HPP
+
+#include <cstddef>
+#include <chrono>
+
+#include <atomic>
+
+namespace simple_web_game_server {
+  /// How a tick_scheduler recovers once it falls behind its deadlines.
+  enum class catch_up_policy {
+    /// Run one late tick reporting the real elapsed time and drop the ticks
+    /// that were missed, keeping later deadlines on the original grid.
+    skip,
+    /// Run every missed tick back to back, each reporting one timestep.
+    accumulate,
+    /// As accumulate, but drop any backlog beyond a maximum number of ticks.
+    clamp
+  };
+
+  /// A snapshot of the timing statistics of a tick_scheduler.
+  struct tick_stats {
+    /// The number of ticks run.
+    std::size_t ticks;
+    /// The number of ticks that started after the following deadline had
+    /// already passed, i.e. the loop fell at least a full timestep behind.
+    std::size_t overruns;
+    /// The number of ticks dropped by the skip or clamp policies.
+    std::size_t skipped;
+    /// The mean time between a deadline and the start of its tick.
+    std::chrono::nanoseconds mean_lateness;
+    /// The longest time between a deadline and the start of its tick.
+    std::chrono::nanoseconds max_lateness;
+  };
+
+  /// Schedules the ticks of a fixed timestep loop on a steady clock.
+  /**
+   * Deadlines are kept on a fixed grid of multiples of the timestep from the
+   * last call to start() or restart(), so time spent running ticks never
+   * causes drift. The owning loop waits until get_deadline(), e.g. with
+   * condition_variable::wait_until, and then calls tick() to obtain the time
+   * step for that tick and schedule the next deadline.
+   *
+   * Only one thread may drive the scheduler, but get_stats() may be called
+   * from any thread.
+   */
+  class tick_scheduler {
+  public:
+    /// The clock used for all deadlines.
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    tick_scheduler() : m_timestep(std::chrono::milliseconds{1}),
+      m_policy(catch_up_policy::skip), m_max_catch_up(4), m_ticks(0),
+      m_overruns(0), m_skipped(0), m_total_lateness_ns(0),
+      m_max_lateness_ns(0) {}
+
+    /// Starts a new schedule and clears the statistics.
+    /**
+     * The first deadline is one timestep after now. The max_catch_up
+     * parameter is the largest backlog of ticks kept by the clamp policy.
+     */
+    void start(
+        duration timestep,
+        catch_up_policy policy,
+        std::size_t max_catch_up,
+        time_point now = clock::now()
+      )
+    {
+      m_timestep = timestep > duration::zero() ? timestep : duration{1};
+      m_policy = policy;
+      m_max_catch_up = max_catch_up;
+
+      m_ticks = 0;
+      m_overruns = 0;
+      m_skipped = 0;
+      m_total_lateness_ns = 0;
+      m_max_lateness_ns = 0;
+
+      restart(now);
+    }
+
+    /// Restarts the grid of deadlines, e.g. after the loop has been idle.
+    void restart(time_point now = clock::now()) {
+      m_last_tick = now;
+      m_deadline = now + m_timestep;
+    }
+
+    /// Returns the deadline of the next tick.
+    time_point get_deadline() const {
+      return m_deadline;
+    }
+
+    /// Begins a tick at time now, which must not be before get_deadline().
+    /**
+     * Returns the time step the tick should simulate and schedules the next
+     * deadline according to the catch-up policy.
+     */
+    duration tick(time_point now = clock::now()) {
+      record_lateness(now - m_deadline);
+      ++m_ticks;
+
+      duration delta_time;
+      if(m_policy == catch_up_policy::skip) {
+        delta_time = now - m_last_tick;
+        m_deadline += m_timestep;
+        if(m_deadline <= now) {
+          std::size_t missed = (now - m_deadline) / m_timestep + 1;
+          m_deadline += missed * m_timestep;
+          m_skipped += missed;
+          ++m_overruns;
+        }
+      } else {
+        delta_time = m_timestep;
+        m_deadline += m_timestep;
+        if(m_deadline <= now) {
+          ++m_overruns;
+          std::size_t backlog = (now - m_deadline) / m_timestep + 1;
+          if(m_policy == catch_up_policy::clamp && backlog > m_max_catch_up) {
+            std::size_t dropped = backlog - m_max_catch_up;
+            m_deadline += dropped * m_timestep;
+            m_skipped += dropped;
+          }
+        }
+      }
+
+      m_last_tick = now;
+      return delta_time;
+    }
+
+    /// Returns the statistics since the last call to start().
+    tick_stats get_stats() const {
+      std::size_t ticks = m_ticks;
+      return tick_stats{
+          ticks,
+          m_overruns,
+          m_skipped,
+          std::chrono::nanoseconds{
+              ticks > 0 ? m_total_lateness_ns / (long long)ticks : 0
+            },
+          std::chrono::nanoseconds{m_max_lateness_ns.load()}
+        };
+    }
+
+  private:
+    void record_lateness(duration lateness) {
+      long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          lateness
+        ).count();
+      m_total_lateness_ns += ns;
+      if(ns > m_max_lateness_ns) {
+        m_max_lateness_ns = ns;
+      }
+    }
+
+    duration m_timestep;
+    catch_up_policy m_policy;
+    std::size_t m_max_catch_up;
+
+    time_point m_deadline;
+    time_point m_last_tick;
+
+    std::atomic<std::size_t> m_ticks;
+    std::atomic<std::size_t> m_overruns;
+    std::atomic<std::size_t> m_skipped;
+    std::atomic<long long> m_total_lateness_ns;
+    std::atomic<long long> m_max_lateness_ns;
+  };
+}
+
+#endif // JWT_GAME_SERVER_TICK_SCHEDULER_HPP
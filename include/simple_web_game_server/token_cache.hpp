@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_TOKEN_CACHE_HPP
+#define JWT_GAME_SERVER_TOKEN_CACHE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <chrono>
+
+#include <mutex>
+
+namespace simple_web_game_server {
+  /// A bounded least-recently-used cache of verified tokens.
+  /**
+   * Maps the full token string to the value parsed from it and the time at
+   * which the token expires. Lookups hash the token and compare it in full,
+   * so a hit is only ever returned for exactly the token that was verified.
+   * Expired entries are never returned and are evicted when found. Once the
+   * cache holds capacity() entries, inserting evicts the least recently used
+   * entry. A capacity of zero disables the cache.
+   *
+   * All member functions are thread safe.
+   */
+  template<typename value>
+  class token_cache {
+  public:
+    /// The clock whose time points, the same as jwt::date, mark expiry.
+    /**
+     * Callers pass in the current time, so entries may be checked against
+     * any JWT clock.
+     */
+    using clock = std::chrono::system_clock;
+    using time_point = clock::time_point;
+
+    /// Constructs an empty cache holding at most capacity entries.
+    explicit token_cache(std::size_t capacity = 0) : m_capacity(capacity) {}
+
+    /// Sets the maximum number of entries, evicting any in excess.
+    void set_capacity(std::size_t capacity) {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_capacity = capacity;
+      evict();
+    }
+
+    /// Returns the maximum number of entries.
+    std::size_t capacity() {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_capacity;
+    }
+
+    /// Returns the number of entries, including any that have expired.
+    std::size_t size() {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_entries.size();
+    }
+
+    /// Looks up an unexpired token, copying its value into v on a hit.
+    bool get(const std::string& token, value& v, time_point now) {
+      std::lock_guard<std::mutex> guard(m_lock);
+      auto it = m_index.find(std::string_view{token});
+      if(it == m_index.end()) {
+        return false;
+      }
+
+      if(it->second->expiry <= now) {
+        m_entries.erase(it->second);
+        m_index.erase(it);
+        return false;
+      }
+
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      v = it->second->data;
+      return true;
+    }
+
+    /// Inserts a verified token that expires at the given time.
+    void put(
+        const std::string& token,
+        const value& v,
+        time_point expiry,
+        time_point now
+      )
+    {
+      if(expiry <= now) {
+        return;
+      }
+
+      std::lock_guard<std::mutex> guard(m_lock);
+      if(m_capacity == 0) {
+        return;
+      }
+
+      auto it = m_index.find(std::string_view{token});
+      if(it != m_index.end()) {
+        it->second->data = v;
+        it->second->expiry = expiry;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+      }
+
+      m_entries.push_front(entry{ token, v, expiry });
+      // the key views the token owned by the list node, which never moves
+      m_index.emplace(std::string_view{m_entries.front().token},
+        m_entries.begin());
+      evict();
+    }
+
+    /// Removes all entries.
+    void clear() {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_index.clear();
+      m_entries.clear();
+    }
+
+  private:
+    struct entry {
+      std::string token;
+      value data;
+      time_point expiry;
+    };
+
+    // assumes that m_lock is acquired
+    void evict() {
+      while(m_entries.size() > m_capacity) {
+        m_index.erase(std::string_view{m_entries.back().token});
+        m_entries.pop_back();
+      }
+    }
+
+    // most recently used entries are kept at the front
+    std::list<entry> m_entries;
+    std::unordered_map<std::string_view, typename std::list<entry>::iterator>
+      m_index;
+    std::size_t m_capacity;
+    std::mutex m_lock;
+  };
+}
+
+#endif // JWT_GAME_SERVER_TOKEN_CACHE_HPP
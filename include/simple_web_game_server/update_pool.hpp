@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2020 Daniel Aven Bross
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JWT_GAME_SERVER_UPDATE_POOL_HPP
+#define JWT_GAME_SERVER_UPDATE_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef __linux__
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+namespace simple_web_game_server {
+  /// A fork-join thread pool that runs a function over a range of indices.
+  /**
+   * Each call to run() splits the range [0, n) into one contiguous block per
+   * thread. A thread works through its own block from the front, and once
+   * it is empty steals half of the remainder of another thread's block from
+   * the back, so uneven work is balanced without a shared queue. Each block
+   * is a single atomic word holding its begin and end indices, and owners
+   * and thieves both claim indices with compare-and-swap.
+   *
+   * The thread calling run() takes part in the work, so a pool started with
+   * a thread count of one runs everything on the calling thread. Only one
+   * thread may call run() at a time.
+   */
+  class update_pool {
+  private:
+    // a block of indices [begin, end) packed as (begin << 32) | end
+    struct alignas(64) block {
+      std::atomic<std::uint64_t> range{0};
+    };
+
+    static std::uint64_t pack(std::uint64_t begin, std::uint64_t end) {
+      return (begin << 32) | end;
+    }
+
+    static std::uint64_t get_begin(std::uint64_t range) {
+      return range >> 32;
+    }
+
+    static std::uint64_t get_end(std::uint64_t range) {
+      return range & 0xffffffffULL;
+    }
+
+  public:
+    update_pool() : m_thread_count(1), m_is_running(false), m_generation(0),
+      m_active(0), m_call(nullptr), m_context(nullptr) {}
+
+    ~update_pool() {
+      stop();
+    }
+
+    update_pool(const update_pool&) = delete;
+    update_pool& operator=(const update_pool&) = delete;
+
+    /// Starts thread_count - 1 worker threads to assist the calling thread.
+    /**
+     * A thread_count of zero uses one thread per hardware thread. If
+     * pin_threads is true, each worker is pinned to its own CPU where
+     * supported (currently Linux only).
+     */
+    void start(std::size_t thread_count, bool pin_threads) {
+      stop();
+
+      if(thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+      }
+      m_thread_count = thread_count;
+      m_blocks.reset(new block[thread_count]);
+      m_is_running = true;
+
+      for(std::size_t i = 1; i < thread_count; ++i) {
+        m_threads.emplace_back(&update_pool::work, this, i);
+        if(pin_threads) {
+          pin_thread(m_threads.back(), i);
+        }
+      }
+    }
+
+    /// Stops and joins all worker threads.
+    void stop() {
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_is_running = false;
+      }
+      m_start_condition.notify_all();
+
+      for(std::thread& t : m_threads) {
+        t.join();
+      }
+      m_threads.clear();
+      m_thread_count = 1;
+    }
+
+    /// Returns the number of threads, including the caller, used by run().
+    std::size_t thread_count() const {
+      return m_thread_count;
+    }
+
+    /// Calls f(i) for each i in [0, n), returning once every call is done.
+    /**
+     * The calls are spread over all threads of the pool, so f must be safe to
+     * call concurrently for distinct indices.
+     */
+    template<typename function>
+    void run(std::size_t n, function& f) {
+      if(n == 0) {
+        return;
+      }
+
+      if(m_threads.empty() || n == 1) {
+        for(std::size_t i = 0; i < n; ++i) {
+          f(i);
+        }
+        return;
+      }
+
+      // split the indices into one contiguous block per thread
+      const std::size_t count = m_thread_count;
+      for(std::size_t t = 0; t < count; ++t) {
+        m_blocks[t].range.store(
+            pack(n * t / count, n * (t + 1) / count),
+            std::memory_order_relaxed
+          );
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_call = [](void* context, std::size_t i){
+            (*static_cast<function*>(context))(i);
+          };
+        m_context = &f;
+        m_active = count - 1;
+        ++m_generation;
+      }
+      m_start_condition.notify_all();
+
+      process(0);
+
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_done_condition.wait(lock, [this](){ return m_active == 0; });
+    }
+
+  private:
+    static void pin_thread(std::thread& t, std::size_t i) {
+      #ifdef __linux__
+        unsigned int cpu_count = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(i % cpu_count, &cpus);
+        pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &cpus);
+      #else
+        (void)t;
+        (void)i;
+      #endif
+    }
+
+    void work(std::size_t id) {
+      std::size_t generation = 0;
+      while(true) {
+        {
+          std::unique_lock<std::mutex> lock(m_lock);
+          m_start_condition.wait(lock, [&](){
+              return !m_is_running || m_generation != generation;
+            });
+          if(!m_is_running) {
+            return;
+          }
+          generation = m_generation;
+        }
+
+        process(id);
+
+        {
+          std::lock_guard<std::mutex> guard(m_lock);
+          --m_active;
+        }
+        m_done_condition.notify_one();
+      }
+    }
+
+    // runs indices from the thread's own block, then steals until no work
+    // remains anywhere
+    void process(std::size_t id) {
+      std::size_t begin, end;
+      while(take(id, begin, end) || steal(id, begin, end)) {
+        for(std::size_t i = begin; i < end; ++i) {
+          m_call(m_context, i);
+        }
+      }
+    }
+
+    // claims a batch from the front of the thread's own block
+    bool take(std::size_t id, std::size_t& begin, std::size_t& end) {
+      std::atomic<std::uint64_t>& range = m_blocks[id].range;
+      std::uint64_t r = range.load(std::memory_order_acquire);
+      while(get_begin(r) < get_end(r)) {
+        std::uint64_t b = get_begin(r);
+        std::uint64_t e = get_end(r);
+        std::uint64_t batch = std::max<std::uint64_t>(1, (e - b) / 8);
+        if(range.compare_exchange_weak(r, pack(b + batch, e),
+            std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+          begin = b;
+          end = b + batch;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // moves half of another thread's remaining block into this thread's
+    // block, then claims a batch from it
+    bool steal(std::size_t id, std::size_t& begin, std::size_t& end) {
+      const std::size_t count = m_thread_count;
+      for(std::size_t k = 1; k < count; ++k) {
+        std::atomic<std::uint64_t>& victim = m_blocks[(id + k) % count].range;
+        std::uint64_t r = victim.load(std::memory_order_acquire);
+        while(get_begin(r) < get_end(r)) {
+          std::uint64_t b = get_begin(r);
+          std::uint64_t e = get_end(r);
+          std::uint64_t mid = b + (e - b) / 2;
+          if(victim.compare_exchange_weak(r, pack(b, mid),
+              std::memory_order_acq_rel, std::memory_order_acquire))
+          {
+            m_blocks[id].range.store(pack(mid, e), std::memory_order_release);
+            return take(id, begin, end);
+          }
+        }
+      }
+      return false;
+    }
+
+    std::size_t m_thread_count;
+    std::unique_ptr<block[]> m_blocks;
+    std::vector<std::thread> m_threads;
+
+    // m_lock guards the members below, which describe the current job
+    std::mutex m_lock;
+    std::condition_variable m_start_condition;
+    std::condition_variable m_done_condition;
+    bool m_is_running;
+    std::size_t m_generation;
+    std::size_t m_active;
+    void (*m_call)(void*, std::size_t);
+    void* m_context;
+  };
+}
+
+#endif // JWT_GAME_SERVER_UPDATE_POOL_HPP
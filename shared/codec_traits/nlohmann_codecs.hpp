@@ -0,0 +1,67 @@
+#ifndef NLOHMANN_CODECS_HPP
+#define NLOHMANN_CODECS_HPP
+
+#include <nlohmann/json.hpp>
+
+#include <string>
+
+// message codecs for game_server using the nlohmann json library; each codec
+// is named by the WebSocket subprotocol a client requests to use it
+
+// plain JSON sent in text frames
+struct nlohmann_json_codec {
+  using value_type = nlohmann::json;
+
+  static constexpr bool is_binary = false;
+
+  static const char* subprotocol() { return "json"; }
+
+  static bool decode(value_type &val, const std::string &data) {
+    val = value_type::parse(data, nullptr, false);
+    return !val.is_discarded();
+  }
+
+  static std::string encode(const value_type &val) { return val.dump(); }
+};
+
+// MessagePack sent in binary frames
+struct nlohmann_msgpack_codec {
+  using value_type = nlohmann::json;
+
+  static constexpr bool is_binary = true;
+
+  static const char* subprotocol() { return "msgpack"; }
+
+  static bool decode(value_type &val, const std::string &data) {
+    val = value_type::from_msgpack(data, true, false);
+    return !val.is_discarded();
+  }
+
+  static std::string encode(const value_type &val) {
+    std::string data;
+    value_type::to_msgpack(val, data);
+    return data;
+  }
+};
+
+// CBOR sent in binary frames
+struct nlohmann_cbor_codec {
+  using value_type = nlohmann::json;
+
+  static constexpr bool is_binary = true;
+
+  static const char* subprotocol() { return "cbor"; }
+
+  static bool decode(value_type &val, const std::string &data) {
+    val = value_type::from_cbor(data, true, false);
+    return !val.is_discarded();
+  }
+
+  static std::string encode(const value_type &val) {
+    std::string data;
+    value_type::to_cbor(val, data);
+    return data;
+  }
+};
+
+#endif // NLOHMANN_CODECS_HPP
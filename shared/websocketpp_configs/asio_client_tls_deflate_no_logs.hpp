@@ -0,0 +1,16 @@
+#ifndef JWT_GAME_SERVER_ASIO_CLIENT_TLS_DEFLATE_NO_LOGS_HPP
+#define JWT_GAME_SERVER_ASIO_CLIENT_TLS_DEFLATE_NO_LOGS_HPP
+
+#include "asio_client_tls_no_logs.hpp"
+#include "permessage_deflate.hpp"
+
+// asio_client_tls_no_logs offering permessage-deflate to the server
+struct asio_client_tls_deflate_no_logs : public asio_client_tls_no_logs {
+  using type = asio_client_tls_deflate_no_logs;
+
+  using permessage_deflate_type = permessage_deflate_extension<
+      context_takeover_deflate_config
+    >;
+};
+
+#endif // JWT_GAME_SERVER_ASIO_CLIENT_TLS_DEFLATE_NO_LOGS_HPP
@@ -0,0 +1,20 @@
+#ifndef JWT_GAME_SERVER_ASIO_DEFLATE_NO_LOGS_HPP
+#define JWT_GAME_SERVER_ASIO_DEFLATE_NO_LOGS_HPP
+
+#include "asio_no_logs.hpp"
+#include "permessage_deflate.hpp"
+
+// asio_no_logs with permessage-deflate enabled, where deflate_config sets
+// whether the server keeps its compression context between messages, see
+// permessage_deflate.hpp
+template<typename deflate_config = no_context_takeover_deflate_config>
+struct basic_asio_deflate_no_logs : public asio_no_logs {
+  using type = basic_asio_deflate_no_logs;
+
+  using permessage_deflate_type =
+    permessage_deflate_extension<deflate_config>;
+};
+
+using asio_deflate_no_logs = basic_asio_deflate_no_logs<>;
+
+#endif // JWT_GAME_SERVER_ASIO_DEFLATE_NO_LOGS_HPP
@@ -0,0 +1,39 @@
+#ifndef JWT_GAME_SERVER_PERMESSAGE_DEFLATE_HPP
+#define JWT_GAME_SERVER_PERMESSAGE_DEFLATE_HPP
+
+#include <sstream>
+
+#include <websocketpp/http/constants.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+
+// websocketpp's permessage-deflate extension with its context takeover set
+// by deflate_config::server_no_context_takeover
+//
+// With server_no_context_takeover the server resets its compression context
+// for every message. Messages compress less, but the server compresses each
+// broadcast once and shares the compressed frame between recipients, and
+// keeps no compression window per connection between messages. Without it
+// repeated content across messages compresses far better, at the cost of a
+// compression per recipient for broadcasts.
+template<typename deflate_config>
+class permessage_deflate_extension
+  : public websocketpp::extensions::permessage_deflate::enabled<deflate_config>
+{
+public:
+  permessage_deflate_extension() {
+    if(deflate_config::server_no_context_takeover) {
+      this->enable_server_no_context_takeover();
+    }
+  }
+};
+
+// deflate_config types; the server configs default to no context takeover
+struct no_context_takeover_deflate_config {
+  static const bool server_no_context_takeover = true;
+};
+
+struct context_takeover_deflate_config {
+  static const bool server_no_context_takeover = false;
+};
+
+#endif // JWT_GAME_SERVER_PERMESSAGE_DEFLATE_HPP
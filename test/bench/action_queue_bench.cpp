@@ -0,0 +1,150 @@
+// Compares the sharded action_queue against the single mutex guarded queue
+// previously used by base_server, with a fixed pool of consumer threads and
+// a varying number of producer threads.
+
+#include <simple_web_game_server/action_queue.hpp>
+
+#include <cstdio>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+const std::size_t TOTAL_ACTIONS = 2000000;
+const std::size_t CONSUMER_COUNT = 4;
+const std::size_t CONNECTION_COUNT = 4096;
+
+// the queue as it was implemented in base_server
+class locked_queue {
+public:
+  locked_queue() : m_is_running(true) {}
+
+  void push(std::size_t v) {
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_values.push(v);
+    }
+    m_cond.notify_one();
+  }
+
+  bool pop(std::size_t& v) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    while(m_values.empty()) {
+      if(!m_is_running) {
+        return false;
+      }
+      m_cond.wait(lock);
+    }
+    v = m_values.front();
+    m_values.pop();
+    return true;
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_is_running = false;
+    }
+    m_cond.notify_all();
+  }
+
+private:
+  std::queue<std::size_t> m_values;
+  std::mutex m_lock;
+  std::condition_variable m_cond;
+  bool m_is_running;
+};
+
+template<typename push_function, typename consume_function,
+  typename stop_function>
+double run(std::size_t producers, push_function push, consume_function consume,
+  stop_function stop)
+{
+  std::atomic<std::size_t> consumed{0};
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for(std::size_t c = 0; c < CONSUMER_COUNT; ++c) {
+    threads.emplace_back([&](){ consume(consumed); });
+  }
+
+  std::vector<std::thread> producer_threads;
+  for(std::size_t p = 0; p < producers; ++p) {
+    producer_threads.emplace_back([&, p](){
+        std::size_t count = TOTAL_ACTIONS / producers;
+        for(std::size_t i = 0; i < count; ++i) {
+          push((p * count + i) % CONNECTION_COUNT);
+        }
+      });
+  }
+
+  for(std::thread& t : producer_threads) {
+    t.join();
+  }
+
+  std::size_t expected = (TOTAL_ACTIONS / producers) * producers;
+  while(consumed < expected) {
+    std::this_thread::yield();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+
+  stop();
+  for(std::thread& t : threads) {
+    t.join();
+  }
+
+  return std::chrono::duration<double>(end - start).count();
+}
+
+int main() {
+  std::vector<int> connections(CONNECTION_COUNT);
+
+  std::printf("%10s %20s %20s\n", "producers", "locked (Mops/s)",
+    "sharded (Mops/s)");
+
+  for(std::size_t producers : { 1, 4, 16, 64 }) {
+    double locked_time;
+    {
+      locked_queue queue;
+      locked_time = run(
+          producers,
+          [&](std::size_t conn){ queue.push(conn); },
+          [&](std::atomic<std::size_t>& consumed){
+            std::size_t v;
+            while(queue.pop(v)) {
+              ++consumed;
+            }
+          },
+          [&](){ queue.stop(); }
+        );
+    }
+
+    double sharded_time;
+    {
+      simple_web_game_server::action_queue<std::size_t> queue{CONSUMER_COUNT};
+      queue.start();
+      sharded_time = run(
+          producers,
+          [&](std::size_t conn){
+            queue.push(queue.get_shard(&connections[conn]), std::size_t{conn});
+          },
+          [&](std::atomic<std::size_t>& consumed){
+            std::size_t worker = queue.add_worker();
+            std::size_t v;
+            while(queue.pop_worker(worker, v)) {
+              ++consumed;
+            }
+          },
+          [&](){ queue.stop(); }
+        );
+    }
+
+    std::printf("%10zu %20.2f %20.2f\n", producers,
+      TOTAL_ACTIONS / locked_time / 1e6, TOTAL_ACTIONS / sharded_time / 1e6);
+  }
+}
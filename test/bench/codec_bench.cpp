@@ -0,0 +1,101 @@
+// Measures the cost of encoding and decoding the tic-tac-toe message mix
+// with each of the nlohmann codecs: moves sent by players, game states
+// broadcast after every move, and the time states broadcast every second.
+
+#include <codec_traits/nlohmann_codecs.hpp>
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+
+using json = nlohmann::json;
+
+const std::size_t ROUND_COUNT = 200;
+
+// builds the messages of one game in the order they are sent
+std::vector<json> create_messages(std::mt19937& rng) {
+  std::uniform_int_distribution<int> cell{0, 2};
+  std::vector<json> messages;
+  std::vector<int> board(9, 0);
+  std::vector<long> times = { 100000, 100000 };
+
+  for(int turn = 0; turn < 9; ++turn) {
+    int i = cell(rng);
+    int j = cell(rng);
+    board[3 * i + j] = (turn % 2 == 0) ? 1 : -1;
+    times[turn % 2] -= 1000 + cell(rng) * 500;
+
+    messages.push_back(json{ { "move", { i, j } } });
+
+    json game;
+    game["board"] = board;
+    game["times"] = times;
+    game["turn"] = (turn + 1) % 2;
+    game["state"] = 0;
+    game["done"] = (turn == 8);
+    messages.push_back(game);
+
+    json time;
+    time["times"] = times;
+    messages.push_back(time);
+  }
+
+  return messages;
+}
+
+template<typename codec>
+void run(const char* name, const std::vector<json>& messages) {
+  std::vector<std::string> encoded(messages.size());
+  std::size_t bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for(std::size_t r = 0; r < ROUND_COUNT; ++r) {
+    for(std::size_t i = 0; i < messages.size(); ++i) {
+      encoded[i] = codec::encode(messages[i]);
+    }
+  }
+  auto middle = std::chrono::steady_clock::now();
+
+  std::size_t failures = 0;
+  json value;
+  for(std::size_t r = 0; r < ROUND_COUNT; ++r) {
+    for(const std::string& data : encoded) {
+      if(!codec::decode(value, data)) {
+        ++failures;
+      }
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  for(const std::string& data : encoded) {
+    bytes += data.size();
+  }
+
+  const double count = static_cast<double>(ROUND_COUNT * messages.size());
+  std::printf("%10s %18.1f %18.1f %18.1f\n", name,
+    std::chrono::duration<double, std::nano>(middle - start).count() / count,
+    std::chrono::duration<double, std::nano>(end - middle).count() / count,
+    static_cast<double>(bytes) / messages.size());
+
+  if(failures > 0) {
+    std::printf("unexpected decode failures: %zu\n", failures);
+  }
+}
+
+int main() {
+  std::mt19937 rng{42};
+  std::vector<json> messages;
+  for(std::size_t g = 0; g < 100; ++g) {
+    std::vector<json> game = create_messages(rng);
+    messages.insert(messages.end(), game.begin(), game.end());
+  }
+
+  std::printf("%10s %18s %18s %18s\n", "codec", "encode (ns/msg)",
+    "decode (ns/msg)", "size (bytes/msg)");
+
+  run<nlohmann_json_codec>("json", messages);
+  run<nlohmann_msgpack_codec>("msgpack", messages);
+  run<nlohmann_cbor_codec>("cbor", messages);
+}
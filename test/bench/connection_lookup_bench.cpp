@@ -0,0 +1,90 @@
+// Measures the per-message cost of resolving the player id of an incoming
+// message as the number of open connections grows: the owner_less map lookup
+// under a global lock previously done by base_server, against reading the
+// id from the data attached to each connection.
+
+#include <cstdio>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+
+const std::size_t MESSAGE_COUNT = 4000000;
+
+struct id {
+  unsigned long player;
+  unsigned long session;
+};
+
+struct connection_data {
+  id player_id;
+  std::atomic<bool> is_verified{true};
+};
+
+using connection_hdl = std::weak_ptr<void>;
+
+template<typename function>
+double time_per_message(function f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count()
+    / MESSAGE_COUNT;
+}
+
+int main() {
+  std::printf("%12s %20s %20s\n", "connections", "map lookup (ns)",
+    "attached data (ns)");
+
+  for(std::size_t count : { 100, 1000, 10000, 100000 }) {
+    std::vector<std::shared_ptr<int> > connections;
+    std::vector<std::shared_ptr<connection_data> > data;
+    std::map<connection_hdl, id, std::owner_less<connection_hdl> > ids;
+    std::mutex lock;
+
+    for(std::size_t i = 0; i < count; ++i) {
+      connections.push_back(std::make_shared<int>(0));
+      data.push_back(std::make_shared<connection_data>());
+      data.back()->player_id = id{ i, i / 2 };
+      ids.emplace(connection_hdl{connections.back()}, id{ i, i / 2 });
+    }
+
+    // messages arrive from connections in a random order
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<std::size_t> dist{0, count - 1};
+    std::vector<std::size_t> order(MESSAGE_COUNT);
+    for(std::size_t& i : order) {
+      i = dist(rng);
+    }
+
+    std::vector<connection_hdl> hdls(connections.begin(), connections.end());
+
+    unsigned long checksum = 0;
+    double map_time = time_per_message([&](){
+        for(std::size_t i : order) {
+          std::lock_guard<std::mutex> guard(lock);
+          auto it = ids.find(hdls[i]);
+          if(it != ids.end()) {
+            checksum += it->second.player;
+          }
+        }
+      });
+
+    double data_time = time_per_message([&](){
+        for(std::size_t i : order) {
+          const connection_data& d = *data[i];
+          if(d.is_verified) {
+            checksum += d.player_id.player;
+          }
+        }
+      });
+
+    std::printf("%12zu %20.1f %20.1f\n", count, map_time, data_time);
+    if(checksum == 0) {
+      std::printf("unexpected checksum\n");
+    }
+  }
+}
@@ -0,0 +1,99 @@
+// Measures the CPU cost of permessage-deflate per byte saved on tic-tac-toe
+// full game states carrying a move list of increasing length, with and
+// without server_no_context_takeover. Each state is compressed by the same
+// extension instance in the order a single connection would send them.
+
+#include <websocketpp_configs/permessage_deflate.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+
+using json = nlohmann::json;
+
+const std::size_t MESSAGE_COUNT = 2000;
+
+// builds a sequence of full game states each with the last move_count moves
+std::vector<std::string> create_states(
+  std::mt19937& rng,
+  std::size_t move_count
+) {
+  std::uniform_int_distribution<int> cell{0, 2};
+  std::vector<std::string> states;
+  std::vector<json> moves;
+  std::vector<int> board(9, 0);
+  std::vector<long> times = { 100000, 100000 };
+
+  for(std::size_t turn = 0; states.size() < MESSAGE_COUNT; ++turn) {
+    int i = cell(rng);
+    int j = cell(rng);
+    board[3 * i + j] = (turn % 2 == 0) ? 1 : -1;
+    times[turn % 2] -= 1000 + cell(rng) * 500;
+
+    moves.push_back(json{ { "player", turn % 2 }, { "move", { i, j } } });
+    if(moves.size() > move_count) {
+      moves.erase(moves.begin());
+    }
+
+    json game;
+    game["board"] = board;
+    game["times"] = times;
+    game["turn"] = (turn + 1) % 2;
+    game["state"] = 0;
+    game["done"] = false;
+    game["moves"] = moves;
+    states.push_back(game.dump());
+  }
+
+  return states;
+}
+
+template<typename deflate_config>
+void run(
+  const char* name,
+  std::size_t move_count,
+  const std::vector<std::string>& states
+) {
+  permessage_deflate_extension<deflate_config> deflate;
+  deflate.init(true);
+
+  std::size_t bytes = 0;
+  std::size_t compressed_bytes = 0;
+  std::string out;
+
+  auto start = std::chrono::steady_clock::now();
+  for(const std::string& s : states) {
+    out.clear();
+    deflate.compress(s, out);
+    bytes += s.size();
+    compressed_bytes += out.size();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  const double ns = std::chrono::duration<double, std::nano>(end - start)
+    .count();
+  const double saved = static_cast<double>(bytes)
+    - static_cast<double>(compressed_bytes);
+  std::printf("%12s %8zu %12.1f %12.1f %12.1f %16.2f\n", name, move_count,
+    static_cast<double>(bytes) / states.size(),
+    static_cast<double>(compressed_bytes) / states.size(),
+    ns / states.size(),
+    (saved > 0) ? ns / saved : 0.0);
+}
+
+int main() {
+  std::printf("%12s %8s %12s %12s %12s %16s\n", "takeover", "moves",
+    "raw (bytes)", "sent (bytes)", "ns/msg", "ns/byte saved");
+
+  for(std::size_t move_count : { 0, 8, 64, 512 }) {
+    std::mt19937 rng{42};
+    std::vector<std::string> states = create_states(rng, move_count);
+
+    run<context_takeover_deflate_config>("context", move_count, states);
+    run<no_context_takeover_deflate_config>("no context", move_count, states);
+  }
+}
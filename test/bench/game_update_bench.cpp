@@ -0,0 +1,77 @@
+// Compares updating games with std::for_each over an unordered_map, as
+// game_server previously did, against the work-stealing update_pool over a
+// contiguous array of games, for 10k to 100k games whose update cost varies
+// and for thread counts up to the number of hardware threads.
+
+#include <simple_web_game_server/update_pool.hpp>
+
+#include <cstdio>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <thread>
+
+const std::size_t TICKS = 20;
+
+struct game {
+  unsigned long cost;
+  unsigned long state;
+
+  void update() {
+    // a simulated update whose cost varies from game to game
+    for(unsigned long i = 0; i < cost; ++i) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+  }
+};
+
+template<typename function>
+double time_per_tick(function f) {
+  auto start = std::chrono::steady_clock::now();
+  for(std::size_t t = 0; t < TICKS; ++t) {
+    f();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / TICKS;
+}
+
+int main() {
+  const std::size_t max_threads =
+    std::max(1u, std::thread::hardware_concurrency());
+
+  std::printf("%8s %8s %16s %16s %10s\n", "games", "threads",
+    "for_each (ms)", "pool (ms)", "speedup");
+
+  for(std::size_t count : { 10000, 100000 }) {
+    std::mt19937 rng{42};
+    // most games are cheap, a few are very expensive
+    std::exponential_distribution<double> dist{1.0 / 200};
+
+    std::unordered_map<std::size_t, game> game_map;
+    std::vector<game*> game_slots;
+    for(std::size_t i = 0; i < count; ++i) {
+      game g{ static_cast<unsigned long>(dist(rng)) + 1, i };
+      game_slots.push_back(&game_map.emplace(i, g).first->second);
+    }
+
+    double map_time = time_per_tick([&](){
+        std::for_each(game_map.begin(), game_map.end(),
+          [](auto& key_val_pair){ key_val_pair.second.update(); });
+      });
+
+    for(std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+      simple_web_game_server::update_pool pool;
+      pool.start(threads, true);
+
+      auto update = [&](std::size_t i){ game_slots[i]->update(); };
+      double pool_time = time_per_tick([&](){
+          pool.run(game_slots.size(), update);
+        });
+
+      std::printf("%8zu %8zu %16.3f %16.3f %10.2f\n", count, threads,
+        map_time, pool_time, map_time / pool_time);
+    }
+  }
+}
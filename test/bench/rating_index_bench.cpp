@@ -0,0 +1,170 @@
+// Measures the cost of a matchmaking pass as the number of waiting sessions
+// grows: the quadratic rescan of the session map previously done by the
+// tic-tac-toe matchmaker, a rescan that sorts the sessions each pass, and
+// the incremental rating_index. Each pass a batch of new sessions arrives,
+// each close in rating to one waiting session.
+
+#include <simple_web_game_server/rating_index.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <utility>
+#include <random>
+#include <chrono>
+
+const std::size_t PASS_COUNT = 10;
+const std::size_t ARRIVALS_PER_PASS = 100;
+const int MAX_DIFFERENCE = 250;
+// waiting sessions are spread further apart than they may be matched
+const int RATING_SPACING = 300;
+
+using session_map = std::unordered_map<unsigned long, int>;
+using match_list = std::vector<std::pair<unsigned long, unsigned long> >;
+
+// the matching loop as it was implemented in the tic-tac-toe matchmaker
+void quadratic_match(const session_map& sessions, match_list& matches) {
+  std::unordered_set<unsigned long> matched;
+  for(auto it1 = sessions.begin(); it1 != sessions.end(); ++it1) {
+    if(matched.count(it1->first) > 0) {
+      continue;
+    }
+    int min_score = 100000;
+    unsigned long partner = 0;
+    auto temp = it1;
+    for(auto it2 = ++temp; it2 != sessions.end(); ++it2) {
+      if(matched.count(it2->first) > 0) {
+        continue;
+      }
+      int score = std::abs(it1->second - it2->second);
+      if(score < min_score) {
+        partner = it2->first;
+        min_score = score;
+      }
+    }
+    if(min_score <= MAX_DIFFERENCE) {
+      matches.emplace_back(it1->first, partner);
+      matched.insert(it1->first);
+      matched.insert(partner);
+    }
+  }
+}
+
+// pairs adjacent sessions after sorting every waiting session by rating
+void sorted_match(const session_map& sessions, match_list& matches) {
+  std::vector<std::pair<int, unsigned long> > sorted;
+  sorted.reserve(sessions.size());
+  for(auto& spair : sessions) {
+    sorted.emplace_back(spair.second, spair.first);
+  }
+  std::sort(sorted.begin(), sorted.end());
+  for(std::size_t i = 0; i + 1 < sorted.size(); ++i) {
+    if(sorted[i + 1].first - sorted[i].first <= MAX_DIFFERENCE) {
+      matches.emplace_back(sorted[i].second, sorted[i + 1].second);
+      ++i;
+    }
+  }
+}
+
+// returns the mean milliseconds per pass of f(sessions, arrivals, matches)
+template<typename function>
+double time_per_pass(std::size_t count, function f) {
+  session_map sessions;
+  std::vector<std::pair<unsigned long, int> > initial;
+  for(std::size_t i = 0; i < count; ++i) {
+    initial.emplace_back(i, static_cast<int>(i) * RATING_SPACING);
+  }
+
+  std::mt19937 rng{42};
+  std::uniform_int_distribution<std::size_t> dist{0, count - 1};
+  std::vector<std::vector<std::pair<unsigned long, int> > > arrivals(
+      PASS_COUNT
+    );
+  unsigned long next_id = count;
+  for(auto& batch : arrivals) {
+    for(std::size_t i = 0; i < ARRIVALS_PER_PASS; ++i) {
+      batch.emplace_back(next_id++,
+        static_cast<int>(dist(rng)) * RATING_SPACING + 1);
+    }
+  }
+
+  f(initial, true);
+
+  double total = 0;
+  for(auto& batch : arrivals) {
+    auto start = std::chrono::steady_clock::now();
+    f(batch, false);
+    auto end = std::chrono::steady_clock::now();
+    total += std::chrono::duration<double, std::milli>(end - start).count();
+  }
+  return total / PASS_COUNT;
+}
+
+int main() {
+  std::printf("%10s %18s %18s %18s\n", "sessions", "quadratic (ms)",
+    "sorted (ms)", "indexed (ms)");
+
+  for(std::size_t count : { 1000, 100000, 1000000 }) {
+    using batch = std::vector<std::pair<unsigned long, int> >;
+    std::size_t checksum = 0;
+
+    double quadratic_time = -1;
+    if(count <= 10000) {
+      session_map sessions;
+      quadratic_time = time_per_pass(count, [&](batch& b, bool initial){
+          sessions.insert(b.begin(), b.end());
+          if(!initial) {
+            match_list matches;
+            quadratic_match(sessions, matches);
+            for(auto& m : matches) {
+              sessions.erase(m.first);
+              sessions.erase(m.second);
+            }
+            checksum += matches.size();
+          }
+        });
+    }
+
+    session_map sorted_sessions;
+    double sorted_time = time_per_pass(count, [&](batch& b, bool initial){
+        sorted_sessions.insert(b.begin(), b.end());
+        if(!initial) {
+          match_list matches;
+          sorted_match(sorted_sessions, matches);
+          for(auto& m : matches) {
+            sorted_sessions.erase(m.first);
+            sorted_sessions.erase(m.second);
+          }
+          checksum += matches.size();
+        }
+      });
+
+    session_map indexed_sessions;
+    simple_web_game_server::rating_index<unsigned long> index;
+    double indexed_time = time_per_pass(count, [&](batch& b, bool initial){
+        for(auto& spair : b) {
+          indexed_sessions.insert(spair);
+          index.insert(spair.first, spair.second);
+        }
+        checksum += index.match_pairs(MAX_DIFFERENCE,
+          [&](unsigned long a, unsigned long b){
+            indexed_sessions.erase(a);
+            indexed_sessions.erase(b);
+          });
+      });
+
+    if(quadratic_time < 0) {
+      std::printf("%10zu %18s %18.3f %18.3f\n", count, "-", sorted_time,
+        indexed_time);
+    } else {
+      std::printf("%10zu %18.3f %18.3f %18.3f\n", count, quadratic_time,
+        sorted_time, indexed_time);
+    }
+    if(checksum == 0) {
+      std::printf("unexpected checksum\n");
+    }
+  }
+}
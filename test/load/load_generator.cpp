@@ -0,0 +1,694 @@
+// Drives thousands of simulated players against a game_server from a small
+// pool of threads. Each thread runs one websocketpp client endpoint with its
+// own io_context, and the players are spread round-robin over the endpoints,
+// so no player needs a thread of its own. Players log in with JWTs minted as
+// create_game_tokens does in the tests, two players to a session, and then
+// follow scripted or random play of test_game or tic_tac_toe_game. Reports
+// the connect rate, message throughput, and latency percentiles.
+//
+// See README.md for the options and an example run against load_server.
+
+#define DISABLE_PICOJSON
+#include <jwt-cpp/jwt.h>
+
+#include <json_traits/nlohmann_traits.hpp>
+#include <websocketpp_configs/asio_client_no_logs.hpp>
+
+#include <websocketpp/client.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+using json = nlohmann::json;
+using steady_clock = std::chrono::steady_clock;
+
+// asio_client_no_logs with a small read buffer per connection, so tens of
+// thousands of connections fit in memory
+struct load_client_config : public asio_client_no_logs {
+  using type = load_client_config;
+  using super = asio_client_no_logs;
+
+  struct transport_config : public super::transport_config {
+    using concurrency_type = type::concurrency_type;
+    using alog_type = type::alog_type;
+    using elog_type = type::elog_type;
+    using request_type = type::request_type;
+    using response_type = type::response_type;
+    using socket_type = super::transport_config::socket_type;
+  };
+
+  using transport_type =
+    websocketpp::transport::asio::endpoint<transport_config>;
+
+  static const std::size_t connection_read_buffer_size = 1024;
+};
+
+using ws_client = websocketpp::client<load_client_config>;
+using connection_hdl = websocketpp::connection_hdl;
+using claim = jwt::basic_claim<nlohmann_traits>;
+
+struct options {
+  std::vector<std::string> uris;
+  std::size_t clients = 1000;
+  std::size_t threads = 4;
+  std::string game = "test_game";
+  std::string play = "random";
+  double connect_rate = 0;
+  long interval_ms = 100;
+  long duration_s = 10;
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-test";
+};
+
+void print_usage() {
+  std::printf(
+      "usage: load_generator [options]\n"
+      "  --uri URI            server to connect to, may be repeated to spread\n"
+      "                       clients round-robin (default ws://localhost:9090)\n"
+      "  --clients N          simulated players, two per session (1000)\n"
+      "  --threads N          client threads, each with its own io_context (4)\n"
+      "  --game NAME          test_game or tic_tac_toe (test_game)\n"
+      "  --play MODE          scripted or random (random)\n"
+      "  --connect-rate N     new connections per second, 0 for no limit (0)\n"
+      "  --interval MS        time between a player's messages or moves (100)\n"
+      "  --duration S         seconds to play once every client is started (10)\n"
+      "  --secret KEY         HS256 key of the server's JWT verifier (secret)\n"
+      "  --issuer NAME        issuer claim of the minted JWTs (jwt-gs-test)\n"
+    );
+}
+
+options parse_options(int argc, char* argv[]) {
+  options opts;
+  for(int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if(arg == "--help") {
+      print_usage();
+      std::exit(0);
+    }
+    if(i + 1 >= argc) {
+      throw std::invalid_argument{"missing value for " + arg};
+    }
+
+    const std::string value = argv[++i];
+    if(arg == "--uri") {
+      opts.uris.push_back(value);
+    } else if(arg == "--clients") {
+      opts.clients = std::stoul(value);
+    } else if(arg == "--threads") {
+      opts.threads = std::max<std::size_t>(1, std::stoul(value));
+    } else if(arg == "--game") {
+      opts.game = value;
+    } else if(arg == "--play") {
+      opts.play = value;
+    } else if(arg == "--connect-rate") {
+      opts.connect_rate = std::stod(value);
+    } else if(arg == "--interval") {
+      opts.interval_ms = std::stol(value);
+    } else if(arg == "--duration") {
+      opts.duration_s = std::stol(value);
+    } else if(arg == "--secret") {
+      opts.secret = value;
+    } else if(arg == "--issuer") {
+      opts.issuer = value;
+    } else {
+      throw std::invalid_argument{"unknown option " + arg};
+    }
+  }
+
+  if(opts.uris.empty()) {
+    opts.uris.push_back("ws://localhost:9090");
+  }
+  if(opts.game != "test_game" && opts.game != "tic_tac_toe") {
+    throw std::invalid_argument{"unknown game " + opts.game};
+  }
+  if(opts.play != "scripted" && opts.play != "random") {
+    throw std::invalid_argument{"unknown play mode " + opts.play};
+  }
+  opts.clients += opts.clients % 2;
+
+  return opts;
+}
+
+// an HDR style histogram of nanosecond latencies: each power of two is split
+// into 16 buckets, so every value is recorded within 1/16 of its size
+class latency_histogram {
+public:
+  latency_histogram() : m_counts(64 * SUB_BUCKETS, 0), m_count(0), m_max(0) {}
+
+  void record(std::int64_t ns) {
+    const std::uint64_t v = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+    ++m_counts[index(v)];
+    ++m_count;
+    m_max = std::max(m_max, v);
+  }
+
+  void merge(const latency_histogram& other) {
+    for(std::size_t i = 0; i < m_counts.size(); ++i) {
+      m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_max = std::max(m_max, other.m_max);
+  }
+
+  std::uint64_t count() const {
+    return m_count;
+  }
+
+  // returns an upper bound of the value at quantile q
+  double percentile_ms(double q) const {
+    if(m_count == 0) {
+      return 0;
+    }
+
+    const std::uint64_t rank = static_cast<std::uint64_t>(q * (m_count - 1));
+    std::uint64_t seen = 0;
+    for(std::size_t i = 0; i < m_counts.size(); ++i) {
+      seen += m_counts[i];
+      if(seen > rank) {
+        return std::min(upper_bound(i), m_max) / 1e6;
+      }
+    }
+    return m_max / 1e6;
+  }
+
+  double max_ms() const {
+    return m_max / 1e6;
+  }
+
+private:
+  static const std::size_t SUB_BITS = 4;
+  static const std::size_t SUB_BUCKETS = 1 << SUB_BITS;
+
+  static std::size_t index(std::uint64_t v) {
+    if(v < SUB_BUCKETS) {
+      return v;
+    }
+    const std::size_t exponent = 63 - __builtin_clzll(v);
+    const std::size_t sub = (v >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+  }
+
+  static std::uint64_t upper_bound(std::size_t i) {
+    if(i < SUB_BUCKETS) {
+      return i;
+    }
+    const std::size_t exponent = i / SUB_BUCKETS + SUB_BITS - 1;
+    const std::uint64_t sub = i % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << (exponent - SUB_BITS)) - 1;
+  }
+
+  std::vector<std::uint64_t> m_counts;
+  std::uint64_t m_count;
+  std::uint64_t m_max;
+};
+
+// the counters of one worker; written only by the worker's thread, and read
+// by the main thread for progress reports
+struct worker_stats {
+  std::atomic<std::uint64_t> opened{0};
+  std::atomic<std::uint64_t> failed{0};
+  std::atomic<std::uint64_t> closed{0};
+  std::atomic<std::uint64_t> sent{0};
+  std::atomic<std::uint64_t> received{0};
+  std::atomic<std::uint64_t> games{0};
+
+  // only read once the worker has stopped
+  latency_histogram connect_latency;
+  latency_histogram message_latency;
+  steady_clock::time_point last_open;
+};
+
+struct worker;
+
+// one simulated player, only touched by the thread of its worker
+struct player {
+  std::size_t index;
+  worker* owner;
+  const std::string* uri;
+  unsigned long pid;
+  std::size_t game;
+  std::size_t round;
+  connection_hdl hdl;
+  bool is_open;
+  steady_clock::time_point connect_start;
+  ws_client::timer_ptr timer;
+  std::mt19937 rng;
+
+  // tic-tac-toe state
+  int seat;
+  std::vector<int> board;
+  int pending_cell;
+  steady_clock::time_point move_sent;
+};
+
+struct worker {
+  ws_client endpoint;
+  std::thread thread;
+  worker_stats stats;
+  std::deque<player> players;
+};
+
+class load_generator {
+public:
+  explicit load_generator(const options& opts) : m_opts(opts),
+    m_workers(opts.threads), m_game_count(opts.clients / 2),
+    m_is_stopping(false), m_test_game(opts.game == "test_game"),
+    m_random(opts.play == "random") {}
+
+  void run() {
+    for(std::size_t i = 0; i < m_workers.size(); ++i) {
+      worker& w = m_workers[i];
+      w.endpoint.init_asio();
+      w.endpoint.start_perpetual();
+      w.thread = std::thread{[&w](){ w.endpoint.run(); }};
+    }
+
+    for(std::size_t i = 0; i < m_opts.clients; ++i) {
+      worker& w = m_workers[i % m_workers.size()];
+      w.players.push_back(player{});
+      player& p = w.players.back();
+      p.index = i;
+      p.owner = &w;
+      p.uri = &m_opts.uris[i % m_opts.uris.size()];
+      p.pid = i + 1;
+      p.game = i / 2;
+      p.round = 0;
+      p.is_open = false;
+      p.rng.seed(static_cast<unsigned>(i));
+      p.seat = -1;
+      p.pending_cell = -1;
+    }
+
+    std::printf(
+        "starting %zu clients on %zu threads, %s with %s play\n",
+        m_opts.clients, m_workers.size(), m_opts.game.c_str(),
+        m_opts.play.c_str()
+      );
+
+    // start the clients at the requested rate, posting each connect to the
+    // io_context of its worker
+    const steady_clock::time_point start = steady_clock::now();
+    steady_clock::time_point next_report = start + std::chrono::seconds{1};
+    for(std::size_t i = 0; i < m_opts.clients; ++i) {
+      worker& w = m_workers[i % m_workers.size()];
+      player& p = w.players[i / m_workers.size()];
+      w.endpoint.get_io_service().post([this, &p](){ connect(p); });
+
+      if(m_opts.connect_rate > 0) {
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<
+            steady_clock::duration
+          >(std::chrono::duration<double>(i / m_opts.connect_rate)));
+      }
+      if(steady_clock::now() >= next_report) {
+        report_progress(start);
+        next_report += std::chrono::seconds{1};
+      }
+    }
+
+    const steady_clock::time_point play_start = steady_clock::now();
+    const steady_clock::time_point end = play_start
+      + std::chrono::seconds{m_opts.duration_s};
+    while(steady_clock::now() < end) {
+      std::this_thread::sleep_until(std::min(next_report, end));
+      if(steady_clock::now() >= next_report) {
+        report_progress(start);
+        next_report += std::chrono::seconds{1};
+      }
+    }
+
+    // measure throughput over the play phase only
+    const std::uint64_t sent = total(&worker_stats::sent);
+    const std::uint64_t received = total(&worker_stats::received);
+    stop();
+
+    report(start, play_start, end, sent, received);
+  }
+
+private:
+  void connect(player& p) {
+    if(m_is_stopping) {
+      return;
+    }
+
+    worker& w = *p.owner;
+    websocketpp::lib::error_code ec;
+    ws_client::connection_ptr con = w.endpoint.get_connection(*p.uri, ec);
+    if(ec) {
+      ++w.stats.failed;
+      return;
+    }
+
+    const std::string token = mint_token(p);
+    con->set_open_handler([this, &p, token](connection_hdl hdl){
+        on_open(p, hdl, token);
+      });
+    con->set_fail_handler([this, &p](connection_hdl){
+        ++p.owner->stats.failed;
+      });
+    con->set_close_handler([this, &p](connection_hdl){
+        on_close(p);
+      });
+    con->set_message_handler(
+        [this, &p](connection_hdl, ws_client::message_ptr msg){
+          on_message(p, msg->get_payload());
+        }
+      );
+
+    p.connect_start = steady_clock::now();
+    w.endpoint.connect(con);
+  }
+
+  // signs a token for the player's session in its current round; both
+  // players of a game move to the next round together when it ends
+  std::string mint_token(const player& p) {
+    const unsigned long sid = p.round * m_game_count + p.game + 1;
+    return jwt::create<nlohmann_traits>()
+      .set_issuer(m_opts.issuer)
+      .set_payload_claim("pid", claim(json(p.pid)))
+      .set_payload_claim("sid", claim(json(sid)))
+      .set_payload_claim("data", claim(json{ { "matched", true } }))
+      .sign(jwt::algorithm::hs256{m_opts.secret});
+  }
+
+  void on_open(player& p, connection_hdl hdl, const std::string& token) {
+    worker& w = *p.owner;
+    const steady_clock::time_point now = steady_clock::now();
+    ++w.stats.opened;
+    w.stats.connect_latency.record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          now - p.connect_start
+        ).count()
+      );
+    w.stats.last_open = now;
+
+    p.hdl = hdl;
+    p.is_open = true;
+    p.seat = -1;
+    p.board.assign(9, 0);
+    p.pending_cell = -1;
+    send(p, token);
+
+    if(m_test_game) {
+      schedule(p, [this, &p](){ send_test_message(p); });
+    }
+  }
+
+  void on_close(player& p) {
+    worker& w = *p.owner;
+    ++w.stats.closed;
+    p.is_open = false;
+    if(p.timer) {
+      p.timer->cancel();
+      p.timer.reset();
+    }
+
+    // the server closes tic-tac-toe connections once their game ends, so
+    // play the next game in a new session
+    if(!m_test_game && !m_is_stopping) {
+      ++w.stats.games;
+      ++p.round;
+      connect(p);
+    }
+  }
+
+  void on_message(player& p, const std::string& payload) {
+    worker& w = *p.owner;
+    ++w.stats.received;
+
+    json msg = json::parse(payload, nullptr, false);
+    if(msg.is_discarded() || !msg.is_object()) {
+      return;
+    }
+
+    if(m_test_game) {
+      // echoes, and broadcasts sent by this player, carry their send time
+      auto data = msg.find("data");
+      auto pid = msg.find("pid");
+      if(data != msg.end() && data->is_number_integer()
+          && (pid == msg.end() || *pid == p.pid))
+      {
+        record_latency(p, data->get<std::int64_t>());
+      }
+      return;
+    }
+
+    auto seat = msg.find("player");
+    if(seat != msg.end()) {
+      p.seat = seat->get<int>();
+    }
+    auto board = msg.find("board");
+    if(board == msg.end()) {
+      return;
+    }
+    p.board = board->get<std::vector<int> >();
+
+    if(p.pending_cell >= 0 && p.board[p.pending_cell] != 0) {
+      w.stats.message_latency.record(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+            steady_clock::now() - p.move_sent
+          ).count()
+        );
+      p.pending_cell = -1;
+    }
+
+    if(p.seat >= 0 && msg.value("turn", -1) == p.seat
+        && !msg.value("done", true) && p.pending_cell < 0)
+    {
+      schedule(p, [this, &p](){ send_move(p); });
+    }
+  }
+
+  void send_test_message(player& p) {
+    if(!p.is_open) {
+      return;
+    }
+
+    // scripted play echoes at a fixed interval, random play also broadcasts
+    const bool broadcast = m_random
+      && std::uniform_int_distribution<int>{0, 3}(p.rng) == 0;
+    json msg = {
+        { "type", broadcast ? "broadcast" : "echo" },
+        { "data", now_ns() }
+      };
+    send(p, msg.dump());
+
+    schedule(p, [this, &p](){ send_test_message(p); });
+  }
+
+  void send_move(player& p) {
+    if(!p.is_open || p.pending_cell >= 0) {
+      return;
+    }
+
+    std::vector<int> empty;
+    for(int k = 0; k < 9; ++k) {
+      if(p.board[k] == 0) {
+        empty.push_back(k);
+      }
+    }
+    if(empty.empty()) {
+      return;
+    }
+
+    // scripted play takes the first empty cell, random play any empty cell
+    std::size_t choice = 0;
+    if(m_random) {
+      choice = std::uniform_int_distribution<std::size_t>{
+          0, empty.size() - 1
+        }(p.rng);
+    }
+    const int cell = empty[choice];
+
+    p.pending_cell = cell;
+    p.move_sent = steady_clock::now();
+    // the board is indexed by i + 3 * j for the move [i, j]
+    send(p, json{ { "move", { cell % 3, cell / 3 } } }.dump());
+  }
+
+  // runs f after the play interval, exponentially distributed for random
+  // play, on the player's worker thread
+  void schedule(player& p, std::function<void()> f) {
+    long delay = m_opts.interval_ms;
+    if(m_random && delay > 0) {
+      delay = static_cast<long>(std::exponential_distribution<double>{
+          1.0 / delay
+        }(p.rng));
+    }
+
+    p.timer = p.owner->endpoint.set_timer(
+        delay,
+        [f](const websocketpp::lib::error_code& ec){
+          if(!ec) {
+            f();
+          }
+        }
+      );
+  }
+
+  void send(player& p, const std::string& msg) {
+    websocketpp::lib::error_code ec;
+    p.owner->endpoint.send(p.hdl, msg, websocketpp::frame::opcode::text, ec);
+    if(!ec) {
+      ++p.owner->stats.sent;
+    }
+  }
+
+  void record_latency(player& p, std::int64_t sent_ns) {
+    p.owner->stats.message_latency.record(now_ns() - sent_ns);
+  }
+
+  static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        steady_clock::now().time_since_epoch()
+      ).count();
+  }
+
+  // closes every connection and joins the worker threads
+  void stop() {
+    m_is_stopping = true;
+    for(worker& w : m_workers) {
+      w.endpoint.get_io_service().post([&w](){
+          for(player& p : w.players) {
+            if(p.timer) {
+              p.timer->cancel();
+            }
+            if(p.is_open) {
+              websocketpp::lib::error_code ec;
+              w.endpoint.close(
+                  p.hdl, websocketpp::close::status::normal, "done", ec
+                );
+            }
+          }
+          w.endpoint.stop_perpetual();
+        });
+    }
+
+    // give the closing handshakes a moment before forcing the loops to end
+    const steady_clock::time_point deadline = steady_clock::now()
+      + std::chrono::seconds{5};
+    while(total(&worker_stats::closed) < total(&worker_stats::opened)
+        && steady_clock::now() < deadline)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    for(worker& w : m_workers) {
+      w.endpoint.stop();
+      w.thread.join();
+    }
+  }
+
+  std::uint64_t total(std::atomic<std::uint64_t> worker_stats::* counter) {
+    std::uint64_t sum = 0;
+    for(worker& w : m_workers) {
+      sum += (w.stats.*counter).load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  void report_progress(steady_clock::time_point start) {
+    const std::uint64_t sent = total(&worker_stats::sent);
+    const std::uint64_t received = total(&worker_stats::received);
+    std::printf(
+        "%6.1fs open %8llu failed %6llu sent/s %9llu received/s %9llu\n",
+        std::chrono::duration<double>(steady_clock::now() - start).count(),
+        static_cast<unsigned long long>(
+          total(&worker_stats::opened) - total(&worker_stats::closed)
+        ),
+        static_cast<unsigned long long>(total(&worker_stats::failed)),
+        static_cast<unsigned long long>(sent - m_last_sent),
+        static_cast<unsigned long long>(received - m_last_received)
+      );
+    std::fflush(stdout);
+    m_last_sent = sent;
+    m_last_received = received;
+  }
+
+  void report(
+      steady_clock::time_point start,
+      steady_clock::time_point play_start,
+      steady_clock::time_point end,
+      std::uint64_t sent,
+      std::uint64_t received
+    )
+  {
+    latency_histogram connect_latency;
+    latency_histogram message_latency;
+    steady_clock::time_point last_open = start;
+    for(worker& w : m_workers) {
+      connect_latency.merge(w.stats.connect_latency);
+      message_latency.merge(w.stats.message_latency);
+      last_open = std::max(last_open, w.stats.last_open);
+    }
+
+    const double connect_time =
+      std::chrono::duration<double>(last_open - start).count();
+    const double play_time =
+      std::chrono::duration<double>(end - play_start).count();
+    const std::uint64_t opened = total(&worker_stats::opened);
+
+    std::printf("\n%-22s %12llu\n", "connections opened",
+      static_cast<unsigned long long>(opened));
+    std::printf("%-22s %12llu\n", "connections failed",
+      static_cast<unsigned long long>(total(&worker_stats::failed)));
+    std::printf("%-22s %12.1f\n", "connects/s",
+      connect_time > 0 ? opened / connect_time : 0.0);
+    if(!m_test_game) {
+      std::printf("%-22s %12llu\n", "games finished",
+        static_cast<unsigned long long>(total(&worker_stats::games) / 2));
+    }
+    std::printf("%-22s %12.1f\n", "messages sent/s",
+      play_time > 0 ? sent / play_time : 0.0);
+    std::printf("%-22s %12.1f\n", "messages received/s",
+      play_time > 0 ? received / play_time : 0.0);
+
+    std::printf("\n%-22s %10s %10s %10s %10s %10s %10s\n", "latency (ms)",
+      "samples", "p50", "p90", "p99", "p99.9", "max");
+    print_latency("connect", connect_latency);
+    print_latency(m_test_game ? "echo" : "move", message_latency);
+  }
+
+  static void print_latency(const char* name, const latency_histogram& h) {
+    std::printf("%-22s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n", name,
+      static_cast<unsigned long long>(h.count()), h.percentile_ms(0.5),
+      h.percentile_ms(0.9), h.percentile_ms(0.99), h.percentile_ms(0.999),
+      h.max_ms());
+  }
+
+  const options m_opts;
+  std::deque<worker> m_workers;
+  const std::size_t m_game_count;
+  std::atomic<bool> m_is_stopping;
+  const bool m_test_game;
+  const bool m_random;
+
+  std::uint64_t m_last_sent = 0;
+  std::uint64_t m_last_received = 0;
+};
+
+int main(int argc, char* argv[]) {
+  options opts;
+  try {
+    opts = parse_options(argc, argv);
+  } catch(std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    print_usage();
+    return 1;
+  }
+
+  load_generator generator{opts};
+  generator.run();
+}
@@ -0,0 +1,163 @@
+// A plain WebSocket game_server for load_generator, hosting either the
+// test_game from the unit tests or the tic_tac_toe_game example, with its
+// metrics served over http so a run can be watched from the server side.
+//
+// See README.md for the options.
+
+#define DISABLE_PICOJSON
+#include <jwt-cpp/jwt.h>
+
+#include <simple_web_game_server/game_server.hpp>
+#include <json_traits/nlohmann_traits.hpp>
+#include <codec_traits/nlohmann_codecs.hpp>
+#include <websocketpp_configs/asio_no_logs.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include "../src/test_game.hpp"
+#include "../../examples/tic_tac_toe/tic_tac_toe_game.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+using namespace std::chrono_literals;
+
+struct options {
+  uint16_t port = 9090;
+  std::string game = "test_game";
+  std::size_t io_threads = 1;
+  std::size_t message_threads = 1;
+  long tick_ms = 100;
+  std::string metrics_path = "/metrics";
+  std::size_t trace_interval = 0;
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-test";
+};
+
+void print_usage() {
+  std::printf(
+      "usage: load_server [options]\n"
+      "  --port N             port to listen on (9090)\n"
+      "  --game NAME          test_game or tic_tac_toe (test_game)\n"
+      "  --io-threads N       threads running the WebSocket server (1)\n"
+      "  --message-threads N  threads processing messages (1)\n"
+      "  --tick MS            game update time step (100)\n"
+      "  --metrics-path PATH  http path of the metrics (/metrics)\n"
+      "  --trace-interval N   trace one in every N messages, 0 for none (0)\n"
+      "  --secret KEY         HS256 key of the JWT verifier (secret)\n"
+      "  --issuer NAME        issuer required of login JWTs (jwt-gs-test)\n"
+    );
+}
+
+options parse_options(int argc, char* argv[]) {
+  options opts;
+  for(int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if(arg == "--help") {
+      print_usage();
+      std::exit(0);
+    }
+    if(i + 1 >= argc) {
+      throw std::invalid_argument{"missing value for " + arg};
+    }
+
+    const std::string value = argv[++i];
+    if(arg == "--port") {
+      opts.port = static_cast<uint16_t>(std::stoul(value));
+    } else if(arg == "--game") {
+      opts.game = value;
+    } else if(arg == "--io-threads") {
+      opts.io_threads = std::max<std::size_t>(1, std::stoul(value));
+    } else if(arg == "--message-threads") {
+      opts.message_threads = std::max<std::size_t>(1, std::stoul(value));
+    } else if(arg == "--tick") {
+      opts.tick_ms = std::stol(value);
+    } else if(arg == "--metrics-path") {
+      opts.metrics_path = value;
+    } else if(arg == "--trace-interval") {
+      opts.trace_interval = std::stoul(value);
+    } else if(arg == "--secret") {
+      opts.secret = value;
+    } else if(arg == "--issuer") {
+      opts.issuer = value;
+    } else {
+      throw std::invalid_argument{"unknown option " + arg};
+    }
+  }
+
+  if(opts.game != "test_game" && opts.game != "tic_tac_toe") {
+    throw std::invalid_argument{"unknown game " + opts.game};
+  }
+
+  return opts;
+}
+
+template<typename game, typename game_server>
+void run_server(const options& opts) {
+  using combined_id = typename game::player_traits::id;
+
+  jwt::verifier<jwt::default_clock, nlohmann_traits>
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(opts.secret))
+    .with_issuer(opts.issuer);
+
+  // the load generator ignores game results, so none are signed
+  game_server gs{verifier, [](const combined_id& id, const json& data){
+      return data.dump();
+    }, 60s};
+  gs.set_metrics_path(opts.metrics_path);
+  gs.set_trace_sample_interval(opts.trace_interval);
+  // give each message thread its own shard of the action queue
+  gs.set_action_shard_count(opts.message_threads);
+
+  std::vector<std::thread> threads;
+  threads.emplace_back(&game_server::run, &gs, opts.port, true);
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  for(std::size_t i = 1; i < opts.io_threads; ++i) {
+    threads.emplace_back(&game_server::run, &gs, opts.port, true);
+  }
+  for(std::size_t i = 0; i < opts.message_threads; ++i) {
+    threads.emplace_back(&game_server::process_messages, &gs);
+  }
+  threads.emplace_back(
+      &game_server::update_games, &gs, std::chrono::milliseconds{opts.tick_ms}
+    );
+
+  for(std::thread& t : threads) {
+    t.join();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  options opts;
+  try {
+    opts = parse_options(argc, argv);
+  } catch(std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    print_usage();
+    return 1;
+  }
+
+  spdlog::set_level(spdlog::level::warn);
+
+  if(opts.game == "test_game") {
+    run_server<test_game, simple_web_game_server::game_server<
+        test_game, jwt::default_clock, nlohmann_traits, asio_no_logs
+      > >(opts);
+  } else {
+    // tic_tac_toe_game exchanges decoded json, so it needs a codec
+    run_server<tic_tac_toe_game, simple_web_game_server::game_server<
+        tic_tac_toe_game, jwt::default_clock, nlohmann_traits, asio_no_logs,
+        simple_web_game_server::default_close_reasons,
+        simple_web_game_server::codec_list<nlohmann_json_codec>
+      > >(opts);
+  }
+}
@@ -0,0 +1,232 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/action_queue.hpp>
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+TEST_CASE("the action queue should keep values with the same key in order") {
+  using simple_web_game_server::action_queue;
+  using namespace std::chrono_literals;
+
+  action_queue<int> queue{4};
+  queue.start();
+
+  std::vector<int> keys(8);
+
+  SUBCASE("values pushed to a shard should be popped in order") {
+    for(int i = 0; i < 100; ++i) {
+      CHECK(queue.push(queue.get_shard(&keys[i % keys.size()]), int{i}));
+    }
+
+    CHECK(queue.size() == 100);
+
+    for(std::size_t k = 0; k < keys.size(); ++k) {
+      std::size_t shard = queue.get_shard(&keys[k]);
+      CHECK(shard < queue.shard_count());
+      CHECK(shard == queue.get_shard(&keys[k]));
+    }
+
+    int first;
+    std::size_t first_shard = queue.get_shard(&keys[0]);
+    CHECK(queue.pop(first_shard, first));
+    CHECK(first == 0);
+
+    // each shard is FIFO, so draining shard by shard preserves key order
+    std::vector<int> last(keys.size(), -1);
+    last[0] = first;
+    queue.drain([&](int& v){
+        std::size_t k = v % keys.size();
+        CHECK(last[k] < v);
+        last[k] = v;
+      });
+
+    CHECK(queue.size() == 0);
+  }
+
+  SUBCASE("values pushed in bulk should be popped in order") {
+    std::vector<int> batch{ 1, 2, 3, 4 };
+    CHECK(queue.push_bulk(2, batch));
+    CHECK(batch.empty());
+    CHECK(queue.size() == 4);
+
+    for(int i = 1; i <= 4; ++i) {
+      int v;
+      CHECK(queue.pop(2, v));
+      CHECK(v == i);
+    }
+  }
+
+  SUBCASE("values should stay in order as a shard wraps around and grows") {
+    int next = 0;
+    int expected = 0;
+    for(int round = 0; round < 50; ++round) {
+      // push more than are popped so the buffer both wraps and grows
+      for(int i = 0; i < round % 7 + 3; ++i) {
+        CHECK(queue.push(1, int{next++}));
+      }
+      for(int i = 0; i < round % 5 + 1; ++i) {
+        int v;
+        CHECK(queue.pop(1, v));
+        CHECK(v == expected++);
+      }
+    }
+
+    std::vector<int> rest;
+    queue.drain([&](int& v){ rest.push_back(v); });
+    CHECK(rest.size() == static_cast<std::size_t>(next - expected));
+    for(int v : rest) {
+      CHECK(v == expected++);
+    }
+    CHECK(queue.size() == 0);
+  }
+
+  SUBCASE("bounded pushes should be rejected once a shard is full") {
+    CHECK(queue.try_push(1, 1, 2));
+    CHECK(queue.try_push(1, 2, 2));
+    CHECK(queue.try_push(1, 3, 2) == false);
+    CHECK(queue.try_push(0, 4, 2));
+    CHECK(queue.size() == 3);
+
+    int v;
+    CHECK(queue.pop(1, v));
+    CHECK(v == 1);
+    CHECK(queue.try_push(1, 5, 2));
+  }
+
+  SUBCASE("workers should be numbered in the order they are added") {
+    for(std::size_t i = 0; i < 2 * queue.shard_count(); ++i) {
+      CHECK(queue.add_worker() == i);
+    }
+  }
+
+  SUBCASE("fewer workers than shards should drain every shard") {
+    const std::size_t worker_count = 3;
+    const int value_count = 1000;
+    std::vector<std::size_t> workers;
+    for(std::size_t i = 0; i < worker_count; ++i) {
+      workers.push_back(queue.add_worker());
+    }
+
+    std::atomic<int> popped{0};
+    std::vector<std::thread> threads;
+    for(std::size_t worker : workers) {
+      threads.emplace_back([&queue, &popped, worker](){
+          int v;
+          while(queue.pop_worker(worker, v)) {
+            ++popped;
+          }
+        });
+    }
+
+    for(int i = 0; i < value_count; ++i) {
+      CHECK(queue.push(queue.get_shard(&keys[i % keys.size()]), int{i}));
+    }
+    for(int i = 0; i < 1000 && popped < value_count; ++i) {
+      std::this_thread::sleep_for(1ms);
+    }
+    CHECK(popped == value_count);
+    CHECK(queue.size() == 0);
+
+    queue.stop();
+    for(std::thread& t : threads) {
+      t.join();
+    }
+  }
+
+  SUBCASE("restarting the queue should forget its workers") {
+    CHECK(queue.add_worker() == 0);
+    queue.stop();
+    queue.start();
+    CHECK(queue.add_worker() == 0);
+
+    // the lone worker of the new run drains every shard
+    for(std::size_t i = 0; i < queue.shard_count(); ++i) {
+      CHECK(queue.push(i, int(i)));
+    }
+    for(std::size_t i = 0; i < queue.shard_count(); ++i) {
+      int v;
+      CHECK(queue.pop_worker(0, v));
+    }
+    CHECK(queue.size() == 0);
+  }
+
+  SUBCASE("workers beyond the shard count should be idle") {
+    for(std::size_t i = 0; i < queue.shard_count(); ++i) {
+      queue.add_worker();
+    }
+    const std::size_t idle = queue.add_worker();
+
+    std::atomic<bool> is_done{false};
+    bool result = true;
+    std::thread worker{[&](){
+        int v;
+        result = queue.pop_worker(idle, v);
+        is_done = true;
+      }};
+
+    CHECK(queue.push(0, 1));
+    std::this_thread::sleep_for(10ms);
+    CHECK(!is_done);
+    CHECK(queue.size() == 1);
+
+    queue.stop();
+    worker.join();
+    CHECK(result == false);
+  }
+
+  SUBCASE("a shard should be held until its worker asks for another value") {
+    CHECK(queue.add_worker() == 0);
+    CHECK(queue.push(1, 1));
+    CHECK(queue.push(1, 2));
+
+    int first;
+    CHECK(queue.pop_worker(0, first));
+    CHECK(first == 1);
+
+    // shard 1 moves to the new worker, which must wait for worker 0
+    CHECK(queue.add_worker() == 1);
+    std::atomic<bool> is_popped{false};
+    std::thread second_worker{[&](){
+        int v;
+        if(queue.pop_worker(1, v)) {
+          CHECK(v == 2);
+          is_popped = true;
+        }
+      }};
+
+    std::this_thread::sleep_for(10ms);
+    CHECK(!is_popped);
+
+    std::thread first_worker{[&](){
+        int v;
+        queue.pop_worker(0, v);
+      }};
+    for(int i = 0; i < 1000 && !is_popped; ++i) {
+      std::this_thread::sleep_for(1ms);
+    }
+    CHECK(is_popped);
+
+    queue.stop();
+    first_worker.join();
+    second_worker.join();
+  }
+
+  SUBCASE("stopping the queue should wake waiting workers") {
+    bool result = true;
+    std::thread worker{[&](){
+        int v;
+        result = queue.pop(0, v);
+      }};
+
+    std::this_thread::sleep_for(10ms);
+    queue.stop();
+    worker.join();
+
+    CHECK(result == false);
+    CHECK(queue.push(0, 1) == false);
+    CHECK(queue.size() == 0);
+  }
+}
@@ -0,0 +1,714 @@
+#include <doctest/doctest.h>
+
+#define DISABLE_PICOJSON
+#include <jwt-cpp/jwt.h>
+
+#include <simple_web_game_server/base_server.hpp>
+#include <json_traits/nlohmann_traits.hpp>
+
+#include <websocketpp_configs/asio_no_logs.hpp>
+#include <websocketpp_configs/asio_client_no_logs.hpp>
+#include <websocketpp/client.hpp>
+
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <string>
+
+#include "constants.hpp"
+#include "test_game.hpp"
+
+// returns the count of the given slow consumer event in the metrics text
+std::size_t slow_consumer_count(
+    const std::string& metrics,
+    const std::string& event
+  )
+{
+  const std::string name =
+    "simple_web_game_server_slow_consumer_events_total{event=\"" + event
+      + "\"} ";
+  std::size_t pos = metrics.find(name);
+  if(pos == std::string::npos) {
+    return 0;
+  }
+  return std::stoul(metrics.substr(pos + name.size()));
+}
+
+TEST_CASE("the base server should bound the messages held for slow clients") {
+  using namespace std::chrono_literals;
+  using combined_id = test_player_traits::id;
+  using claim = jwt::basic_claim<nlohmann_traits>;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using base_server = simple_web_game_server::base_server<
+      test_player_traits,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs,
+      simple_web_game_server::default_close_reasons
+    >;
+  using slow_consumer_policy = simple_web_game_server::slow_consumer_policy;
+  using ws_client = websocketpp::client<asio_client_no_logs>;
+
+  const std::string secret = "secret";
+  const std::string issuer = "jwt-gs-test";
+  const std::size_t message_count = 1000;
+  const std::size_t message_size = 32 * 1024;
+
+  jwt::verifier<jwt::default_clock, nlohmann_traits>
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  // the session result, numbered after every message the tests send
+  const std::size_t result_number = 1000000;
+  base_server server{verifier, [&](const combined_id&, const json&){
+      return std::to_string(result_number);
+    }, 3600s};
+  server.set_write_buffer_limit(64 * 1024);
+
+  std::atomic<bool> is_player_open{false};
+  combined_id player;
+  server.set_open_handler([&](const combined_id& id, json&&){
+      player = id;
+      is_player_open = true;
+    });
+
+  const std::string token = jwt::create<nlohmann_traits>()
+    .set_issuer(issuer)
+    .set_payload_claim("pid", claim(1))
+    .set_payload_claim("sid", claim(1))
+    .set_payload_claim("data", claim(json{}))
+    .sign(jwt::algorithm::hs256{secret});
+
+  // a client that stops reading as soon as it has sent its JWT
+  ws_client client;
+  client.init_asio();
+  // a paused connection leaves no work, so keep run() from returning
+  client.start_perpetual();
+  ws_client::connection_ptr client_con;
+  std::atomic<bool> is_client_closed{false};
+  std::mutex received_lock;
+  std::vector<std::size_t> received;
+
+  auto connect_client = [&](){
+      client.set_open_handler([&](websocketpp::connection_hdl hdl){
+          ws_client::connection_ptr con = client.get_con_from_hdl(hdl);
+          con->send(token, opcode::text);
+          con->pause_reading();
+        });
+      client.set_close_handler([&](websocketpp::connection_hdl){
+          is_client_closed = true;
+        });
+      client.set_message_handler(
+          [&](websocketpp::connection_hdl, ws_client::message_ptr msg){
+            std::lock_guard<std::mutex> guard(received_lock);
+            received.push_back(std::stoul(msg->get_payload()));
+          }
+        );
+
+      websocketpp::lib::error_code ec;
+      client_con = client.get_connection(
+          "ws://localhost:" + std::to_string(SERVER_PORT), ec
+        );
+      REQUIRE(!ec);
+      client.connect(client_con);
+    };
+
+  // sends every message, numbered, to the client
+  auto send_messages = [&](bool droppable){
+      for(std::size_t i = 0; i < message_count; ++i) {
+        std::string msg = std::to_string(i);
+        msg.resize(message_size, ' ');
+        server.send_message(
+            player, std::move(msg), opcode::text, false, droppable
+          );
+      }
+    };
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 1000 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  std::vector<std::thread> threads;
+  auto start = [&](){
+      threads.emplace_back([&](){ server.run(SERVER_PORT, true); });
+      while(!server.is_running()) {
+        std::this_thread::sleep_for(1ms);
+      }
+      threads.emplace_back(&base_server::process_messages, &server);
+
+      connect_client();
+      threads.emplace_back([&](){ client.run(); });
+      REQUIRE(wait_for([&](){ return is_player_open.load(); }));
+    };
+
+  auto finish = [&](){
+      server.stop();
+      client.stop();
+      for(std::thread& t : threads) {
+        t.join();
+      }
+    };
+
+  SUBCASE("a client behind on reliable messages should be closed") {
+    start();
+    send_messages(false);
+
+    CHECK(wait_for([&](){
+        return slow_consumer_count(server.get_metrics(), "closed") == 1;
+      }));
+    const std::string metrics = server.get_metrics();
+    CHECK(slow_consumer_count(metrics, "held") > 0);
+    CHECK(slow_consumer_count(metrics, "dropped") == 0);
+
+    finish();
+  }
+
+  SUBCASE("the oldest droppable messages should be dropped") {
+    server.set_slow_consumer_policy(slow_consumer_policy::drop_oldest, 16);
+    start();
+    send_messages(true);
+
+    CHECK(wait_for([&](){
+        return slow_consumer_count(server.get_metrics(), "dropped") > 0;
+      }));
+    client.get_io_service().post([&](){ client_con->resume_reading(); });
+    CHECK(wait_for([&](){
+        std::lock_guard<std::mutex> guard(received_lock);
+        return !received.empty() && received.back() == message_count - 1;
+      }));
+
+    const std::string metrics = server.get_metrics();
+    CHECK(slow_consumer_count(metrics, "closed") == 0);
+    CHECK(!is_client_closed);
+    {
+      std::lock_guard<std::mutex> guard(received_lock);
+      CHECK(received.size() < message_count);
+      CHECK(std::is_sorted(received.begin(), received.end()));
+    }
+
+    finish();
+  }
+
+  SUBCASE("held droppable messages should be coalesced into the newest") {
+    server.set_slow_consumer_policy(slow_consumer_policy::coalesce, 16);
+    start();
+    send_messages(true);
+
+    CHECK(wait_for([&](){
+        return slow_consumer_count(server.get_metrics(), "coalesced") > 0;
+      }));
+    client.get_io_service().post([&](){ client_con->resume_reading(); });
+    CHECK(wait_for([&](){
+        std::lock_guard<std::mutex> guard(received_lock);
+        return !received.empty() && received.back() == message_count - 1;
+      }));
+
+    const std::string metrics = server.get_metrics();
+    CHECK(slow_consumer_count(metrics, "closed") == 0);
+    CHECK(slow_consumer_count(metrics, "dropped") == 0);
+    {
+      std::lock_guard<std::mutex> guard(received_lock);
+      CHECK(received.size() < message_count);
+      CHECK(std::is_sorted(received.begin(), received.end()));
+    }
+
+    finish();
+  }
+
+  SUBCASE("the session result should be the last message held") {
+    start();
+    const std::size_t before_count = 64;
+    for(std::size_t i = 0; i < before_count; ++i) {
+      std::string msg = std::to_string(i);
+      msg.resize(message_size, ' ');
+      server.send_message(player, std::move(msg), opcode::text, false);
+    }
+    CHECK(wait_for([&](){
+        return slow_consumer_count(server.get_metrics(), "held") > 0;
+      }));
+
+    server.complete_session(player.session, player.session, json{});
+
+    // sent once the result is held, so never written
+    for(std::size_t i = before_count; i < 2 * before_count; ++i) {
+      server.send_message(player, std::to_string(i), opcode::text, false);
+    }
+
+    client.get_io_service().post([&](){ client_con->resume_reading(); });
+    CHECK(wait_for([&](){ return is_client_closed.load(); }));
+    {
+      std::lock_guard<std::mutex> guard(received_lock);
+      REQUIRE(!received.empty());
+      CHECK(received.back() == result_number);
+      CHECK(received.size() == before_count + 1);
+    }
+
+    finish();
+  }
+
+  SUBCASE("held keyed messages should be replaced by the newest") {
+    // the reliable messages alone fit the budget, so the client is only
+    // kept open if the keyed messages are conflated
+    server.set_slow_consumer_policy(slow_consumer_policy::close, 16);
+    start();
+
+    const std::size_t reliable_interval = 100;
+    for(std::size_t i = 0; i < message_count; ++i) {
+      std::string msg = std::to_string(i);
+      msg.resize(message_size, ' ');
+      if(i % reliable_interval == 0) {
+        server.send_message(player, std::move(msg), opcode::text, false);
+      } else {
+        server.send_message(
+            player, std::move(msg), opcode::text, false, false, 1
+          );
+      }
+    }
+
+    CHECK(wait_for([&](){
+        return slow_consumer_count(server.get_metrics(), "conflated") > 0;
+      }));
+    client.get_io_service().post([&](){ client_con->resume_reading(); });
+    CHECK(wait_for([&](){
+        std::lock_guard<std::mutex> guard(received_lock);
+        return !received.empty() && received.back() == message_count - 1;
+      }));
+
+    const std::string metrics = server.get_metrics();
+    CHECK(slow_consumer_count(metrics, "closed") == 0);
+    CHECK(!is_client_closed);
+    {
+      std::lock_guard<std::mutex> guard(received_lock);
+      CHECK(received.size() < message_count);
+      CHECK(std::is_sorted(received.begin(), received.end()));
+      for(std::size_t i = 0; i < message_count; i += reliable_interval) {
+        CHECK(std::find(received.begin(), received.end(), i)
+          != received.end());
+      }
+    }
+
+    finish();
+  }
+}
+
+// a JWT clock that runs offset from the system clock, and blocks token
+// verification until the gate is opened
+struct test_clock {
+  static inline std::atomic<bool> is_open{true};
+  static inline std::atomic<long long> offset_seconds{0};
+
+  jwt::date now() const {
+    while(!is_open) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return jwt::date::clock::now() + std::chrono::seconds{offset_seconds};
+  }
+};
+
+TEST_CASE("the base server should bound messages held during verification") {
+  using namespace std::chrono_literals;
+  using combined_id = test_player_traits::id;
+  using claim = jwt::basic_claim<nlohmann_traits>;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using base_server = simple_web_game_server::base_server<
+      test_player_traits,
+      test_clock,
+      nlohmann_traits,
+      asio_no_logs,
+      simple_web_game_server::default_close_reasons
+    >;
+  using ws_client = websocketpp::client<asio_client_no_logs>;
+
+  const std::string secret = "secret";
+  const std::string issuer = "jwt-gs-test";
+  const std::size_t pending_limit = 4;
+
+  jwt::verifier<test_clock, nlohmann_traits> verifier(test_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  base_server server{verifier, [](const combined_id&, const json&){
+      return std::string{};
+    }, 3600s};
+  server.set_pending_message_limit(pending_limit, 64 * 1024);
+
+  std::atomic<bool> is_player_open{false};
+  server.set_open_handler([&](const combined_id&, json&&){
+      is_player_open = true;
+    });
+  std::atomic<std::size_t> handled{0};
+  server.set_message_handler([&](const combined_id&, std::string&&){
+      ++handled;
+    });
+
+  const std::string token = jwt::create<nlohmann_traits>()
+    .set_issuer(issuer)
+    .set_payload_claim("pid", claim(1))
+    .set_payload_claim("sid", claim(1))
+    .set_payload_claim("data", claim(json{}))
+    .sign(jwt::algorithm::hs256{secret});
+
+  ws_client client;
+  client.init_asio();
+  ws_client::connection_ptr client_con;
+  std::atomic<bool> is_client_closed{false};
+
+  // sends the JWT followed by the given number of messages
+  auto connect_client = [&](std::size_t message_count,
+      const std::string& login_token)
+    {
+      client.set_open_handler(
+          [&, message_count, login_token](websocketpp::connection_hdl hdl){
+            ws_client::connection_ptr con = client.get_con_from_hdl(hdl);
+            con->send(login_token, opcode::text);
+            for(std::size_t i = 0; i < message_count; ++i) {
+              con->send(std::to_string(i), opcode::text);
+            }
+          }
+        );
+      client.set_close_handler([&](websocketpp::connection_hdl){
+          is_client_closed = true;
+        });
+
+      websocketpp::lib::error_code ec;
+      client_con = client.get_connection(
+          "ws://localhost:" + std::to_string(SERVER_PORT), ec
+        );
+      REQUIRE(!ec);
+      client.connect(client_con);
+    };
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 1000 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  test_clock::is_open = false;
+
+  std::vector<std::thread> threads;
+  threads.emplace_back([&](){ server.run(SERVER_PORT, true); });
+  while(!server.is_running()) {
+    std::this_thread::sleep_for(1ms);
+  }
+  threads.emplace_back(&base_server::process_messages, &server);
+  threads.emplace_back(&base_server::process_verifications, &server);
+
+  SUBCASE("messages within the limit should be handled once verified") {
+    connect_client(pending_limit, token);
+    threads.emplace_back([&](){ client.run(); });
+
+    // let the messages reach the server before the token is verified
+    std::this_thread::sleep_for(50ms);
+    CHECK(!is_player_open);
+    test_clock::is_open = true;
+
+    CHECK(wait_for([&](){ return handled.load() == pending_limit; }));
+    CHECK(is_player_open);
+    CHECK(!is_client_closed);
+  }
+
+  SUBCASE("a client exceeding the limit should be closed") {
+    connect_client(pending_limit + 1, token);
+    threads.emplace_back([&](){ client.run(); });
+
+    CHECK(wait_for([&](){ return is_client_closed.load(); }));
+    CHECK(client_con->get_remote_close_reason()
+      == simple_web_game_server::default_close_reasons::pending_overflow());
+
+    // the token result for the closed connection is ignored
+    test_clock::is_open = true;
+    std::this_thread::sleep_for(50ms);
+    CHECK(!is_player_open);
+    CHECK(handled == 0);
+    CHECK(server.get_player_count() == 0);
+  }
+
+  SUBCASE("messages held for a rejected token should be dropped") {
+    const std::string forged_token = jwt::create<nlohmann_traits>()
+      .set_issuer(issuer)
+      .set_payload_claim("pid", claim(1))
+      .set_payload_claim("sid", claim(1))
+      .set_payload_claim("data", claim(json{}))
+      .sign(jwt::algorithm::hs256{"forged"});
+    connect_client(pending_limit, forged_token);
+    threads.emplace_back([&](){ client.run(); });
+
+    std::this_thread::sleep_for(50ms);
+    test_clock::is_open = true;
+
+    CHECK(wait_for([&](){ return is_client_closed.load(); }));
+    CHECK(client_con->get_remote_close_reason()
+      == simple_web_game_server::default_close_reasons::invalid_jwt());
+    CHECK(server.get_metrics().find(
+        "simple_web_game_server_actions_total{type=\"token_rejected\"} 1"
+      ) != std::string::npos);
+    CHECK(!is_player_open);
+    CHECK(handled == 0);
+  }
+
+  test_clock::is_open = true;
+  server.stop();
+  client.stop();
+  for(std::thread& t : threads) {
+    t.join();
+  }
+}
+
+TEST_CASE("the base server should expire cached tokens by the JWT clock") {
+  using namespace std::chrono_literals;
+  using combined_id = test_player_traits::id;
+  using claim = jwt::basic_claim<nlohmann_traits>;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using base_server = simple_web_game_server::base_server<
+      test_player_traits,
+      test_clock,
+      nlohmann_traits,
+      asio_no_logs,
+      simple_web_game_server::default_close_reasons
+    >;
+  using ws_client = websocketpp::client<asio_client_no_logs>;
+
+  const std::string secret = "secret";
+  const std::string issuer = "jwt-gs-test";
+
+  jwt::verifier<test_clock, nlohmann_traits> verifier(test_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  base_server server{verifier, [](const combined_id&, const json&){
+      return std::string{};
+    }, 3600s};
+  server.set_token_cache_size(16);
+
+  std::atomic<std::size_t> open_count{0};
+  std::atomic<std::size_t> close_count{0};
+  server.set_open_handler([&](const combined_id&, json&&){ ++open_count; });
+  server.set_close_handler([&](const combined_id&){ ++close_count; });
+
+  const std::string token = jwt::create<nlohmann_traits>()
+    .set_issuer(issuer)
+    .set_expires_at(std::chrono::system_clock::now() + 1h)
+    .set_payload_claim("pid", claim(1))
+    .set_payload_claim("sid", claim(1))
+    .set_payload_claim("data", claim(json{}))
+    .sign(jwt::algorithm::hs256{secret});
+
+  ws_client client;
+  client.init_asio();
+  client.start_perpetual();
+  client.set_open_handler([&](websocketpp::connection_hdl hdl){
+      client.get_con_from_hdl(hdl)->send(token, opcode::text);
+    });
+
+  // connects with the token and returns the connection
+  auto connect_client = [&](){
+      websocketpp::lib::error_code ec;
+      ws_client::connection_ptr con = client.get_connection(
+          "ws://localhost:" + std::to_string(SERVER_PORT), ec
+        );
+      REQUIRE(!ec);
+      client.connect(con);
+      return con;
+    };
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 1000 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  test_clock::offset_seconds = 0;
+
+  std::vector<std::thread> threads;
+  threads.emplace_back([&](){ server.run(SERVER_PORT, true); });
+  while(!server.is_running()) {
+    std::this_thread::sleep_for(1ms);
+  }
+  threads.emplace_back(&base_server::process_messages, &server);
+  threads.emplace_back([&](){ client.run(); });
+
+  // log in twice, the second time from the cache
+  for(std::size_t i = 1; i <= 2; ++i) {
+    ws_client::connection_ptr con = connect_client();
+    CHECK(wait_for([&](){ return open_count.load() == i; }));
+    con->close(websocketpp::close::status::normal, "");
+    CHECK(wait_for([&](){ return close_count.load() == i; }));
+  }
+  CHECK(server.get_verification_stats().cache_hits == 1);
+
+  // the token has expired by the JWT clock, though not the system clock
+  test_clock::offset_seconds = 7200;
+  connect_client();
+  CHECK(wait_for([&](){
+      return server.get_verification_stats().rejected == 1;
+    }));
+
+  base_server::verification_stats stats = server.get_verification_stats();
+  CHECK(stats.cache_hits == 1);
+  CHECK(stats.verified == 2);
+  CHECK(open_count == 2);
+
+  test_clock::offset_seconds = 0;
+  server.stop();
+  client.stop_perpetual();
+  client.stop();
+  for(std::thread& t : threads) {
+    t.join();
+  }
+}
+
+TEST_CASE("the base server should keep each client's messages in order") {
+  using namespace std::chrono_literals;
+  using combined_id = test_player_traits::id;
+  using claim = jwt::basic_claim<nlohmann_traits>;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using base_server = simple_web_game_server::base_server<
+      test_player_traits,
+      test_clock,
+      nlohmann_traits,
+      asio_no_logs,
+      simple_web_game_server::default_close_reasons
+    >;
+  using ws_client = websocketpp::client<asio_client_no_logs>;
+
+  const std::string secret = "secret";
+  const std::string issuer = "jwt-gs-test";
+  const std::size_t shard_count = 4;
+  const std::size_t client_count = 8;
+  const std::size_t message_count = 200;
+
+  jwt::verifier<test_clock, nlohmann_traits> verifier(test_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  base_server server{verifier, [](const combined_id&, const json&){
+      return std::string{};
+    }, 3600s};
+  server.set_action_shard_count(shard_count);
+  server.set_pending_message_limit(message_count, 64 * 1024);
+
+  // the messages handled for each player, in the order handled
+  std::mutex received_lock;
+  std::vector<std::vector<std::size_t>> received;
+  std::atomic<std::size_t> handled{0};
+  server.set_message_handler([&](const combined_id& id, std::string&& msg){
+      std::lock_guard<std::mutex> guard(received_lock);
+      received[id.player].push_back(std::stoul(msg));
+      ++handled;
+    });
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 1000 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  // connects each client, which sends its JWT and then numbered messages
+  auto run_clients = [&](std::size_t worker_count,
+      std::size_t verifier_count = 0)
+    {
+      received.assign(client_count, {});
+      handled = 0;
+
+      std::vector<std::thread> threads;
+      threads.emplace_back([&](){ server.run(SERVER_PORT, true); });
+      while(!server.is_running()) {
+        std::this_thread::sleep_for(1ms);
+      }
+      for(std::size_t i = 0; i < worker_count; ++i) {
+        threads.emplace_back(&base_server::process_messages, &server);
+      }
+      for(std::size_t i = 0; i < verifier_count; ++i) {
+        threads.emplace_back(&base_server::process_verifications, &server);
+      }
+
+      ws_client client;
+      client.init_asio();
+      client.start_perpetual();
+      threads.emplace_back([&](){ client.run(); });
+
+      for(std::size_t player = 0; player < client_count; ++player) {
+        const std::string token = jwt::create<nlohmann_traits>()
+          .set_issuer(issuer)
+          .set_payload_claim("pid", claim(player))
+          .set_payload_claim("sid", claim(std::size_t{1}))
+          .set_payload_claim("data", claim(json{}))
+          .sign(jwt::algorithm::hs256{secret});
+
+        websocketpp::lib::error_code ec;
+        ws_client::connection_ptr con = client.get_connection(
+            "ws://localhost:" + std::to_string(SERVER_PORT), ec
+          );
+        REQUIRE(!ec);
+        con->set_open_handler([&, token](websocketpp::connection_hdl hdl){
+            ws_client::connection_ptr con = client.get_con_from_hdl(hdl);
+            con->send(token, opcode::text);
+            for(std::size_t i = 0; i < message_count; ++i) {
+              con->send(std::to_string(i), opcode::text);
+            }
+          });
+        client.connect(con);
+      }
+
+      // release any held verifications while the messages arrive
+      test_clock::is_open = true;
+
+      CHECK(wait_for([&](){
+          return handled.load() == client_count * message_count;
+        }));
+      {
+        std::lock_guard<std::mutex> guard(received_lock);
+        for(const std::vector<std::size_t>& messages : received) {
+          CHECK(messages.size() == message_count);
+          for(std::size_t i = 0; i < messages.size(); ++i) {
+            CHECK(messages[i] == i);
+          }
+        }
+      }
+
+      // the client answers the closing handshakes before its loop returns
+      server.stop();
+      client.stop_perpetual();
+      for(std::thread& t : threads) {
+        t.join();
+      }
+      server.reset();
+    };
+
+  SUBCASE("with a thread for each shard") {
+    run_clients(shard_count);
+  }
+
+  SUBCASE("with fewer threads than shards") {
+    run_clients(shard_count - 1);
+  }
+
+  SUBCASE("with more threads than shards") {
+    run_clients(shard_count + 2);
+  }
+
+  SUBCASE("with messages held while tokens are verified") {
+    test_clock::is_open = false;
+    run_clients(shard_count, 2);
+  }
+
+  SUBCASE("after the server is restarted") {
+    run_clients(shard_count);
+    run_clients(shard_count - 1);
+  }
+}
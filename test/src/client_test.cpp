@@ -7,12 +7,18 @@
 #include <jwt-cpp/jwt.h>
 
 #include <simple_web_game_server/client.hpp>
+#include <simple_web_game_server/multiplex_client.hpp>
 
 #include <websocketpp/server.hpp>
 #include <websocketpp_configs/asio_no_logs.hpp>
 #include <websocketpp_configs/asio_client_no_logs.hpp>
 
 #include <atomic>
+#include <map>
+#include <set>
+#include <memory>
+#include <vector>
+#include <string>
 #include <thread>
 #include <functional>
 #include <sstream>
@@ -57,7 +63,7 @@ TEST_CASE("the base client should interact with a websocket server") {
       messages.push_back(last_message);
     }
 
-    bool conn_open;
+    bool conn_open = false;
     connection_hdl client_hdl; 
     std::vector<std::string> messages;
     std::string last_message;
@@ -194,6 +200,73 @@ TEST_CASE("the base client should interact with a websocket server") {
     client_thr.join();
   }
 
+  SUBCASE("the client should queue asynchronous sends with backpressure") {
+    std::atomic<std::size_t> sent{0};
+    std::atomic<bool> drained{false};
+    client.set_send_queue_limit(4);
+    client.set_high_water_mark(1);
+    client.set_drain_handler([&drained](){ drained = true; });
+
+    std::thread client_thr{
+        std::bind(&ws_client::connect, &client, uri, "1234")
+      };
+
+    while(!client.is_running() && !client.has_failed()) {
+      std::this_thread::sleep_for(10ms);
+    }
+
+    // messages queued before the connection opens follow the JWT
+    auto on_sent = [&sent](bool s){ if(s) { ++sent; } };
+    client.async_send("first", websocketpp::frame::opcode::text, on_sent);
+    CHECK_THROWS_AS(
+        client.set_high_water_mark(100),
+        ws_client::client_error
+      );
+    std::this_thread::sleep_for(100ms);
+
+    CHECK(server_data.messages == std::vector<std::string>{ "1234", "first" });
+    CHECK(sent == 1);
+
+    // a burst beyond the queue limit is partly refused, and the rest is
+    // delivered in order
+    std::vector<std::string> expected = server_data.messages;
+    std::size_t full = 0;
+    for(int i = 0; i < 20; i++) {
+      std::string msg = std::to_string(i);
+      if(client.async_send(msg, websocketpp::frame::opcode::text, on_sent)
+          == ws_client::push_result::full)
+      {
+        ++full;
+      } else {
+        expected.push_back(msg);
+      }
+    }
+    std::this_thread::sleep_for(100ms);
+
+    CHECK(server_data.messages == expected);
+    CHECK(sent == expected.size() - 1);
+    CHECK(client.get_queued_amount() == 0);
+    if(full > 0) {
+      CHECK(drained == true);
+    }
+    CHECK(oss.str() == std::string{""});
+
+    if(client.is_running()) {
+      client.disconnect();
+    }
+
+    while(client.is_running() && !client.has_failed()) {
+      std::this_thread::sleep_for(10ms);
+    }
+    std::this_thread::sleep_for(100ms);
+
+    CHECK_THROWS_AS(
+        client.async_send("closed"),
+        ws_client::client_error
+      );
+    client_thr.join();
+  }
+
   SUBCASE("the client should be able to bind a function to handle open") { 
     struct test_client_data {
       void on_open() {
@@ -406,3 +479,179 @@ TEST_CASE("the base client should interact with a websocket server") {
   server.stop_listening();
   server_thr.join();
 }
+
+TEST_CASE("the multiplex client should run many connections on one thread") {
+  using namespace std::chrono_literals;
+
+  using ws_server = websocketpp::server<asio_no_logs>;
+
+  using message_ptr = typename ws_server::message_ptr;
+  using connection_hdl = websocketpp::connection_hdl;
+
+  using mux_client = simple_web_game_server::multiplex_client<
+      asio_client_no_logs
+    >;
+  using connection_id = mux_client::connection_id;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  // the server records the first message of each connection as its token
+  // and echoes the rest; its handlers all run on the server thread
+  std::map<connection_hdl, bool, std::owner_less<connection_hdl> > has_token;
+  std::set<std::string> tokens;
+  std::atomic<std::size_t> server_open{0};
+
+  ws_server server;
+  server.init_asio();
+  server.set_reuse_addr(true);
+  server.set_open_handler([&](connection_hdl hdl){
+      has_token[hdl] = false;
+      ++server_open;
+    });
+  server.set_close_handler([&](connection_hdl hdl){
+      has_token.erase(hdl);
+      --server_open;
+    });
+  server.set_message_handler([&](connection_hdl hdl, message_ptr msg){
+      if(!has_token[hdl]) {
+        has_token[hdl] = true;
+        tokens.insert(msg->get_payload());
+      } else {
+        server.send(hdl, msg->get_payload(), msg->get_opcode());
+      }
+    });
+
+  server.listen(SERVER_PORT);
+  server.start_accept();
+  std::thread server_thr{std::bind(&ws_server::run, &server)};
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  const std::size_t connection_count = 100;
+
+  std::atomic<std::size_t> opened{0};
+  std::atomic<std::size_t> closed{0};
+  std::atomic<std::size_t> echoes{0};
+  std::atomic<std::size_t> wrong_echoes{0};
+
+  // each connection says hello with its index once open, and checks that
+  // only its own hello is echoed back to it
+  auto connect_all = [&](mux_client& client) {
+      std::vector<connection_id> ids(connection_count);
+      for(std::size_t i = 0; i < connection_count; i++) {
+        const std::string hello = "hello " + std::to_string(i);
+        mux_client::handlers h;
+        h.open = [&, hello](connection_id id){
+            ++opened;
+            client.send(id, hello);
+          };
+        h.close = [&](connection_id id){ ++closed; };
+        h.message = [&, hello](connection_id id, const std::string& msg){
+            if(msg == hello) {
+              ++echoes;
+            } else {
+              ++wrong_echoes;
+            }
+          };
+        ids[i] = client.connect(uri, "token " + std::to_string(i), h);
+      }
+      return ids;
+    };
+
+  auto wait_for = [](std::function<bool()> done) {
+      auto deadline = std::chrono::steady_clock::now() + 5s;
+      while(!done() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(10ms);
+      }
+    };
+
+  SUBCASE("the client should drive every connection from its run thread") {
+    mux_client client;
+    std::thread client_thr{[&client](){ client.run(); }};
+
+    std::vector<connection_id> ids = connect_all(client);
+    wait_for([&](){ return echoes == connection_count; });
+
+    CHECK(opened == connection_count);
+    CHECK(echoes == connection_count);
+    CHECK(wrong_echoes == 0);
+    CHECK(client.connection_count() == connection_count);
+    CHECK(client.is_open(ids.front()) == true);
+    CHECK(tokens.size() == connection_count);
+    CHECK(tokens.count("token 0") == 1);
+
+    client.disconnect(ids.front());
+    wait_for([&](){ return closed == 1; });
+    CHECK(client.is_open(ids.front()) == false);
+    CHECK_THROWS_AS(
+        client.send(ids.front(), "closed"),
+        mux_client::client_error
+      );
+
+    // shutting down closes every connection, so run returns
+    client.shutdown();
+    client_thr.join();
+
+    CHECK(closed == connection_count);
+    CHECK(client.connection_count() == 0);
+    CHECK_THROWS_AS(
+        client.connect(uri, "late", mux_client::handlers{}),
+        mux_client::client_error
+      );
+  }
+
+  SUBCASE("the client should run on an io_context supplied by the caller") {
+    mux_client::io_context ios;
+    mux_client client{ios};
+
+    std::vector<std::thread> pool;
+    for(int i = 0; i < 2; i++) {
+      pool.emplace_back([&ios](){ ios.run(); });
+    }
+
+    connect_all(client);
+    wait_for([&](){ return echoes == connection_count; });
+
+    CHECK(echoes == connection_count);
+    CHECK(wrong_echoes == 0);
+
+    client.shutdown();
+    for(std::thread& t : pool) {
+      t.join();
+    }
+
+    CHECK(closed == connection_count);
+  }
+
+  SUBCASE("a connection that cannot open should call its fail handler") {
+    mux_client client;
+    std::thread client_thr{[&client](){ client.run(); }};
+
+    std::atomic<bool> failed{false};
+    mux_client::handlers h;
+    h.fail = [&](connection_id id){ failed = true; };
+    client.connect("ws://localhost:1", "token", h);
+    wait_for([&](){ return failed.load(); });
+
+    CHECK(failed == true);
+    CHECK(client.connection_count() == 0);
+    CHECK_THROWS_AS(
+        client.connect("not a uri", "token", mux_client::handlers{}),
+        mux_client::client_error
+      );
+
+    client.shutdown();
+    client_thr.join();
+  }
+
+  wait_for([&](){ return server_open == 0; });
+  CHECK(oss.str() == std::string{""});
+
+  server.stop_listening();
+  server_thr.join();
+}
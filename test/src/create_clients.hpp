@@ -2,6 +2,8 @@
 #define CREATE_CLIENTS_HPP
 
 #include <vector>
+#include <atomic>
+#include <memory>
 #include <chrono>
 #include <functional>
 #include <thread>
@@ -28,15 +30,22 @@ inline void create_clients(
   using std::placeholders::_1;
   using std::placeholders::_2;
 
+  // a client may open and be closed by the server before is_running is
+  // polled, so also wait on the open handler
+  std::vector<std::shared_ptr<std::atomic<bool> > > opened;
   for(std::size_t i = 0; i < player_count; i++) {
     clients.push_back(game_client{});
     client_data_list.push_back(client_data{});
+    opened.push_back(std::make_shared<std::atomic<bool> >(false));
   }
 
   for(std::size_t i = 0; i < player_count; i++) {
     auto open_handler = std::bind(&client_data::on_open,
         &(client_data_list[i]));
-    clients[i].set_open_handler(open_handler);
+    clients[i].set_open_handler([open_handler, opened = opened[i]](){
+        *opened = true;
+        open_handler();
+      });
     auto close_handler = std::bind(&client_data::on_close,
         &(client_data_list[i]));
     clients[i].set_close_handler(close_handler);
@@ -50,7 +59,7 @@ inline void create_clients(
         std::bind(&game_client::connect, &(clients[i]), uri, tokens[i])
       };
 
-    while(!clients[i].is_running()) {
+    while(!clients[i].is_running() && !*opened[i]) {
       std::this_thread::sleep_for(1ms);
     }
     std::this_thread::sleep_for(std::chrono::milliseconds(wait_time));
@@ -8,20 +8,54 @@
 
 #include <simple_web_game_server/game_server.hpp>
 #include <simple_web_game_server/client.hpp>
+#include <simple_web_game_server/message_batch.hpp>
 #include <json_traits/nlohmann_traits.hpp>
+#include <codec_traits/nlohmann_codecs.hpp>
 
 #include <websocketpp_configs/asio_no_logs.hpp>
 #include <websocketpp_configs/asio_client_no_logs.hpp>
+#include <websocketpp_configs/asio_deflate_no_logs.hpp>
+#include <websocketpp_configs/asio_client_deflate_no_logs.hpp>
 
 #include <thread>
+#include <mutex>
+#include <vector>
+#include <utility>
 #include <functional>
 #include <sstream>
 #include <chrono>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 
 #include "constants.hpp"
 #include "create_clients.hpp"
 #include "test_game.hpp"
 
+// count the allocations made by each thread while the steady state
+// allocation test below sets is_counting_allocations
+std::atomic<bool> is_counting_allocations{false};
+thread_local std::size_t thread_allocation_count = 0;
+
+void* operator new(std::size_t size) {
+  if(is_counting_allocations.load(std::memory_order_relaxed)) {
+    ++thread_allocation_count;
+  }
+  if(void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
 // create JWTs for games between the given players
 // assumes that player_list.size() is divisible by GAME_SIZE
 void create_game_tokens(
@@ -212,6 +246,48 @@ TEST_CASE("players should interact with the server with no errors") {
     CHECK(oss.str() == std::string{""});
   }
 
+  SUBCASE("other games should keep running when a game ends") {
+    std::vector<player_id> player_list = { 12, 4005, 77, 310 };
+    PLAYER_COUNT = player_list.size();
+    const std::size_t GAME_SIZE = 1;
+    
+    create_game_tokens(tokens, player_list, secret, issuer, GAME_SIZE);
+
+    create_clients<player_id, game_client, test_client_data>(
+        clients, client_data_list, client_threads, tokens, uri, PLAYER_COUNT
+      );
+
+    std::this_thread::sleep_for(200ms + 20ms * PLAYER_COUNT);
+
+    // end a game from the middle of the game list
+    clients[1].send(json{ { "type", "stop" } }.dump());
+
+    std::this_thread::sleep_for(200ms + 20ms * PLAYER_COUNT);
+
+    CHECK(clients[1].is_running() == false);
+    CHECK(gs.get_game_count() == PLAYER_COUNT - 1);
+
+    json msg = { { "type", "echo" } };
+    for(std::size_t i = 0; i < PLAYER_COUNT; i++) {
+      if(i != 1) {
+        clients[i].send(msg.dump());
+      }
+    }
+
+    std::this_thread::sleep_for(200ms + 20ms * PLAYER_COUNT);
+
+    for(std::size_t i = 0; i < PLAYER_COUNT; i++) {
+      if(i != 1) {
+        CHECK(client_data_list[i].messages.size() == 1);
+        if(client_data_list[i].messages.size() > 0) {
+          CHECK(client_data_list[i].messages.back() == msg.dump());
+        }
+      }
+    }
+
+    CHECK(oss.str() == std::string{""});
+  }
+
   SUBCASE("only most recent client with a given token id should remain open") {
     player_id pid = 84;
     session_id sid = 192;
@@ -362,6 +438,42 @@ TEST_CASE("players should interact with the server with no errors") {
     CHECK(oss.str() == std::string{""}); 
   }
 
+  SUBCASE("broadcasts should be sent to every player in the session") {
+    std::vector<player_id> player_list = { 61, 7240, 918, 5, 33, 1207 };
+    PLAYER_COUNT = player_list.size();
+    const std::size_t GAME_SIZE = 3;
+
+    create_game_tokens(tokens, player_list, secret, issuer, GAME_SIZE);
+
+    create_clients<player_id, game_client, test_client_data>(
+        clients, client_data_list, client_threads, tokens, uri, PLAYER_COUNT
+      );
+
+    std::this_thread::sleep_for(100ms + 20ms * PLAYER_COUNT);
+
+    json msg = { { "type", "broadcast" }, { "data", "hello" } };
+    clients[1].send(msg.dump());
+
+    std::this_thread::sleep_for(100ms + 20ms * PLAYER_COUNT);
+
+    std::string expected = json{
+        { "pid", player_list[1] }, { "data", "hello" }
+      }.dump();
+
+    for(std::size_t i = 0; i < PLAYER_COUNT; i++) {
+      if(i < GAME_SIZE) {
+        CHECK(client_data_list[i].messages.size() == 1);
+        if(client_data_list[i].messages.size() > 0) {
+          CHECK(client_data_list[i].messages.back() == expected);
+        }
+      } else {
+        CHECK(client_data_list[i].messages.size() == 0);
+      }
+    }
+
+    CHECK(oss.str() == std::string{""});
+  }
+
   // end of test cleanup
 
   for(std::size_t i = 0; i < PLAYER_COUNT; i++) {
@@ -388,3 +500,1471 @@ TEST_CASE("players should interact with the server with no errors") {
   game_thr.join();
   server_thr.join();
 }
+
+TEST_CASE("tokens should be verified by the verification pool and cache") {
+  using namespace std::chrono_literals;
+
+  using game_client = simple_web_game_server::client<
+      asio_client_no_logs
+    >;
+
+  using game_server = simple_web_game_server::game_server<
+      test_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+
+  struct test_client_data {
+    test_client_data() : is_connected(false) {}
+
+    void on_open() {
+      is_connected = true;
+    }
+    void on_close() {
+      is_connected = false;
+    }
+    void on_message(const std::string& message) {}
+
+    bool is_connected;
+  };
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+  using session_id = combined_id::session_id;
+  using claim = jwt::basic_claim<nlohmann_traits>;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  gs.set_token_cache_size(16);
+  gs.set_update_threads(2);
+
+  std::size_t PLAYER_COUNT;
+  std::vector<game_client> clients;
+  std::vector<test_client_data> client_data_list;
+  std::vector<std::thread> client_threads;
+  std::vector<std::string> tokens;
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread verify_thr{bind(&game_server::process_verifications, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  SUBCASE("games should start once the pool verifies their players") {
+    std::vector<player_id> player_list = { 83, 2, 17, 339 };
+    PLAYER_COUNT = player_list.size();
+    const std::size_t GAME_SIZE = 2;
+
+    create_game_tokens(tokens, player_list, secret, issuer, GAME_SIZE);
+
+    create_clients<player_id, game_client, test_client_data>(
+        clients, client_data_list, client_threads, tokens, uri, PLAYER_COUNT
+      );
+
+    std::this_thread::sleep_for(100ms + 10ms * PLAYER_COUNT);
+
+    CHECK(gs.get_player_count() == PLAYER_COUNT);
+    CHECK(gs.get_game_count() == PLAYER_COUNT / GAME_SIZE);
+
+    game_server::verification_stats stats = gs.get_verification_stats();
+    CHECK(stats.verified == PLAYER_COUNT);
+    CHECK(stats.rejected == 0);
+    CHECK(stats.dropped == 0);
+    CHECK(stats.queue_size == 0);
+    CHECK(stats.cache_hits == 0);
+    CHECK(stats.max_latency >= stats.mean_latency);
+  }
+
+  SUBCASE("a repeated token should only be verified once") {
+    PLAYER_COUNT = 3;
+    std::string token = jwt::create<nlohmann_traits>()
+      .set_issuer(issuer)
+      .set_payload_claim("pid", claim(player_id{84}))
+      .set_payload_claim("sid", claim(session_id{192}))
+      .set_payload_claim("data", claim(json{ { "matched", true } }))
+      .set_expires_at(std::chrono::system_clock::now() + 60s)
+      .sign(jwt::algorithm::hs256{secret});
+    tokens.assign(PLAYER_COUNT, token);
+
+    create_clients<player_id, game_client, test_client_data>(
+        clients, client_data_list, client_threads, tokens, uri, PLAYER_COUNT, 20
+      );
+
+    std::this_thread::sleep_for(200ms + 20ms * PLAYER_COUNT);
+
+    CHECK(gs.get_player_count() == 1);
+    CHECK(client_data_list.back().is_connected == true);
+
+    game_server::verification_stats stats = gs.get_verification_stats();
+    CHECK(stats.verified == PLAYER_COUNT);
+    CHECK(stats.cache_hits == PLAYER_COUNT - 1);
+  }
+
+  for(std::size_t i = 0; i < PLAYER_COUNT; i++) {
+    try {
+      clients[i].disconnect();
+    } catch(game_client::client_error& e) {}
+  }
+
+  for(std::size_t i = 0; i < PLAYER_COUNT; i++) {
+    client_threads[i].join();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  verify_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+TEST_CASE("binary messages should be passed through to games") {
+  using namespace std::chrono_literals;
+
+  using game_client = simple_web_game_server::client<
+      asio_client_no_logs
+    >;
+
+  using game_server = simple_web_game_server::game_server<
+      test_binary_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  std::vector<player_id> player_list = { 4, 92 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 2);
+
+  // a payload that is not valid UTF-8, so could not be sent as text
+  const std::string payload{ '\x00', '\xff', '\x80', '\x01' };
+
+  std::vector<std::vector<std::string> > text(2), binary(2);
+  std::vector<game_client> clients(2);
+  std::vector<std::thread> client_threads;
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].set_message_handler([&text, i](const std::string& msg){
+        text[i].push_back(msg);
+      });
+    clients[i].set_binary_message_handler([&binary, i](const std::string& msg){
+        binary[i].push_back(msg);
+      });
+    client_threads.emplace_back(
+        bind(&game_client::connect, &clients[i], uri, tokens[i])
+      );
+    while(!clients[i].is_running()) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+
+  std::this_thread::sleep_for(200ms);
+
+  clients[0].send("hello");
+  clients[0].send_binary(payload);
+
+  std::this_thread::sleep_for(200ms);
+
+  // the text message is echoed as text, the binary message is echoed and
+  // broadcast as binary
+  CHECK(text[0] == std::vector<std::string>{ "hello" });
+  CHECK(binary[0] == std::vector<std::string>{ payload, payload });
+  CHECK(text[1].empty());
+  CHECK(binary[1] == std::vector<std::string>{ payload });
+
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].disconnect();
+    client_threads[i].join();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+// a client that records each frame it receives, with its opcode, without
+// unpacking bundles, and counts the frames that arrived compressed
+template<typename client_config>
+class frame_client {
+public:
+  using ws_client = websocketpp::client<client_config>;
+  using opcode = websocketpp::frame::opcode::value;
+  using frame = std::pair<opcode, std::string>;
+
+  frame_client() {
+    m_client.init_asio();
+    // a paused connection leaves no work, so keep run() from returning
+    m_client.start_perpetual();
+    m_client.set_message_handler([this](websocketpp::connection_hdl,
+          typename ws_client::message_ptr msg){
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_frames.emplace_back(msg->get_opcode(), msg->get_payload());
+        if(msg->get_compressed()) {
+          ++m_compressed_count;
+        }
+      });
+  }
+
+  // connects and sends the token, then stops reading if paused is set
+  void connect(const std::string& uri, const std::string& token,
+      bool paused = false)
+  {
+    m_client.set_open_handler(
+        [this, token, paused](websocketpp::connection_hdl){
+          m_connection->send(token, websocketpp::frame::opcode::text);
+          if(paused) {
+            m_connection->pause_reading();
+          }
+        }
+      );
+
+    websocketpp::lib::error_code ec;
+    m_connection = m_client.get_connection(uri, ec);
+    REQUIRE(!ec);
+    m_client.connect(m_connection);
+    m_thread = std::thread{[this](){ m_client.run(); }};
+  }
+
+  void send(const std::string& msg) {
+    m_connection->send(msg, websocketpp::frame::opcode::text);
+  }
+
+  void resume_reading() {
+    m_client.get_io_service().post([this](){
+        m_connection->resume_reading();
+      });
+  }
+
+  void disconnect() {
+    m_client.get_io_service().post([this](){
+        m_connection->close(websocketpp::close::status::normal, "");
+      });
+    m_client.stop_perpetual();
+    m_thread.join();
+  }
+
+  std::vector<frame> get_frames() {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_frames;
+  }
+
+  std::size_t get_frame_count() {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_frames.size();
+  }
+
+  std::size_t get_compressed_count() {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_compressed_count;
+  }
+
+private:
+  ws_client m_client;
+  typename ws_client::connection_ptr m_connection;
+  std::thread m_thread;
+  std::mutex m_lock;
+  std::vector<frame> m_frames;
+  std::size_t m_compressed_count = 0;
+};
+
+// returns the messages in a bundle, see message_batch
+std::vector<std::pair<websocketpp::frame::opcode::value, std::string> >
+unpack_bundle(const std::string& bundle) {
+  std::vector<std::pair<websocketpp::frame::opcode::value, std::string> >
+    messages;
+  bool is_valid = simple_web_game_server::message_batch::unpack(bundle,
+      [&messages](const std::string& payload,
+        websocketpp::frame::opcode::value op){
+        messages.emplace_back(op, payload);
+      }
+    );
+  CHECK(is_valid);
+  return messages;
+}
+
+// returns a message for test_script_game
+json script_message(
+    const std::vector<std::pair<bool, std::string> >& messages,
+    const std::vector<std::pair<bool, std::string> >& broadcasts
+  )
+{
+  json script = {
+      { "messages", json::array() }, { "broadcasts", json::array() }
+    };
+  for(const auto& msg : messages) {
+    script["messages"].push_back(json::array({ msg.first, msg.second }));
+  }
+  for(const auto& msg : broadcasts) {
+    script["broadcasts"].push_back(json::array({ msg.first, msg.second }));
+  }
+  return script;
+}
+
+TEST_CASE("the messages of a tick should be bundled for each player") {
+  using namespace std::chrono_literals;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using game_server = simple_web_game_server::game_server<
+      test_script_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+  using frame = frame_client<asio_client_no_logs>::frame;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  gs.set_message_batching(true);
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  CHECK_THROWS(gs.set_message_batching(false));
+
+  std::vector<player_id> player_list = { 4, 92 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 2);
+
+  std::vector<frame_client<asio_client_no_logs> > clients(2);
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].connect(uri, tokens[i]);
+  }
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 500 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  // waits for the given number of frames, and long enough that any extra
+  // frames would also have arrived
+  auto wait_for_frames = [&](std::size_t count0, std::size_t count1){
+      wait_for([&](){
+          return clients[0].get_frame_count() >= count0
+            && clients[1].get_frame_count() >= count1;
+        });
+      std::this_thread::sleep_for(100ms);
+    };
+
+  REQUIRE(wait_for([&](){ return gs.get_player_count() == 2; }));
+
+  SUBCASE("a lone text message should be sent as it is") {
+    clients[0].send(script_message({ { false, "solo" } }, {}).dump());
+    wait_for_frames(1, 0);
+
+    CHECK(clients[0].get_frames() == std::vector<frame>{
+        { opcode::text, "solo" }
+      });
+    CHECK(clients[1].get_frames().empty());
+  }
+
+  SUBCASE("text and binary messages should be bundled in order") {
+    clients[0].send(script_message(
+        { { false, "a" }, { true, "b" }, { false, "c" } },
+        { { true, "x" }, { false, "y" } }
+      ).dump());
+    wait_for_frames(2, 1);
+
+    // one bundle of messages and one of broadcasts
+    std::vector<frame> frames = clients[0].get_frames();
+    REQUIRE(frames.size() == 2);
+    CHECK(frames[0].first == opcode::binary);
+    CHECK(unpack_bundle(frames[0].second) == std::vector<frame>{
+        { opcode::text, "a" }, { opcode::binary, "b" }, { opcode::text, "c" }
+      });
+    CHECK(frames[1].first == opcode::binary);
+    CHECK(unpack_bundle(frames[1].second) == std::vector<frame>{
+        { opcode::binary, "x" }, { opcode::text, "y" }
+      });
+
+    CHECK(clients[1].get_frames() == std::vector<frame>{ frames[1] });
+  }
+
+  SUBCASE("a lone binary message should be sent as a bundle") {
+    clients[1].send(script_message({ { true, "b" } }, {}).dump());
+    wait_for_frames(0, 1);
+
+    std::vector<frame> frames = clients[1].get_frames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].first == opcode::binary);
+    CHECK(unpack_bundle(frames[0].second) == std::vector<frame>{
+        { opcode::binary, "b" }
+      });
+    CHECK(clients[0].get_frames().empty());
+  }
+
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].disconnect();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+TEST_CASE("messages with a conflation key should keep their place in a tick") {
+  using namespace std::chrono_literals;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using game_server = simple_web_game_server::game_server<
+      test_keyed_script_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+  using frame = frame_client<asio_client_no_logs>::frame;
+
+  bool is_batched = false;
+  SUBCASE("with message batching") {
+    is_batched = true;
+  }
+  SUBCASE("without message batching") {}
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  gs.set_message_batching(is_batched);
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  std::vector<player_id> player_list = { 31, 8 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 2);
+
+  std::vector<frame_client<asio_client_no_logs> > clients(2);
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].connect(uri, tokens[i]);
+  }
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 500 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  REQUIRE(wait_for([&](){ return gs.get_player_count() == 2; }));
+
+  clients[0].send(script_message(
+      {
+        { false, "a" }, { true, "key1:old" }, { false, "b" },
+        { true, "key1:new" }, { false, "key2:text" }, { true, "c" }
+      },
+      { { true, "key3:broadcast" }, { false, "w" } }
+    ).dump());
+
+  if(is_batched) {
+    // each keyed message is a frame of its own between the bundles, a
+    // binary one as a bundle of one, and only the newest for a key is sent
+    std::string keyed_bundle;
+    simple_web_game_server::message_batch::append(
+        keyed_bundle, "key3:broadcast", opcode::binary
+      );
+    const std::vector<frame> broadcast_frames = {
+        { opcode::binary, keyed_bundle }, { opcode::text, "w" }
+      };
+    wait_for([&](){
+        return clients[0].get_frame_count() >= 6
+          && clients[1].get_frame_count() >= 2;
+      });
+    std::this_thread::sleep_for(100ms);
+
+    std::vector<frame> frames = clients[0].get_frames();
+    REQUIRE(frames.size() == 6);
+    CHECK(frames[0].first == opcode::binary);
+    CHECK(unpack_bundle(frames[0].second) == std::vector<frame>{
+        { opcode::text, "a" }, { opcode::text, "b" }
+      });
+    CHECK(frames[1].first == opcode::binary);
+    CHECK(unpack_bundle(frames[1].second) == std::vector<frame>{
+        { opcode::binary, "key1:new" }
+      });
+    CHECK(frames[2] == frame{ opcode::text, "key2:text" });
+    CHECK(frames[3].first == opcode::binary);
+    CHECK(unpack_bundle(frames[3].second) == std::vector<frame>{
+        { opcode::binary, "c" }
+      });
+    CHECK(std::vector<frame>(frames.begin() + 4, frames.end())
+      == broadcast_frames);
+    CHECK(clients[1].get_frames() == broadcast_frames);
+  } else {
+    // every message is sent as it is, with nothing held to replace
+    wait_for([&](){
+        return clients[0].get_frame_count() >= 8
+          && clients[1].get_frame_count() >= 2;
+      });
+    std::this_thread::sleep_for(100ms);
+
+    CHECK(clients[0].get_frames() == std::vector<frame>{
+        { opcode::text, "a" }, { opcode::binary, "key1:old" },
+        { opcode::text, "b" }, { opcode::binary, "key1:new" },
+        { opcode::text, "key2:text" }, { opcode::binary, "c" },
+        { opcode::binary, "key3:broadcast" }, { opcode::text, "w" }
+      });
+    CHECK(clients[1].get_frames() == std::vector<frame>{
+        { opcode::binary, "key3:broadcast" }, { opcode::text, "w" }
+      });
+  }
+
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].disconnect();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+TEST_CASE("held game messages should be replaced by conflation key") {
+  using namespace std::chrono_literals;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using game_server = simple_web_game_server::game_server<
+      test_keyed_script_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+  using slow_consumer_policy = simple_web_game_server::slow_consumer_policy;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+
+  bool is_batched = false;
+  SUBCASE("with message batching") {
+    is_batched = true;
+  }
+  SUBCASE("without message batching") {}
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  gs.set_message_batching(is_batched);
+  gs.set_write_buffer_limit(64 * 1024);
+  // without conflation the held messages would exceed the budget and the
+  // client would be closed
+  gs.set_slow_consumer_policy(slow_consumer_policy::close, 16);
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  std::vector<player_id> player_list = { 502, 6 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 2);
+
+  // the first client stops reading once it has sent its token
+  std::vector<frame_client<asio_client_no_logs> > clients(2);
+  clients[0].connect(uri, tokens[0], true);
+  clients[1].connect(uri, tokens[1]);
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 500 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  REQUIRE(wait_for([&](){ return gs.get_player_count() == 2; }));
+
+  // a tick of messages to each client and a tick of broadcasts, each
+  // keyed update large enough to be held
+  const std::size_t update_count = 64;
+  const std::size_t update_size = 32 * 1024;
+  std::vector<std::pair<bool, std::string> > none;
+  for(std::size_t i = 0; i < update_count; ++i) {
+    json script = script_message(none, none);
+    script["messages"].push_back(
+        json::array({ false, "key1:" + std::to_string(i), update_size })
+      );
+    clients[0].send(script.dump());
+  }
+  for(std::size_t i = 0; i < update_count; ++i) {
+    json script = script_message(none, none);
+    script["broadcasts"].push_back(
+        json::array({ false, "key2:" + std::to_string(i), update_size })
+      );
+    clients[1].send(script.dump());
+  }
+
+  const std::string conflated_name =
+    "simple_web_game_server_slow_consumer_events_total{event=\"conflated\"} ";
+  auto get_event_count = [&](const std::string& name){
+      const std::string metrics = gs.get_metrics();
+      std::size_t pos = metrics.find(name);
+      return pos == std::string::npos ? 0
+        : std::stoul(metrics.substr(pos + name.size()));
+    };
+  CHECK(wait_for([&](){ return get_event_count(conflated_name) > 0; }));
+
+  // the newest update of each key is delivered once reading resumes
+  auto has_update = [&](const std::string& update){
+      std::string payload = update;
+      payload.resize(update_size, ' ');
+      for(const auto& frame : clients[0].get_frames()) {
+        if(frame.second == payload) {
+          return true;
+        }
+      }
+      return false;
+    };
+  clients[0].resume_reading();
+  CHECK(wait_for([&](){
+      return has_update("key1:" + std::to_string(update_count - 1))
+        && has_update("key2:" + std::to_string(update_count - 1));
+    }));
+  CHECK(clients[0].get_frame_count() < 2 * update_count);
+  CHECK(get_event_count(
+      "simple_web_game_server_slow_consumer_events_total{event=\"closed\"} "
+    ) == 0);
+
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].disconnect();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+// returns the body of an HTTP GET request for path on localhost
+std::string http_get(const std::string& path) {
+  namespace asio = websocketpp::lib::asio;
+  asio::io_service ios;
+  asio::ip::tcp::socket socket{ios};
+  socket.connect(asio::ip::tcp::endpoint{
+      asio::ip::address::from_string("127.0.0.1"), SERVER_PORT
+    });
+
+  std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n"
+    "Connection: close\r\n\r\n";
+  asio::write(socket, asio::buffer(request));
+
+  std::string response;
+  char buffer[1024];
+  websocketpp::lib::asio::error_code ec;
+  while(!ec) {
+    std::size_t n = socket.read_some(asio::buffer(buffer), ec);
+    response.append(buffer, n);
+  }
+
+  std::size_t body = response.find("\r\n\r\n");
+  return body == std::string::npos ? std::string{}
+    : response.substr(body + 4);
+}
+
+TEST_CASE("the server should serve its metrics over http") {
+  using namespace std::chrono_literals;
+
+  using game_client = simple_web_game_server::client<
+      asio_client_no_logs
+    >;
+
+  using game_server = simple_web_game_server::game_server<
+      test_binary_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  gs.set_metrics_path("/metrics");
+  gs.set_trace_sample_interval(1);
+  gs.set_http_handler([](game_server::connection_ptr conn){
+      conn->set_status(websocketpp::http::status_code::ok);
+      conn->set_body("user");
+    });
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  std::vector<player_id> player_list = { 4, 92 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 2);
+  tokens.push_back("not a token");
+
+  std::vector<std::size_t> received(3, 0);
+  std::vector<game_client> clients(3);
+  std::vector<std::thread> client_threads;
+  for(std::size_t i = 0; i < 3; i++) {
+    clients[i].set_message_handler([&received, i](const std::string&){
+        ++received[i];
+      });
+    client_threads.emplace_back(
+        bind(&game_client::connect, &clients[i], uri, tokens[i])
+      );
+    // the last client is closed by the server once its token is rejected
+    while(i < 2 && !clients[i].is_running()) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+
+  std::this_thread::sleep_for(200ms);
+
+  clients[0].send("hello");
+  clients[1].send("world!");
+
+  std::this_thread::sleep_for(200ms);
+
+  CHECK(received[0] == 1);
+  CHECK(received[1] == 1);
+
+  const std::string metrics = http_get("/metrics");
+  CHECK(metrics == gs.get_metrics());
+  CHECK(http_get("/other") == "user");
+
+  auto contains = [&metrics](const std::string& line){
+      return metrics.find(line + "\n") != std::string::npos;
+    };
+  // each client sends its token, and the first two a message each
+  CHECK(contains(
+      "simple_web_game_server_actions_total{type=\"in_message\"} 5"
+    ));
+  CHECK(contains(
+      "simple_web_game_server_actions_total{type=\"out_message\"} 2"
+    ));
+  CHECK(contains("simple_web_game_server_messages_received_total 5"));
+  CHECK(contains("simple_web_game_server_received_bytes_total "
+      + std::to_string(tokens[0].size() + tokens[1].size()
+        + tokens[2].size() + 11)
+    ));
+  CHECK(contains("simple_web_game_server_messages_sent_total 2"));
+  CHECK(contains("simple_web_game_server_sent_bytes_total 11"));
+  CHECK(contains(
+      "simple_web_game_server_session_opens_total{result=\"opened\"} 2"
+    ));
+  CHECK(contains(
+      "simple_web_game_server_session_opens_total{result=\"invalid_token\"} 1"
+    ));
+  CHECK(contains("simple_web_game_server_jwt_verify_seconds_count 3"));
+  CHECK(contains("simple_web_game_server_games_created_total 1"));
+  CHECK(contains("simple_web_game_server_games 1"));
+  CHECK(contains("simple_web_game_server_players 2"));
+  CHECK(contains("simple_web_game_server_action_queue_depth 0"));
+  CHECK(metrics.find("simple_web_game_server_tick_seconds_count")
+    != std::string::npos);
+
+  // every message is traced; both echoes may be consumed in one tick
+  const std::string stage = "simple_web_game_server_message_stage_seconds";
+  CHECK(contains(stage + "_count{stage=\"action_queue\"} 2"));
+  CHECK(contains(stage + "_count{stage=\"dispatch\"} 2"));
+  CHECK(contains(stage + "_count{stage=\"send_queue\"} 2"));
+  CHECK((contains(stage + "_count{stage=\"tick_wait\"} 1")
+      || contains(stage + "_count{stage=\"tick_wait\"} 2")));
+  CHECK((contains(stage + "_count{stage=\"game_update\"} 1")
+      || contains(stage + "_count{stage=\"game_update\"} 2")));
+
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].disconnect();
+  }
+  for(std::thread& thr : client_threads) {
+    thr.join();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+TEST_CASE("games should exchange values in the codec of each client") {
+  using namespace std::chrono_literals;
+
+  using game_client = simple_web_game_server::client<
+      asio_client_no_logs
+    >;
+
+  using game_server = simple_web_game_server::game_server<
+      test_codec_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs,
+      simple_web_game_server::default_close_reasons,
+      simple_web_game_server::codec_list<
+          nlohmann_json_codec,
+          nlohmann_msgpack_codec
+        >
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  std::vector<player_id> player_list = { 31, 608 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 2);
+
+  // the first client asks for MessagePack, the second requests no codec
+  // and so is given the first codec, JSON
+  std::vector<std::vector<std::string> > text(2), binary(2);
+  std::vector<game_client> clients(2);
+  std::vector<std::thread> client_threads;
+  clients[0].set_subprotocols({ "cbor", "msgpack" });
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].set_message_handler([&text, i](const std::string& msg){
+        text[i].push_back(msg);
+      });
+    clients[i].set_binary_message_handler([&binary, i](const std::string& msg){
+        binary[i].push_back(msg);
+      });
+    client_threads.emplace_back(
+        bind(&game_client::connect, &clients[i], uri, tokens[i])
+      );
+    while(!clients[i].is_running()) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+
+  std::this_thread::sleep_for(200ms);
+
+  CHECK(clients[0].get_subprotocol() == "msgpack");
+  CHECK(clients[1].get_subprotocol() == "");
+
+  json move = { { "move", { 1, 2 } } };
+  clients[0].send_binary(nlohmann_msgpack_codec::encode(move));
+  std::this_thread::sleep_for(50ms);
+  clients[1].send(move.dump());
+  // malformed messages are dropped
+  clients[1].send("{ not json");
+
+  std::this_thread::sleep_for(200ms);
+
+  std::vector<json> expected = {
+      json{ { "pid", player_list[0] }, { "data", move } },
+      json{ { "pid", player_list[1] }, { "data", move } }
+    };
+
+  CHECK(text[0].empty());
+  REQUIRE(binary[0].size() == 3);
+  CHECK(json::from_msgpack(binary[0][0])
+    == json{ { "connected", player_list[0] } });
+  CHECK(json::from_msgpack(binary[0][1]) == expected[0]);
+  CHECK(json::from_msgpack(binary[0][2]) == expected[1]);
+
+  CHECK(binary[1].empty());
+  REQUIRE(text[1].size() == 3);
+  CHECK(json::parse(text[1][0]) == json{ { "connected", player_list[1] } });
+  CHECK(json::parse(text[1][1]) == expected[0]);
+  CHECK(json::parse(text[1][2]) == expected[1]);
+
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].disconnect();
+    client_threads[i].join();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+TEST_CASE_TEMPLATE(
+    "messages should arrive intact with permessage-deflate",
+    server_config,
+    basic_asio_deflate_no_logs<no_context_takeover_deflate_config>,
+    basic_asio_deflate_no_logs<context_takeover_deflate_config>
+  )
+{
+  using namespace std::chrono_literals;
+
+  using deflate_client = simple_web_game_server::client<
+      asio_client_deflate_no_logs
+    >;
+  using plain_client = simple_web_game_server::client<
+      asio_client_no_logs
+    >;
+
+  using game_server = simple_web_game_server::game_server<
+      test_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      server_config
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  gs.set_compression_threshold(64);
+  gs.set_broadcast_compression_threshold(64);
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  std::vector<player_id> player_list = { 7, 70, 700 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 3);
+
+  // two clients negotiate permessage-deflate, the third does not
+  std::vector<std::vector<std::string> > received(3);
+  std::vector<deflate_client> deflate_clients(2);
+  plain_client other_client;
+  std::vector<std::thread> client_threads;
+  for(std::size_t i = 0; i < 2; i++) {
+    deflate_clients[i].set_message_handler(
+        [&received, i](const std::string& msg){
+          received[i].push_back(msg);
+        }
+      );
+    client_threads.emplace_back(
+        bind(&deflate_client::connect, &deflate_clients[i], uri, tokens[i])
+      );
+    while(!deflate_clients[i].is_running()) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+  other_client.set_message_handler([&received](const std::string& msg){
+      received[2].push_back(msg);
+    });
+  client_threads.emplace_back(
+      bind(&plain_client::connect, &other_client, uri, tokens[2])
+    );
+  while(!other_client.is_running()) {
+    std::this_thread::sleep_for(1ms);
+  }
+
+  std::this_thread::sleep_for(200ms);
+
+  // repetitive game states, as well as short messages below the threshold
+  std::string state;
+  for(std::size_t i = 0; i < 50; i++) {
+    state += "{\"board\":[0,1,-1,0,0,1,0,-1,0],\"turn\":"
+      + std::to_string(i) + "}";
+  }
+  std::vector<json> messages = {
+      { { "type", "echo" }, { "data", state } },
+      { { "type", "echo" }, { "data", "short" } }
+    };
+
+  for(const json& msg : messages) {
+    deflate_clients[0].send(msg.dump());
+    other_client.send(msg.dump());
+  }
+  std::this_thread::sleep_for(100ms);
+  deflate_clients[1].send(
+      json{ { "type", "broadcast" }, { "data", state } }.dump()
+    );
+  std::this_thread::sleep_for(100ms);
+  deflate_clients[1].send(
+      json{ { "type", "broadcast" }, { "data", "hi" } }.dump()
+    );
+  std::this_thread::sleep_for(200ms);
+
+  std::string big_broadcast = json{
+      { "pid", player_list[1] }, { "data", state }
+    }.dump();
+  std::string small_broadcast = json{
+      { "pid", player_list[1] }, { "data", "hi" }
+    }.dump();
+
+  std::vector<std::string> echoed = {
+      messages[0].dump(), messages[1].dump(), big_broadcast, small_broadcast
+    };
+  std::vector<std::string> broadcast_only = { big_broadcast, small_broadcast };
+  CHECK(received[0] == echoed);
+  CHECK(received[1] == broadcast_only);
+  CHECK(received[2] == echoed);
+
+  for(std::size_t i = 0; i < 2; i++) {
+    deflate_clients[i].disconnect();
+  }
+  other_client.disconnect();
+  for(std::thread& t : client_threads) {
+    t.join();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+TEST_CASE("a compressed broadcast should be shared by its recipients") {
+  using namespace std::chrono_literals;
+  namespace opcode = websocketpp::frame::opcode;
+
+  using game_server = simple_web_game_server::game_server<
+      test_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_deflate_no_logs
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+  using frame = frame_client<asio_client_no_logs>::frame;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  gs.set_broadcast_compression_threshold(64);
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 10ms)};
+
+  std::vector<player_id> player_list = { 3, 30, 300, 3000 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 4);
+
+  // three clients negotiate permessage-deflate, the fourth does not
+  std::vector<frame_client<asio_client_deflate_no_logs> > deflate_clients(3);
+  frame_client<asio_client_no_logs> plain_client;
+  for(std::size_t i = 0; i < 3; i++) {
+    deflate_clients[i].connect(uri, tokens[i]);
+  }
+  plain_client.connect(uri, tokens[3]);
+
+  auto wait_for = [](auto&& done){
+      for(int i = 0; i < 500 && !done(); ++i) {
+        std::this_thread::sleep_for(10ms);
+      }
+      return done();
+    };
+
+  auto get_compressed_total = [&](){
+      const std::string name =
+        "\nsimple_web_game_server_broadcasts_compressed_total ";
+      const std::string metrics = gs.get_metrics();
+      std::size_t pos = metrics.find(name);
+      REQUIRE(pos != std::string::npos);
+      return std::stoul(metrics.substr(pos + name.size()));
+    };
+
+  REQUIRE(wait_for([&](){ return gs.get_player_count() == 4; }));
+  CHECK(get_compressed_total() == 0);
+
+  std::string state;
+  for(std::size_t i = 0; i < 50; i++) {
+    state += "{\"board\":[0,1,-1,0,0,1,0,-1,0],\"turn\":"
+      + std::to_string(i) + "}";
+  }
+  deflate_clients[1].send(
+      json{ { "type", "broadcast" }, { "data", state } }.dump()
+    );
+
+  auto has_frames = [](auto& client){
+      return client.get_frame_count() >= 1;
+    };
+  REQUIRE(wait_for([&](){
+      return has_frames(deflate_clients[0]) && has_frames(deflate_clients[1])
+        && has_frames(deflate_clients[2]) && has_frames(plain_client);
+    }));
+  std::this_thread::sleep_for(100ms);
+
+  // the broadcast was compressed once for all three deflate clients
+  CHECK(get_compressed_total() == 1);
+
+  const std::vector<frame> expected = {
+      {
+        opcode::text,
+        json{ { "pid", player_list[1] }, { "data", state } }.dump()
+      }
+    };
+  for(std::size_t i = 0; i < 3; i++) {
+    CHECK(deflate_clients[i].get_frames() == expected);
+    CHECK(deflate_clients[i].get_compressed_count() == 1);
+  }
+  CHECK(plain_client.get_frames() == expected);
+  CHECK(plain_client.get_compressed_count() == 0);
+
+  for(std::size_t i = 0; i < 3; i++) {
+    deflate_clients[i].disconnect();
+  }
+  plain_client.disconnect();
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
+
+// records the allocation count of the game loop thread at each update while
+// allocations are counted, and echoes messages short enough to need no
+// allocation
+std::atomic<std::size_t> allocation_tick_count{0};
+std::array<std::size_t, 1024> allocation_counts;
+
+class allocation_game {
+public:
+  using player_traits = test_player_traits;
+  using player_id = player_traits::id::player_id;
+  using message = std::pair<player_id, std::string>;
+
+  allocation_game(const json& data) {}
+
+  void connect(vector<message>& out_msg_list, player_id id) {}
+
+  void disconnect(vector<message>& out_msg_list, player_id id) {}
+
+  void update(
+      vector<message>& out_msg_list,
+      const vector<message>& in_msg_list,
+      long delta_time
+    )
+  {
+    for(const message& msg : in_msg_list) {
+      out_msg_list.push_back(msg);
+    }
+
+    std::size_t tick = allocation_tick_count;
+    if(is_counting_allocations && tick < allocation_counts.size()) {
+      allocation_counts[tick] = thread_allocation_count;
+      allocation_tick_count = tick + 1;
+    }
+  }
+
+  bool is_done() const {
+    return false;
+  }
+
+  bool is_valid() const {
+    return true;
+  }
+
+  json get_state() const {
+    return json{};
+  }
+};
+
+TEST_CASE("steady state game ticks should not allocate") {
+  using namespace std::chrono_literals;
+
+  using game_client = simple_web_game_server::client<
+      asio_client_no_logs
+    >;
+
+  using game_server = simple_web_game_server::game_server<
+      allocation_game,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  std::string secret = "secret";
+  std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  game_server gs{verifier, [](combined_id id, const json& data){
+      return std::string{};
+    }};
+  // games are updated on the game loop thread, so its count covers them
+  gs.set_update_threads(1);
+
+  std::thread server_thr{bind(&game_server::run, &gs, SERVER_PORT, true)};
+  while(!gs.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+  std::thread msg_process_thr{bind(&game_server::process_messages, &gs)};
+  std::thread game_thr{bind(&game_server::update_games, &gs, 5ms)};
+
+  std::vector<player_id> player_list = { 15, 2048 };
+  std::vector<std::string> tokens;
+  create_game_tokens(tokens, player_list, secret, issuer, 2);
+
+  std::vector<std::size_t> received(2, 0);
+  std::vector<game_client> clients(2);
+  std::vector<std::thread> client_threads;
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].set_message_handler([&received, i](const std::string& msg){
+        ++received[i];
+      });
+    client_threads.emplace_back(
+        bind(&game_client::connect, &clients[i], uri, tokens[i])
+      );
+    while(!clients[i].is_running()) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+
+  std::this_thread::sleep_for(200ms);
+
+  // warm up with bursts larger than the steady traffic, so every buffer
+  // reaches its peak capacity
+  for(std::size_t burst = 0; burst < 4; burst++) {
+    for(std::size_t j = 0; j < 32; j++) {
+      clients[j % 2].send("warm up");
+    }
+    std::this_thread::sleep_for(50ms);
+  }
+
+  is_counting_allocations = true;
+  for(std::size_t j = 0; j < 40; j++) {
+    clients[j % 2].send("ping");
+    std::this_thread::sleep_for(10ms);
+  }
+  std::this_thread::sleep_for(50ms);
+  is_counting_allocations = false;
+
+  std::size_t ticks = allocation_tick_count;
+  REQUIRE(ticks > 10);
+  CHECK(allocation_counts[ticks - 1] - allocation_counts[0] == 0);
+  CHECK(received[0] + received[1] == 128 + 40);
+
+  for(std::size_t i = 0; i < 2; i++) {
+    clients[i].disconnect();
+    client_threads[i].join();
+  }
+
+  gs.stop();
+
+  msg_process_thr.join();
+  game_thr.join();
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
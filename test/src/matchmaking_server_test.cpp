@@ -44,7 +44,8 @@ void create_matchmaker_tokens(
   }
 }
 
-TEST_CASE("players should interact with the server with no errors") {
+TEST_CASE_TEMPLATE("players should interact with the server with no errors",
+    matchmaker, test_matchmaker, test_event_matchmaker) {
   using namespace std::chrono_literals;
 
   using test_client = simple_web_game_server::client<
@@ -52,7 +53,7 @@ TEST_CASE("players should interact with the server with no errors") {
     >;
 
   using test_matchmaking_server = simple_web_game_server::matchmaking_server<
-      test_matchmaker,
+      matchmaker,
       jwt::default_clock,
       nlohmann_traits,
       asio_no_logs
@@ -316,3 +317,154 @@ TEST_CASE("players should interact with the server with no errors") {
   match_thr.join();
   server_thr.join();
 }
+
+TEST_CASE("partitions should match their sessions independently") {
+  using namespace std::chrono_literals;
+
+  using test_client = simple_web_game_server::client<
+      asio_client_no_logs
+    >;
+
+  using test_matchmaking_server = simple_web_game_server::matchmaking_server<
+      test_matchmaker,
+      jwt::default_clock,
+      nlohmann_traits,
+      asio_no_logs
+    >;
+
+  struct test_client_data {
+    void on_open() {}
+    void on_close() {}
+    void on_message(const std::string& message) {
+      last_message = message;
+    }
+
+    std::string last_message;
+  };
+
+  using combined_id = test_game::player_traits::id;
+  using player_id = combined_id::player_id;
+  using json = nlohmann::json;
+  using claim = jwt::basic_claim<nlohmann_traits>;
+
+  std::ostringstream oss;
+  auto ostream_sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(oss);
+  auto logger = std::make_shared<spdlog::logger>("my_logger", ostream_sink);
+  spdlog::set_default_logger(logger);
+  spdlog::set_level(spdlog::level::err);
+
+  const std::string secret = "secret";
+  const std::string issuer = "jwt-gs-text";
+  jwt::verifier<jwt::default_clock, nlohmann_traits> 
+    verifier(jwt::default_clock{});
+  verifier.allow_algorithm(jwt::algorithm::hs256(secret))
+    .with_issuer(issuer);
+
+  std::string uri = std::string{"ws://localhost:"}
+    + std::to_string(SERVER_PORT);
+
+  test_matchmaking_server mms{
+      verifier, 
+      [](const combined_id& id, const json& data){
+        return json{ { "pid", id.player }, { "sid", id.session } }.dump();
+      }
+    };
+
+  mms.add_partition("a");
+  mms.add_partition("b");
+  mms.set_partition_handler([](const json& data){
+      return data.value("mode", std::string{});
+    });
+  mms.set_partition_overflow("b", "a", 500ms);
+
+  CHECK_THROWS(mms.set_partition_overflow("b", "c", 500ms));
+
+  std::thread server_thr{
+      bind(&test_matchmaking_server::run, &mms, SERVER_PORT, true)
+    };
+
+  while(!mms.is_running()) {
+    std::this_thread::sleep_for(10ms);
+  }
+
+  CHECK_THROWS(mms.add_partition("c"));
+
+  std::thread msg_process_thr{
+      bind(&test_matchmaking_server::process_messages, &mms)
+    };
+  std::vector<std::thread> match_threads;
+  for(const std::string name : { "", "a", "b" }) {
+    match_threads.emplace_back([&mms, name](){
+        mms.match_partition(name, 50ms);
+      });
+  }
+
+  std::vector<combined_id> player_list{ { 1, 1 }, { 2, 2 } };
+  std::vector<std::string> modes{ "a", "b" };
+  std::vector<std::string> tokens;
+  for(std::size_t i = 0; i < player_list.size(); i++) {
+    tokens.push_back(jwt::create<nlohmann_traits>()
+        .set_issuer(issuer)
+        .set_payload_claim("pid", claim(player_list[i].player))
+        .set_payload_claim("sid", claim(player_list[i].session))
+        .set_payload_claim("data", claim(json{ { "mode", modes[i] } }))
+        .sign(jwt::algorithm::hs256{secret})
+      );
+  }
+
+  std::vector<test_client> clients;
+  std::vector<test_client_data> client_data_list;
+  std::vector<std::thread> client_threads;
+  create_clients<player_id, test_client, test_client_data>(
+      clients, client_data_list, client_threads, tokens, uri,
+      player_list.size()
+    );
+
+  std::this_thread::sleep_for(250ms);
+
+  // the sessions wait in different partitions, so are not matched
+  CHECK(client_data_list[0].last_message == "");
+  CHECK(client_data_list[1].last_message == "");
+  CHECK(mms.get_partition_stats("a").waiting == 1);
+  CHECK(mms.get_partition_stats("b").waiting == 1);
+  CHECK(mms.get_partition_stats("").joined == 0);
+
+  std::this_thread::sleep_for(1000ms);
+
+  // the session in b overflows to a and is matched there
+  CHECK(client_data_list[0].last_message != "");
+  CHECK(client_data_list[1].last_message != "");
+
+  auto a_stats = mms.get_partition_stats("a");
+  CHECK(a_stats.joined == 2);
+  CHECK(a_stats.matched == 2);
+  CHECK(a_stats.games == 1);
+  CHECK(a_stats.waiting == 0);
+  CHECK(a_stats.ticks.ticks > 0);
+
+  auto b_stats = mms.get_partition_stats("b");
+  CHECK(b_stats.joined == 1);
+  CHECK(b_stats.overflowed == 1);
+  CHECK(b_stats.games == 0);
+  CHECK(b_stats.waiting == 0);
+
+  for(std::size_t i = 0; i < clients.size(); i++) {
+    try {
+      clients[i].disconnect();
+    } catch(test_client::client_error& e) {}
+  }
+
+  for(std::thread& t : client_threads) {
+    t.join();
+  }
+
+  mms.stop();
+
+  msg_process_thr.join();
+  for(std::thread& t : match_threads) {
+    t.join();
+  }
+  server_thr.join();
+
+  CHECK(oss.str() == std::string{""});
+}
@@ -0,0 +1,46 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/message_batch.hpp>
+
+#include <string>
+#include <vector>
+#include <utility>
+
+TEST_CASE("message bundles should unpack to the messages appended") {
+  using message_batch = simple_web_game_server::message_batch;
+  namespace opcode = websocketpp::frame::opcode;
+  using message = std::pair<std::string, opcode::value>;
+
+  const std::string binary{ '\x00', '\xff', '\x80', '\x01' };
+  const std::string large(70000, 'x');
+
+  std::string bundle;
+  message_batch::append(bundle, "hello", opcode::text);
+  message_batch::append(bundle, binary, opcode::binary);
+  message_batch::append(bundle, "", opcode::text);
+  message_batch::append(bundle, large, opcode::text);
+  CHECK(bundle.size() == 4 * 5 + 5 + 4 + 70000);
+
+  std::vector<message> unpacked;
+  auto collect = [&unpacked](const std::string& payload, opcode::value op){
+      unpacked.emplace_back(payload, op);
+    };
+
+  SUBCASE("a whole bundle should unpack in order") {
+    CHECK(message_batch::unpack(bundle, collect));
+    CHECK(unpacked == std::vector<message>{
+        { "hello", opcode::text }, { binary, opcode::binary },
+        { "", opcode::text }, { large, opcode::text }
+      });
+  }
+
+  SUBCASE("a truncated bundle should be reported after its whole messages") {
+    bundle.resize(bundle.size() - 1);
+    CHECK(!message_batch::unpack(bundle, collect));
+    CHECK(unpacked.size() == 3);
+
+    unpacked.clear();
+    CHECK(!message_batch::unpack(std::string{ '\x01', '\x00' }, collect));
+    CHECK(unpacked.empty());
+  }
+}
@@ -0,0 +1,152 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/metrics.hpp>
+#include <simple_web_game_server/message_tracer.hpp>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+TEST_CASE("the metrics registry should sum the values of every thread") {
+  using simple_web_game_server::metrics_registry;
+  using namespace std::chrono_literals;
+
+  metrics_registry metrics;
+  std::size_t in = metrics.add_counter(
+      "test_actions_total", "Actions.", "type=\"in\""
+    );
+  std::size_t out = metrics.add_counter(
+      "test_actions_total", "Actions.", "type=\"out\""
+    );
+  std::size_t latency = metrics.add_histogram(
+      "test_latency_seconds", "Latency.", { 0.001, 0.01 }
+    );
+  metrics.add_gauge("test_depth", "Depth.", [](){ return 3.5; });
+
+  SUBCASE("counters and histograms should be summed across threads") {
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t) {
+      threads.emplace_back([&](){
+          for(int i = 0; i < 1000; ++i) {
+            metrics.increment(in);
+            metrics.increment(out, 2);
+          }
+          metrics.observe(latency, 500us);
+          metrics.observe(latency, 5ms);
+          metrics.observe(latency, 2s);
+        });
+    }
+    for(std::thread& t : threads) {
+      t.join();
+    }
+
+    std::string text = metrics.render();
+    CHECK(text == std::string{
+        "# HELP test_actions_total Actions.\n"
+        "# TYPE test_actions_total counter\n"
+        "test_actions_total{type=\"in\"} 4000\n"
+        "test_actions_total{type=\"out\"} 8000\n"
+        "# HELP test_latency_seconds Latency.\n"
+        "# TYPE test_latency_seconds histogram\n"
+        "test_latency_seconds_bucket{le=\"0.001\"} 4\n"
+        "test_latency_seconds_bucket{le=\"0.01\"} 8\n"
+        "test_latency_seconds_bucket{le=\"+Inf\"} 12\n"
+        "test_latency_seconds_sum 8.022\n"
+        "test_latency_seconds_count 12\n"
+        "# HELP test_depth Depth.\n"
+        "# TYPE test_depth gauge\n"
+        "test_depth 3.5\n"
+      });
+  }
+
+  SUBCASE("the values of exited threads should be kept") {
+    for(int t = 0; t < 8; ++t) {
+      std::thread{[&](){ metrics.increment(in, 3); }}.join();
+      CHECK(metrics.thread_count() == 0);
+    }
+    metrics.increment(in);
+    CHECK(metrics.thread_count() == 1);
+
+    std::string text = metrics.render();
+    CHECK(text.find("test_actions_total{type=\"in\"} 25\n")
+      != std::string::npos);
+  }
+
+  SUBCASE("a thread should record to registries created after others") {
+    for(int i = 0; i < 4; ++i) {
+      metrics_registry temporary;
+      std::size_t c = temporary.add_counter("test_temporary_total", "Temp.");
+      temporary.increment(c, i + 1);
+      const std::string value = std::to_string(i + 1);
+      CHECK(temporary.render().find("test_temporary_total " + value)
+        != std::string::npos);
+    }
+    metrics.increment(out);
+    CHECK(metrics.render().find("test_actions_total{type=\"out\"} 1\n")
+      != std::string::npos);
+  }
+
+  SUBCASE("metrics should not be added once recording has started") {
+    metrics.increment(in);
+    CHECK_THROWS_AS(
+        metrics.add_counter("test_late_total", "Late."),
+        std::logic_error
+      );
+    metrics.add_gauge("test_late", "Late.", [](){ return 0.0; });
+  }
+}
+
+TEST_CASE("the message tracer should sample and time message stages") {
+  using simple_web_game_server::metrics_registry;
+  using simple_web_game_server::message_tracer;
+  using namespace std::chrono_literals;
+
+  SUBCASE("log linear buckets should split each power of two") {
+    std::vector<double> bounds = metrics_registry::log_linear_buckets(
+        1.0, 5.0, 2
+      );
+    CHECK(bounds == std::vector<double>{ 1.0, 1.5, 2.0, 3.0, 4.0, 6.0, 8.0 });
+  }
+
+  metrics_registry metrics;
+  message_tracer tracer{metrics};
+
+  SUBCASE("no messages should be sampled by default") {
+    for(int i = 0; i < 100; ++i) {
+      CHECK(tracer.sample() == false);
+    }
+  }
+
+  SUBCASE("one in every n messages should be sampled") {
+    tracer.set_sample_interval(3);
+    int sampled = 0;
+    for(int i = 0; i < 30; ++i) {
+      if(tracer.sample()) {
+        ++sampled;
+      }
+    }
+    CHECK(sampled == 10);
+  }
+
+  SUBCASE("each stage should be recorded in its own histogram") {
+    message_tracer::time_point start = message_tracer::clock::now() - 3ms;
+    message_tracer::time_point next = tracer.record(
+        message_tracer::dispatch, start
+      );
+    CHECK(next - start >= 3ms);
+    CHECK(message_tracer::is_traced(next));
+    CHECK(message_tracer::is_traced(message_tracer::time_point{}) == false);
+
+    std::string text = metrics.render();
+    CHECK(text.find(
+        "simple_web_game_server_message_stage_seconds_count"
+        "{stage=\"dispatch\"} 1\n"
+      ) != std::string::npos);
+    CHECK(text.find(
+        "simple_web_game_server_message_stage_seconds_count"
+        "{stage=\"action_queue\"} 0\n"
+      ) != std::string::npos);
+  }
+}
@@ -0,0 +1,96 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/rating_index.hpp>
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+TEST_CASE("the rating index should pair sessions with close ratings") {
+  using rating_index = simple_web_game_server::rating_index<int>;
+  using match = std::pair<int, int>;
+
+  rating_index index;
+  std::vector<match> matches;
+  auto record = [&](int a, int b) {
+      matches.emplace_back(std::min(a, b), std::max(a, b));
+    };
+
+  SUBCASE("sessions should be paired with their closest neighbor") {
+    index.insert(1, 1000);
+    index.insert(2, 1300);
+    index.insert(3, 1350);
+    index.insert(4, 2000);
+    CHECK(index.size() == 4);
+
+    CHECK(index.match_pairs(250, record) == 1);
+    CHECK(matches == std::vector<match>{ { 2, 3 } });
+    CHECK(index.contains(1));
+    CHECK(index.contains(2) == false);
+    CHECK(index.contains(3) == false);
+    CHECK(index.size() == 2);
+  }
+
+  SUBCASE("unchanged sessions should not be paired again") {
+    index.insert(1, 1000);
+    index.insert(2, 2000);
+    CHECK(index.match_pairs(250, record) == 0);
+
+    // only the new session and its neighbors are examined
+    index.insert(3, 1900);
+    CHECK(index.match_pairs(250, record) == 1);
+    CHECK(matches == std::vector<match>{ { 2, 3 } });
+    CHECK(index.size() == 1);
+  }
+
+  SUBCASE("pairs made in a pass should free sessions for later pairs") {
+    index.insert(1, 1000);
+    index.insert(2, 1100);
+    index.insert(3, 1200);
+    index.insert(4, 1300);
+    index.insert(5, 1310);
+    CHECK(index.match_pairs(250, record) == 2);
+    CHECK(matches == std::vector<match>{ { 1, 2 }, { 3, 4 } });
+    CHECK(index.size() == 1);
+    CHECK(index.contains(5));
+  }
+
+  SUBCASE("erased sessions should not be paired") {
+    index.insert(1, 1000);
+    index.insert(2, 1100);
+    index.insert(3, 1150);
+    CHECK(index.erase(3));
+    CHECK(index.erase(3) == false);
+    CHECK(index.match_pairs(250, record) == 1);
+    CHECK(matches == std::vector<match>{ { 1, 2 } });
+  }
+
+  SUBCASE("widening the maximum difference should examine every session") {
+    index.insert(1, 1000);
+    index.insert(2, 1400);
+    CHECK(index.match_pairs(250, record) == 0);
+    CHECK(index.match_pairs(250, record) == 0);
+    CHECK(index.match_pairs(500, record) == 1);
+    CHECK(index.empty());
+  }
+
+  SUBCASE("reinserting a session should update its rating") {
+    index.insert(1, 1000);
+    index.insert(2, 2000);
+    CHECK(index.match_pairs(250, record) == 0);
+
+    index.insert(1, 1900);
+    CHECK(index.size() == 2);
+    CHECK(index.match_pairs(250, record) == 1);
+    CHECK(matches == std::vector<match>{ { 1, 2 } });
+    CHECK(index.empty());
+  }
+
+  SUBCASE("clearing the index should remove pending sessions") {
+    index.insert(1, 1000);
+    index.insert(2, 1000);
+    index.clear();
+    CHECK(index.empty());
+    CHECK(index.match_pairs(250, record) == 0);
+  }
+}
@@ -0,0 +1,119 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/send_queue.hpp>
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <system_error>
+
+TEST_CASE("the send queue should hold messages back above the high-water mark") {
+  using send_queue = simple_web_game_server::send_queue;
+  using push_result = send_queue::push_result;
+  using flush_result = send_queue::flush_result;
+  namespace opcode = websocketpp::frame::opcode;
+
+  send_queue queue{3};
+  std::vector<std::string> written;
+  std::size_t buffered = 0;
+
+  auto get_buffered = [&buffered](){ return buffered; };
+  auto write = [&](const std::string& msg, opcode::value op){
+      written.push_back(msg);
+      buffered += msg.size();
+      return websocketpp::lib::error_code{};
+    };
+
+  SUBCASE("messages should be sent in order while below the high-water mark") {
+    std::vector<bool> sent;
+    CHECK(queue.push("aa", opcode::text, [&](bool s){ sent.push_back(s); })
+      == push_result::queued);
+    CHECK(queue.push("bb", opcode::text) == push_result::queued);
+    CHECK(queue.push("cc", opcode::binary) == push_result::queued);
+    CHECK(queue.bytes() == 6);
+
+    CHECK(queue.flush(4, get_buffered, write) == flush_result::blocked);
+    CHECK(written == std::vector<std::string>{ "aa", "bb" });
+    CHECK(sent == std::vector<bool>{ true });
+    CHECK(queue.size() == 1);
+    CHECK(queue.bytes() == 2);
+
+    // the connection writes its buffer, so the rest may go
+    buffered = 0;
+    CHECK(queue.flush(4, get_buffered, write) == flush_result::drained);
+    CHECK(written == std::vector<std::string>{ "aa", "bb", "cc" });
+
+    CHECK(queue.push("dd", opcode::text) == push_result::queued);
+    buffered = 0;
+    CHECK(queue.flush(4, get_buffered, write) == flush_result::empty);
+  }
+
+  SUBCASE("a full queue should refuse messages until it drains") {
+    for(int i = 0; i < 3; ++i) {
+      CHECK(queue.push("m", opcode::text) == push_result::queued);
+    }
+    CHECK(queue.push("m", opcode::text) == push_result::full);
+    CHECK(queue.size() == 3);
+
+    CHECK(queue.flush(100, get_buffered, write) == flush_result::drained);
+    CHECK(written.size() == 3);
+  }
+
+  SUBCASE("messages with the same key should supersede each other") {
+    std::vector<std::pair<std::string, bool> > sent;
+    auto track = [&sent](const std::string& name) {
+        return [&sent, name](bool s){ sent.emplace_back(name, s); };
+      };
+
+    CHECK(queue.push_latest("pos", "x=1", opcode::text, track("x=1"))
+      == push_result::queued);
+    CHECK(queue.push("chat", opcode::text) == push_result::queued);
+    CHECK(queue.push_latest("pos", "x=22", opcode::text, track("x=22"))
+      == push_result::coalesced);
+    CHECK(queue.push_latest("", "a", opcode::text) == push_result::queued);
+    CHECK(queue.push_latest("", "b", opcode::text) == push_result::full);
+    CHECK(queue.bytes() == 9);
+
+    // the superseded message is dropped, the latest goes to the back
+    CHECK(queue.push_latest("pos", "x=3", opcode::text, track("x=3"))
+      == push_result::coalesced);
+    CHECK(queue.flush(100, get_buffered, write) == flush_result::drained);
+    CHECK(written == std::vector<std::string>{ "chat", "a", "x=3" });
+    CHECK(sent == std::vector<std::pair<std::string, bool> >{
+        { "x=1", false }, { "x=22", false }, { "x=3", true }
+      });
+  }
+
+  SUBCASE("messages the connection fails to send should be reported") {
+    std::vector<bool> sent;
+    auto track = [&sent](bool s){ sent.push_back(s); };
+    queue.push("a", opcode::text, track);
+    queue.push("b", opcode::text, track);
+
+    auto fail_b = [&](const std::string& msg, opcode::value op)
+      -> websocketpp::lib::error_code
+    {
+      if(msg == "b") {
+        return std::make_error_code(std::errc::broken_pipe);
+      }
+      return write(msg, op);
+    };
+    CHECK(queue.flush(100, get_buffered, fail_b) == flush_result::empty);
+    CHECK(written == std::vector<std::string>{ "a" });
+    CHECK(sent == std::vector<bool>{ true, false });
+    CHECK(queue.size() == 0);
+    CHECK(queue.bytes() == 0);
+  }
+
+  SUBCASE("clearing the queue should report its messages as not sent") {
+    std::vector<bool> sent;
+    queue.push("a", opcode::text, [&](bool s){ sent.push_back(s); });
+    queue.push("b", opcode::text, [&](bool s){ sent.push_back(s); });
+    queue.clear();
+
+    CHECK(sent == std::vector<bool>{ false, false });
+    CHECK(queue.size() == 0);
+    CHECK(queue.bytes() == 0);
+    CHECK(queue.flush(100, get_buffered, write) == flush_result::empty);
+  }
+}
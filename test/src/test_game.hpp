@@ -8,6 +8,8 @@ using json = nlohmann::json;
 
 #include <spdlog/spdlog.h>
 
+#include <websocketpp/frame.hpp>
+
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
@@ -15,6 +17,7 @@ using json = nlohmann::json;
 #include <functional>
 #include <tuple>
 #include <utility>
+#include <algorithm>
 
 using std::vector;
 using std::unordered_map;
@@ -91,6 +94,7 @@ public:
 
   void update(
       vector<message>& out_msg_list,
+      vector<std::string>& broadcast_list,
       const vector<message>& in_msg_list,
       long delta_time
     )
@@ -99,12 +103,10 @@ public:
       try {
         json msg_json = json::parse(msg.second);
         if(msg_json.at("type") == "broadcast") {
-          for(player_id pid : m_player_list) {
-            json temp = {
-                { "pid", msg.first }, { "data", msg_json.at("data") }
-              };
-            out_msg_list.emplace_back(pid, temp.dump());
-          }
+          json temp = {
+              { "pid", msg.first }, { "data", msg_json.at("data") }
+            };
+          broadcast_list.push_back(temp.dump());
         } else if(msg_json.at("type") == "echo") {
           out_msg_list.emplace_back(msg.first, msg.second);
         } else if(msg_json.at("type") == "stop") {
@@ -143,6 +145,181 @@ private:
   bool m_done, m_valid;
 };
 
+// a game that tags its messages with opcodes: each message is echoed back
+// to its sender, and binary messages are also broadcast to every player
+class test_binary_game {
+public:
+  using player_traits = test_player_traits;
+  using player_id = player_traits::id::player_id;
+  using opcode = websocketpp::frame::opcode::value;
+  using message = std::tuple<player_id, std::string, opcode>;
+  using broadcast = std::pair<std::string, opcode>;
+
+  test_binary_game(const json& data) {}
+
+  void connect(vector<message>& out_msg_list, player_id id) {}
+
+  void disconnect(vector<message>& out_msg_list, player_id id) {}
+
+  void update(
+      vector<message>& out_msg_list,
+      vector<broadcast>& broadcast_list,
+      const vector<message>& in_msg_list,
+      long delta_time
+    )
+  {
+    for(const message& msg : in_msg_list) {
+      out_msg_list.push_back(msg);
+      if(std::get<2>(msg) == websocketpp::frame::opcode::binary) {
+        broadcast_list.emplace_back(std::get<1>(msg), std::get<2>(msg));
+      }
+    }
+  }
+
+  bool is_done() const {
+    return false;
+  }
+
+  bool is_valid() const {
+    return true;
+  }
+
+  json get_state() const {
+    return json{};
+  }
+};
+
+// a game that sends what each message asks for in one update: a message
+// {"messages": [[binary, payload], ...], "broadcasts": [...]} is answered
+// with each message sent to its sender, and each broadcast to every player,
+// in order, with the binary opcode if the flag is set; an optional third
+// entry pads the payload with spaces to that size
+class test_script_game {
+public:
+  using player_traits = test_player_traits;
+  using player_id = player_traits::id::player_id;
+  using opcode = websocketpp::frame::opcode::value;
+  using message = std::tuple<player_id, std::string, opcode>;
+  using broadcast = std::pair<std::string, opcode>;
+
+  test_script_game(const json& data) {}
+
+  void connect(vector<message>& out_msg_list, player_id id) {}
+
+  void disconnect(vector<message>& out_msg_list, player_id id) {}
+
+  void update(
+      vector<message>& out_msg_list,
+      vector<broadcast>& broadcast_list,
+      const vector<message>& in_msg_list,
+      long delta_time
+    )
+  {
+    for(const message& msg : in_msg_list) {
+      json script = json::parse(std::get<1>(msg));
+      for(const json& entry : script.value("messages", json::array())) {
+        out_msg_list.emplace_back(
+            std::get<0>(msg), get_payload(entry), get_opcode(entry)
+          );
+      }
+      for(const json& entry : script.value("broadcasts", json::array())) {
+        broadcast_list.emplace_back(get_payload(entry), get_opcode(entry));
+      }
+    }
+  }
+
+  bool is_done() const {
+    return false;
+  }
+
+  bool is_valid() const {
+    return true;
+  }
+
+  json get_state() const {
+    return json{};
+  }
+
+private:
+  static opcode get_opcode(const json& entry) {
+    return entry.at(0).get<bool>() ? websocketpp::frame::opcode::binary
+      : websocketpp::frame::opcode::text;
+  }
+
+  static std::string get_payload(const json& entry) {
+    std::string payload = entry.at(1).get<std::string>();
+    if(entry.size() > 2) {
+      payload.resize(entry.at(2).get<std::size_t>(), ' ');
+    }
+    return payload;
+  }
+};
+
+// a test_script_game whose messages and broadcasts starting with "key" have
+// the conflation key of the digit that follows
+class test_keyed_script_game : public test_script_game {
+public:
+  using test_script_game::test_script_game;
+
+  std::size_t get_conflation_key(const message& msg) const {
+    return get_key(std::get<1>(msg));
+  }
+
+  std::size_t get_broadcast_conflation_key(const broadcast& msg) const {
+    return get_key(msg.first);
+  }
+
+private:
+  static std::size_t get_key(const std::string& payload) {
+    if(payload.size() > 3 && payload.compare(0, 3, "key") == 0) {
+      return payload[3] - '0';
+    }
+    return 0;
+  }
+};
+
+// a game that exchanges decoded json values with its players
+class test_codec_game {
+public:
+  using player_traits = test_player_traits;
+  using player_id = player_traits::id::player_id;
+  using message = std::pair<player_id, json>;
+
+  test_codec_game(const json& data) {}
+
+  void connect(vector<message>& out_msg_list, player_id id) {
+    out_msg_list.emplace_back(id, json{ { "connected", id } });
+  }
+
+  void disconnect(vector<message>& out_msg_list, player_id id) {}
+
+  void update(
+      vector<message>& out_msg_list,
+      vector<json>& broadcast_list,
+      const vector<message>& in_msg_list,
+      long delta_time
+    )
+  {
+    for(const message& msg : in_msg_list) {
+      broadcast_list.push_back(
+          json{ { "pid", msg.first }, { "data", msg.second } }
+        );
+    }
+  }
+
+  bool is_done() const {
+    return false;
+  }
+
+  bool is_valid() const {
+    return true;
+  }
+
+  json get_state() const {
+    return json{};
+  }
+};
+
 class test_matchmaker {
 public:
   using player_traits = test_player_traits;
@@ -199,4 +376,67 @@ private:
   session_id m_sid_count;
 };
 
+// a matchmaker that tracks waiting sessions from the server's events
+class test_event_matchmaker {
+public:
+  using player_traits = test_player_traits;
+  using session_id = player_traits::id::session_id;
+  using message = std::pair<session_id, std::string>;
+  using game = std::tuple<std::vector<session_id>, session_id, json>;
+
+  struct session_data {
+    session_data(const json& data) {}
+
+    bool is_valid() {
+      return true;
+    }
+  };
+
+  test_event_matchmaker() : m_sid_count(0) {}
+
+  void on_join(session_id sid, const session_data& data) {
+    m_waiting.push_back(sid);
+  }
+
+  void on_update(session_id sid, const session_data& data) {}
+
+  void on_leave(session_id sid) {
+    m_waiting.erase(
+        std::remove(m_waiting.begin(), m_waiting.end(), sid),
+        m_waiting.end()
+      );
+  }
+
+  bool can_match() const {
+    return m_waiting.size() > 1;
+  }
+
+  void match(
+      vector<game>& game_list,
+      vector<message>& messages,
+      long delta_time
+    )
+  {
+    std::size_t i = 0;
+    for(; i + 1 < m_waiting.size(); i += 2) {
+      game_list.emplace_back(
+          vector<session_id>{ m_waiting[i], m_waiting[i + 1] },
+          m_sid_count++,
+          json{ { "matched", true } }
+        );
+    }
+    m_waiting.erase(m_waiting.begin(), m_waiting.begin() + i);
+  }
+
+  json get_cancel_data() const {
+    json temp;
+    temp["matched"] = false;
+    return temp; 
+  }
+
+private:
+  vector<session_id> m_waiting;
+  session_id m_sid_count;
+};
+
 #endif // MINIMAL_GAME_HPP
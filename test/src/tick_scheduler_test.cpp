@@ -0,0 +1,78 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/tick_scheduler.hpp>
+
+#include <chrono>
+
+TEST_CASE("the tick scheduler should keep deadlines on a fixed grid") {
+  using simple_web_game_server::tick_scheduler;
+  using simple_web_game_server::catch_up_policy;
+  using simple_web_game_server::tick_stats;
+  using namespace std::chrono_literals;
+
+  tick_scheduler ticks;
+  tick_scheduler::time_point start = tick_scheduler::clock::now();
+
+  SUBCASE("late ticks should not delay later deadlines") {
+    ticks.start(10ms, catch_up_policy::skip, 4, start);
+    CHECK(ticks.get_deadline() == start + 10ms);
+
+    CHECK(ticks.tick(start + 13ms) == 13ms);
+    CHECK(ticks.get_deadline() == start + 20ms);
+
+    CHECK(ticks.tick(start + 20ms) == 7ms);
+    CHECK(ticks.get_deadline() == start + 30ms);
+
+    tick_stats stats = ticks.get_stats();
+    CHECK(stats.ticks == 2);
+    CHECK(stats.overruns == 0);
+    CHECK(stats.max_lateness == 3ms);
+  }
+
+  SUBCASE("the skip policy should drop missed ticks") {
+    ticks.start(10ms, catch_up_policy::skip, 4, start);
+
+    CHECK(ticks.tick(start + 45ms) == 45ms);
+    CHECK(ticks.get_deadline() == start + 50ms);
+
+    tick_stats stats = ticks.get_stats();
+    CHECK(stats.overruns == 1);
+    CHECK(stats.skipped == 3);
+  }
+
+  SUBCASE("the accumulate policy should run every missed tick") {
+    ticks.start(10ms, catch_up_policy::accumulate, 4, start);
+
+    tick_scheduler::time_point now = start + 45ms;
+    int count = 0;
+    while(ticks.get_deadline() <= now) {
+      CHECK(ticks.tick(now) == 10ms);
+      ++count;
+    }
+
+    CHECK(count == 4);
+    CHECK(ticks.get_deadline() == start + 50ms);
+    CHECK(ticks.get_stats().skipped == 0);
+  }
+
+  SUBCASE("the clamp policy should bound the backlog of ticks") {
+    ticks.start(10ms, catch_up_policy::clamp, 2, start);
+
+    tick_scheduler::time_point now = start + 105ms;
+    int count = 0;
+    while(ticks.get_deadline() <= now) {
+      CHECK(ticks.tick(now) == 10ms);
+      ++count;
+    }
+
+    CHECK(count == 3);
+    CHECK(ticks.get_deadline() == start + 110ms);
+    CHECK(ticks.get_stats().skipped == 7);
+  }
+
+  SUBCASE("restarting should move the grid") {
+    ticks.start(10ms, catch_up_policy::accumulate, 4, start);
+    ticks.restart(start + 1s);
+    CHECK(ticks.get_deadline() == start + 1s + 10ms);
+  }
+}
@@ -0,0 +1,54 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/token_cache.hpp>
+
+#include <string>
+#include <chrono>
+
+TEST_CASE("the token cache should return unexpired tokens") {
+  using token_cache = simple_web_game_server::token_cache<int>;
+  using namespace std::chrono_literals;
+
+  token_cache cache{2};
+  token_cache::time_point now = token_cache::clock::now();
+  int v = 0;
+
+  SUBCASE("cached tokens should be found until they expire") {
+    cache.put("a", 1, now + 10s, now);
+    CHECK(cache.get("a", v, now));
+    CHECK(v == 1);
+    CHECK(cache.get("b", v, now) == false);
+
+    CHECK(cache.get("a", v, now + 10s) == false);
+    CHECK(cache.size() == 0);
+  }
+
+  SUBCASE("expired tokens should not be cached") {
+    cache.put("a", 1, now, now);
+    CHECK(cache.size() == 0);
+    CHECK(cache.get("a", v, now) == false);
+  }
+
+  SUBCASE("the least recently used token should be evicted") {
+    cache.put("a", 1, now + 10s, now);
+    cache.put("b", 2, now + 10s, now);
+    CHECK(cache.get("a", v, now));
+    cache.put("c", 3, now + 10s, now);
+
+    CHECK(cache.size() == 2);
+    CHECK(cache.get("b", v, now) == false);
+    CHECK(cache.get("a", v, now));
+    CHECK(v == 1);
+    CHECK(cache.get("c", v, now));
+    CHECK(v == 3);
+  }
+
+  SUBCASE("a capacity of zero should disable the cache") {
+    cache.put("a", 1, now + 10s, now);
+    cache.set_capacity(0);
+    CHECK(cache.size() == 0);
+
+    cache.put("b", 2, now + 10s, now);
+    CHECK(cache.get("b", v, now) == false);
+  }
+}
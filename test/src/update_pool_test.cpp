@@ -0,0 +1,59 @@
+#include <doctest/doctest.h>
+
+#include <simple_web_game_server/update_pool.hpp>
+
+#include <vector>
+#include <atomic>
+
+TEST_CASE("the update pool should run every index exactly once") {
+  using simple_web_game_server::update_pool;
+
+  update_pool pool;
+
+  std::vector<std::atomic<int> > counts(10000);
+  auto count = [&](std::size_t i){
+      // uneven work so that threads must steal
+      volatile std::size_t x = 0;
+      for(std::size_t j = 0; j < (i % 64) * 16; ++j) {
+        x = x + j;
+      }
+      ++counts[i];
+    };
+
+  SUBCASE("with several threads") {
+    pool.start(4, false);
+    CHECK(pool.thread_count() == 4);
+
+    for(int run = 1; run <= 3; ++run) {
+      pool.run(counts.size(), count);
+      std::size_t wrong = 0;
+      for(std::atomic<int>& c : counts) {
+        wrong += (c != run);
+      }
+      CHECK(wrong == 0);
+    }
+  }
+
+  SUBCASE("with more threads than indices") {
+    pool.start(8, false);
+    pool.run(3, count);
+    CHECK(counts[0] == 1);
+    CHECK(counts[1] == 1);
+    CHECK(counts[2] == 1);
+    CHECK(counts[3] == 0);
+  }
+
+  SUBCASE("on the calling thread alone") {
+    pool.start(1, false);
+    CHECK(pool.thread_count() == 1);
+    pool.run(counts.size(), count);
+    std::size_t wrong = 0;
+    for(std::atomic<int>& c : counts) {
+      wrong += (c != 1);
+    }
+    CHECK(wrong == 0);
+  }
+
+  pool.stop();
+  CHECK(pool.thread_count() == 1);
+}